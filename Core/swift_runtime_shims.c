@@ -17,9 +17,13 @@
 
 #include "core_kernel_abi.h"
 #include "core_kernel_abi_v3.h"
+#include "core_kernel_abi_v4.h"
+#include "core_kernel_abi_v5.h"
 
 static const kernel_services_v1_t *g_services;
 static const kernel_services_v3_t *g_services_v3;
+static const kernel_services_v4_t *g_services_v4;
+static const kernel_services_v5_t *g_services_v5;
 // Shadow copy of the v1 subset for back-compat consumers.
 // We keep a copy instead of casting a v3 pointer to v1 to avoid strict-aliasing UB.
 static kernel_services_v1_t g_services_v1_shadow;
@@ -64,6 +68,22 @@ const kernel_services_v3_t *core_services_v3(void) {
     return g_services_v3;
 }
 
+void core_set_services_v4(const kernel_services_v4_t *services) {
+    g_services_v4 = services;
+}
+
+const kernel_services_v4_t *core_services_v4(void) {
+    return g_services_v4;
+}
+
+void core_set_services_v5(const kernel_services_v5_t *services) {
+    g_services_v5 = services;
+}
+
+const kernel_services_v5_t *core_services_v5(void) {
+    return g_services_v5;
+}
+
 // ---------- Logging / stdio ----------
 
 __attribute__((weak))
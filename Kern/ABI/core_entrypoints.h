@@ -3,7 +3,7 @@
 //
 // Design goals:
 //  - Core is treated as a required component of the system build.
-//  - Kernel seeds newer service ABIs (v3) while Core can still consume v1.
+//  - Kernel seeds newer service ABIs (v3, v4, v5) while Core can still consume v1.
 //
 
 #ifndef CORE_ENTRYPOINTS_H
@@ -13,6 +13,8 @@
 
 #include "core_kernel_abi.h"
 #include "core_kernel_abi_v3.h"
+#include "core_kernel_abi_v4.h"
+#include "core_kernel_abi_v5.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -40,6 +42,20 @@ static inline const kernel_services_v1_t *core_services(void) {
 void core_set_services_v3(const kernel_services_v3_t *services);
 const kernel_services_v3_t *core_services_v3(void);
 
+// ---- Services ABI (v4) ----
+// Adds scheduling controls (thread priorities) and, since 4.1, per-thread
+// scheduler accounting. The v4 table keeps the v3 prefix, so Core may keep
+// using core_services_v3() for IPC.
+void core_set_services_v4(const kernel_services_v4_t *services);
+const kernel_services_v4_t *core_services_v4(void);
+
+// ---- Services ABI (v5) ----
+// Adds thread creation with attributes (stack size, priority, affinity, QoS)
+// and joining; since 5.1 also changing a thread's QoS class, since 5.2
+// per-task CPU bandwidth reservations. Keeps the v4 prefix.
+void core_set_services_v5(const kernel_services_v5_t *services);
+const kernel_services_v5_t *core_services_v5(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -26,6 +26,7 @@ enum {
     KS_IPC_ERR_NO_MEM  = -3,
     KS_IPC_ERR_EMPTY   = -4,
     KS_IPC_ERR_CLOSED  = -5,
+    KS_IPC_ERR_TIMEOUT = -6,
 };
 
 // Fixed inline payload for bring-up.
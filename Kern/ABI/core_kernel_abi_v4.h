@@ -0,0 +1,99 @@
+// Kernel Services ABI v4
+//
+// v4 extends v3 with scheduling controls (thread priorities) and, since 4.1,
+// scheduler accounting.
+// The first fields match the v3 layout so a v4 pointer may be treated as v3
+// when only v3 features are used.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "core_kernel_abi_v3.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Versioning: bump MINOR on additive changes to the v4 table.
+#define CAPAZ_KERNEL_SERVICES_V4_MAJOR 4
+#define CAPAZ_KERNEL_SERVICES_V4_MINOR 1
+
+// Scheduling status codes (negative = error).
+typedef int32_t ks_sched_status_t;
+
+enum {
+    KS_SCHED_OK = 0,
+    KS_SCHED_ERR_INVALID = -1,
+    KS_SCHED_ERR_RIGHTS  = -2,
+};
+
+// Pseudo-handle naming the calling thread (never a valid capability handle).
+#define KS_THREAD_SELF ((ks_cap_handle_t)0)
+
+// Thread priorities: higher value runs first; equal priorities round-robin.
+#define KS_SCHED_PRIO_MIN     0u
+#define KS_SCHED_PRIO_MAX     31u
+#define KS_SCHED_PRIO_DEFAULT 16u
+
+// Wake-to-run latency histogram buckets: bucket 0 counts latencies under
+// 1 us and bucket i >= 1 those in [2^(i-1), 2^i) us; the last is open-ended.
+#define KS_SCHED_LAT_BUCKETS 20u
+
+// Scheduler accounting for one thread (v4.1). Times are in nanoseconds.
+typedef struct ks_sched_stats {
+    uint64_t run_ns;          // time spent running
+    uint64_t wait_ns;         // time spent ready but not running
+    uint64_t nr_voluntary;    // switches away by yielding or blocking
+    uint64_t nr_involuntary;  // preemptions
+    uint64_t nr_wakeups;
+    uint64_t wake_lat_max_ns; // worst wakeup-to-running latency
+    uint32_t wake_lat_hist[KS_SCHED_LAT_BUCKETS];
+} ks_sched_stats_t;
+
+// v4 services table.
+typedef struct kernel_services_v4 {
+    // v2 prefix (MUST NOT change order)
+    uint32_t abi_version;
+    uint32_t reserved0;
+    void (*log)(const char *s);
+    void *(*alloc)(size_t size);
+    void (*free)(void *ptr);
+    void (*yield)(void);
+
+    // v2 extensions (cap ops)
+    ks_cap_status_t (*cap_dup)(ks_cap_handle_t h, ks_cap_rights_t mask, ks_cap_handle_t *out);
+    ks_cap_status_t (*cap_transfer)(ks_cap_handle_t h, ks_cap_rights_t mask, ks_cap_handle_t *out);
+    ks_cap_status_t (*cap_drop)(ks_cap_handle_t h);
+    ks_cap_status_t (*cap_invalidate)(ks_cap_handle_t h);
+
+    // v3 extensions (IPC)
+    ks_ipc_status_t (*endpoint_create)(ks_cap_rights_t rights, ks_cap_handle_t *out);
+    ks_ipc_status_t (*ipc_send)(ks_cap_handle_t endpoint, const ks_ipc_msg_t *msg);
+    ks_ipc_status_t (*ipc_recv)(ks_cap_handle_t endpoint, ks_ipc_msg_t *out);
+
+    // v4 extensions (scheduling)
+    // `thread` is KS_THREAD_SELF or a thread capability with CAP_R_CONTROL.
+    // Contract:
+    //  - Thread context only (no IRQ).
+    //  - Priorities outside KS_SCHED_PRIO_MIN..KS_SCHED_PRIO_MAX are rejected.
+    //  - A queued thread moves to the tail of its new priority level.
+    ks_sched_status_t (*thread_get_priority)(ks_cap_handle_t thread, uint32_t *out);
+    ks_sched_status_t (*thread_set_priority)(ks_cap_handle_t thread, uint32_t priority);
+
+    // v4.1 extensions (accounting)
+    // Snapshot of a thread's scheduler accounting, including the run or wait
+    // interval in progress. `thread` is KS_THREAD_SELF or a thread capability
+    // with CAP_R_READ. Thread context only. Counters of a thread running on
+    // another CPU are approximate.
+    ks_sched_status_t (*thread_get_stats)(ks_cap_handle_t thread, ks_sched_stats_t *out);
+} kernel_services_v4_t;
+
+// Kernel-side access to the v4 service table.
+const kernel_services_v4_t *kernel_services_v4(void);
+
+#ifdef __cplusplus
+}
+#endif
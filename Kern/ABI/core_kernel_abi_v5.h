@@ -0,0 +1,159 @@
+// Kernel Services ABI v5
+//
+// v5 extends v4 with thread creation: Core starts kernel threads with
+// explicit attributes (stack size, priority, CPU affinity, QoS class) and
+// joins them through a thread capability. 5.1 adds per-thread QoS classes,
+// 5.2 per-task CPU bandwidth reservations.
+// The first fields match the v4 layout so a v5 pointer may be treated as v4
+// when only v4 features are used.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "core_kernel_abi_v4.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Versioning: bump MINOR on additive changes to the v5 table.
+#define CAPAZ_KERNEL_SERVICES_V5_MAJOR 5
+#define CAPAZ_KERNEL_SERVICES_V5_MINOR 2
+
+// Added to the v4 scheduling status codes.
+enum {
+    KS_SCHED_ERR_NO_MEM = -3,
+};
+
+// Quality-of-service classes, most latency-sensitive first. DEFAULT leaves
+// the thread to its numeric priority; any other class sets the priority
+// (what the thread preempts) and the time slice, and BACKGROUND threads are
+// throttled to a share of each CPU.
+enum {
+    KS_THREAD_QOS_DEFAULT = 0,
+    KS_THREAD_QOS_USER_INTERACTIVE,
+    KS_THREAD_QOS_USER_INITIATED,
+    KS_THREAD_QOS_UTILITY,
+    KS_THREAD_QOS_BACKGROUND,
+};
+
+// Affinity masks: bit n allows CPU n.
+#define KS_THREAD_AFFINITY_ANY 0xFFFFFFFFu
+
+// Stack sizes are in 4 KiB pages.
+#define KS_THREAD_STACK_PAGES_MIN     1u
+#define KS_THREAD_STACK_PAGES_DEFAULT 4u
+#define KS_THREAD_STACK_PAGES_MAX     16u
+
+typedef struct ks_thread_attr {
+    const char *name;          // kept by reference: must outlive the thread
+    uint32_t    stack_pages;   // KS_THREAD_STACK_PAGES_MIN..MAX
+    uint32_t    priority;      // KS_SCHED_PRIO_MIN..MAX; used with QOS_DEFAULT only
+    uint32_t    affinity;      // must include an online CPU
+    uint32_t    qos;           // KS_THREAD_QOS_*
+} ks_thread_attr_t;
+
+#define KS_THREAD_ATTR_INIT                                                \
+    { .name = NULL, .stack_pages = KS_THREAD_STACK_PAGES_DEFAULT,          \
+      .priority = KS_SCHED_PRIO_DEFAULT, .affinity = KS_THREAD_AFFINITY_ANY, \
+      .qos = KS_THREAD_QOS_DEFAULT }
+
+// The caller's own task (task_get_cpu_stats only).
+#define KS_TASK_SELF ((ks_cap_handle_t)0)
+
+// CPU bandwidth period bounds (microseconds).
+#define KS_TASK_CPU_PERIOD_MIN_US 1000u
+#define KS_TASK_CPU_PERIOD_MAX_US 1000000u
+
+// Task CPU accounting.
+typedef struct ks_task_cpu_stats {
+    uint64_t usage_ns;        // CPU time used by the task's threads
+    uint64_t throttled_ns;    // time spent throttled
+    uint64_t nr_throttled;    // periods in which the quota ran out
+} ks_task_cpu_stats_t;
+
+// v5 services table.
+typedef struct kernel_services_v5 {
+    // v2 prefix (MUST NOT change order)
+    uint32_t abi_version;
+    uint32_t reserved0;
+    void (*log)(const char *s);
+    void *(*alloc)(size_t size);
+    void (*free)(void *ptr);
+    void (*yield)(void);
+
+    // v2 extensions (cap ops)
+    ks_cap_status_t (*cap_dup)(ks_cap_handle_t h, ks_cap_rights_t mask, ks_cap_handle_t *out);
+    ks_cap_status_t (*cap_transfer)(ks_cap_handle_t h, ks_cap_rights_t mask, ks_cap_handle_t *out);
+    ks_cap_status_t (*cap_drop)(ks_cap_handle_t h);
+    ks_cap_status_t (*cap_invalidate)(ks_cap_handle_t h);
+
+    // v3 extensions (IPC)
+    ks_ipc_status_t (*endpoint_create)(ks_cap_rights_t rights, ks_cap_handle_t *out);
+    ks_ipc_status_t (*ipc_send)(ks_cap_handle_t endpoint, const ks_ipc_msg_t *msg);
+    ks_ipc_status_t (*ipc_recv)(ks_cap_handle_t endpoint, ks_ipc_msg_t *out);
+
+    // v4 extensions (scheduling)
+    ks_sched_status_t (*thread_get_priority)(ks_cap_handle_t thread, uint32_t *out);
+    ks_sched_status_t (*thread_set_priority)(ks_cap_handle_t thread, uint32_t priority);
+
+    // v4.1 extensions (accounting)
+    ks_sched_status_t (*thread_get_stats)(ks_cap_handle_t thread, ks_sched_stats_t *out);
+
+    // v5 extensions (threads)
+    // Create and start a thread running entry(arg) in the caller's task.
+    // `attr` may be NULL for KS_THREAD_ATTR_INIT. On success *out is a thread
+    // capability with CAP_R_READ | CAP_R_CONTROL (usable with the v4 calls).
+    // Contract:
+    //  - Thread context only (no IRQ).
+    //  - Invalid attributes return KS_SCHED_ERR_INVALID, exhausted memory or
+    //    cap slots KS_SCHED_ERR_NO_MEM.
+    //  - The handle cannot be duplicated or transferred. Dropping or
+    //    invalidating it (cap_drop/cap_invalidate) detaches the thread: it
+    //    can no longer be joined and is freed by the kernel once it exits.
+    ks_sched_status_t (*thread_create)(const ks_thread_attr_t *attr,
+                                       void (*entry)(void *), void *arg,
+                                       ks_cap_handle_t *out);
+
+    // Wait for a thread from thread_create() to return from its entry (or
+    // call thread exit), then free it and remove `thread` from the cap-space.
+    // Of concurrent joiners of one handle only the first joins; the others
+    // get KS_SCHED_ERR_RIGHTS or KS_SCHED_ERR_INVALID. A thread cannot join
+    // itself.
+    ks_sched_status_t (*thread_join)(ks_cap_handle_t thread);
+
+    // v5.1 extensions (QoS)
+    // Move a thread (KS_THREAD_SELF or a thread capability) to a QoS class.
+    // A class other than KS_THREAD_QOS_DEFAULT replaces the thread's priority
+    // with the class's; thread_set_priority() may still override it.
+    // Contract:
+    //  - Thread context only (no IRQ).
+    //  - set needs CAP_R_CONTROL, get CAP_R_READ; an unknown class returns
+    //    KS_SCHED_ERR_INVALID.
+    ks_sched_status_t (*thread_set_qos)(ks_cap_handle_t thread, uint32_t qos);
+    ks_sched_status_t (*thread_get_qos)(ks_cap_handle_t thread, uint32_t *out);
+
+    // v5.2 extensions (CPU bandwidth)
+    // Limit a task's threads to `quota_us` of CPU time, summed over all CPUs,
+    // in every `period_us` (KS_TASK_CPU_PERIOD_MIN_US..MAX_US; the quota may
+    // be up to one period per CPU). Past the quota the task's threads are
+    // held back until the next period. quota_us == 0 lifts the limit.
+    // Contract:
+    //  - Thread context only (no IRQ).
+    //  - `task` is a task capability with CAP_R_CONTROL; invalid limits
+    //    return KS_SCHED_ERR_INVALID.
+    ks_sched_status_t (*task_set_cpu_quota)(ks_cap_handle_t task, uint32_t quota_us,
+                                            uint32_t period_us);
+    // `task` is KS_TASK_SELF or a task capability with CAP_R_READ.
+    ks_sched_status_t (*task_get_cpu_stats)(ks_cap_handle_t task, ks_task_cpu_stats_t *out);
+} kernel_services_v5_t;
+
+// Kernel-side access to the v5 service table.
+const kernel_services_v5_t *kernel_services_v5(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -24,6 +24,8 @@
 #define GICD_IPRIORITYR(n) (0x400 + 4u*(n))
 /* Interrupt configuration registers (2 bits / interrupt). */
 #define GICD_ICFGR(n)     (0xC00 + 4u*(n))
+/* Software generated interrupt register. */
+#define GICD_SGIR         0xF00
 
 /* CPU interface registers */
 #define GICC_CTLR        0x000
@@ -31,6 +33,7 @@
 #define GICC_BPR         0x008
 #define GICC_IAR         0x00C
 #define GICC_EOIR        0x010
+#define GICC_HPPIR       0x018
 
 static inline void mmio_write32(uint64_t base, uint32_t off, uint32_t val)
 {
@@ -47,8 +50,23 @@ static inline void isb(void)    { __asm__ volatile("isb" ::: "memory"); }
 
 void gicv2_init(void)
 {
-    /* Disable distributor + CPU interface while configuring. */
+    /* Disable the distributor while configuring. */
     mmio_write32(GICD_BASE, GICD_CTLR, 0);
+    dsb_sy(); isb();
+
+    /* Enable the distributor (Group 0). */
+    mmio_write32(GICD_BASE, GICD_CTLR, (1u << 0));
+    dsb_sy(); isb();
+
+    gicv2_init_cpu();
+}
+
+void gicv2_init_cpu(void)
+{
+    /*
+     * Everything below is banked per CPU: IGROUPR0 (SGIs/PPIs), PMR, BPR and
+     * the CPU interface CTLR. Every CPU runs this once before unmasking IRQs.
+     */
     mmio_write32(GICC_BASE, GICC_CTLR, 0);
     dsb_sy(); isb();
 
@@ -63,16 +81,13 @@ void gicv2_init(void)
      * CapazOS currently runs entirely in one world, so keep interrupts in Group 0
      * (Secure) by default.
      */
-    uint32_t ig0 = mmio_read32(GICD_BASE, GICD_IGROUPR(0));
-    ig0 &= ~0xFFFF0000u;               /* PPIs 16..31 -> Group 0 */
-    mmio_write32(GICD_BASE, GICD_IGROUPR(0), ig0);
+    mmio_write32(GICD_BASE, GICD_IGROUPR(0), 0u); /* SGIs 0..15 + PPIs 16..31 -> Group 0 */
 
     /* Set a permissive priority mask (allow all). */
     mmio_write32(GICC_BASE, GICC_PMR, 0xFFu);
     mmio_write32(GICC_BASE, GICC_BPR, 0u);
 
-    /* Enable the distributor + CPU interface (Group 0). */
-    mmio_write32(GICD_BASE, GICD_CTLR, (1u << 0));
+    /* Enable the CPU interface (Group 0). */
     mmio_write32(GICC_BASE, GICC_CTLR, (1u << 0));
     dsb_sy(); isb();
 }
@@ -133,3 +148,19 @@ void gicv2_end_interrupt(uint32_t iar)
     mmio_write32(GICC_BASE, GICC_EOIR, iar);
     dsb_sy();
 }
+
+uint32_t gicv2_highest_pending(void)
+{
+    return mmio_read32(GICC_BASE, GICC_HPPIR) & 0x3FFu;
+}
+
+void gicv2_send_sgi(uint32_t target_mask, uint32_t sgi)
+{
+    /*
+     * TargetListFilter=0 (use the list), CPUTargetList=[23:16], NSATT=0
+     * (Group 0, matching gicv2_init_cpu()), SGIINTID=[3:0].
+     * The barrier orders prior memory writes before the interrupt is sent.
+     */
+    dsb_sy();
+    mmio_write32(GICD_BASE, GICD_SGIR, ((target_mask & 0xFFu) << 16) | (sgi & 0xFu));
+}
@@ -4,8 +4,19 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+/* Boot CPU: distributor + this CPU's interface. */
 void gicv2_init(void);
 
+/*
+ * Per-CPU interface setup (banked SGI/PPI group, priority mask). Secondary
+ * CPUs call this before unmasking IRQs. PPI enables (e.g. the timer) are also
+ * banked, so each CPU enables its own.
+ */
+void gicv2_init_cpu(void);
+
+/* Send SGI `sgi` (0..15) to every CPU whose bit is set in target_mask. */
+void gicv2_send_sgi(uint32_t target_mask, uint32_t sgi);
+
 /* Enable/disable an interrupt ID (PPI/SPI). */
 void gicv2_enable_irq(uint32_t irq);
 void gicv2_disable_irq(uint32_t irq);
@@ -14,6 +25,12 @@ void gicv2_disable_irq(uint32_t irq);
 uint32_t gicv2_acknowledge(void);
 void gicv2_end_interrupt(uint32_t iar);
 
+/*
+ * ID of the highest-priority interrupt pending on this CPU's interface
+ * without acknowledging it; 1023 (spurious) if none.
+ */
+uint32_t gicv2_highest_pending(void);
+
 /* Configure interrupt trigger type (edge=true, level=false). */
 void gicv2_config_irq(uint32_t irq, bool edge);
 
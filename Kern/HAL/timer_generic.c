@@ -1,25 +1,32 @@
 #include "timer_generic.h"
 
 #include "config.h"
+#include "smp/percpu.h"
 
 /*
  * ARM Generic Timer (AArch64) - CNTV (virtual timer).
  *
  * Clocksource: CNTVCT_EL0
  * Clockevent:  CNTV_{TVAL,CVAL,CTL}_EL0
+ *
+ * The CNTV registers are banked per CPU, so each CPU owns its clockevent
+ * state.
+ *
+ * A CPU has one comparator but two event sources: the periodic tick and an
+ * optional one-shot deadline. The comparator is always programmed with the
+ * earlier of the two. The tick can be stopped while the CPU idles
+ * (CONFIG_TICKLESS), so the tick count is derived from the counter instead of
+ * counting interrupts.
  */
 
-static volatile uint64_t s_ticks;
+/* Counter value at timer bring-up on the boot CPU; timer_ticks_read() base. */
+static uint64_t s_tick_base;
 
-typedef enum {
-    EVENT_MODE_OFF = 0,
-    EVENT_MODE_PERIODIC,
-    EVENT_MODE_ONESHOT,
-} event_mode_t;
-
-static event_mode_t s_mode = EVENT_MODE_OFF;
-static uint64_t s_period_ticks;
-static uint64_t s_next_deadline;
+/* Callers run with IRQs masked or in the timer IRQ itself, so no migration. */
+static inline event_cpu_t *event_this_cpu(void)
+{
+    return &this_cpu_ptr()->event;
+}
 
 static inline uint64_t read_cntfrq(void)
 {
@@ -58,6 +65,33 @@ uint64_t time_now(void)
     return read_cntvct();
 }
 
+uint64_t time_freq(void)
+{
+    return read_cntfrq();
+}
+
+/* Program the comparator with the earliest pending event, or stop it. */
+static void event_program(const event_cpu_t *ev)
+{
+    uint64_t cval = UINT64_MAX;
+    if (ev->mode == EVENT_MODE_PERIODIC) {
+        cval = ev->next_deadline;
+    }
+    if (ev->oneshot_deadline != 0 && ev->oneshot_deadline < cval) {
+        cval = ev->oneshot_deadline;
+    }
+    if (cval == UINT64_MAX) {
+        write_cntv_ctl(0x0);
+        return;
+    }
+
+    /* Program absolute compare value (CVAL). */
+    write_cntv_cval(cval);
+
+    /* enable=1, imask=0 */
+    write_cntv_ctl(0x1);
+}
+
 static uint64_t hz_to_period_ticks(uint32_t hz)
 {
     if (hz == 0) {
@@ -68,84 +102,115 @@ static uint64_t hz_to_period_ticks(uint32_t hz)
 
 void event_arm_periodic(uint32_t hz)
 {
+    event_cpu_t *ev = event_this_cpu();
     uint64_t period = hz_to_period_ticks(hz);
     if (period == 0) {
-        s_mode = EVENT_MODE_OFF;
-        write_cntv_ctl(0);
+        ev->mode = EVENT_MODE_OFF;
+        event_program(ev);
         return;
     }
 
-    s_period_ticks = period;
-    s_mode = EVENT_MODE_PERIODIC;
+    ev->period_ticks = period;
+    ev->mode = EVENT_MODE_PERIODIC;
 
     /* Program the next firing using an absolute compare (CVAL). */
-    s_next_deadline = time_now() + s_period_ticks;
-    write_cntv_cval(s_next_deadline);
-
-    /* enable=1, imask=0 */
-    write_cntv_ctl(0x1);
+    ev->next_deadline = time_now() + ev->period_ticks;
+    event_program(ev);
 }
 
 void event_arm_oneshot(uint64_t absolute_deadline)
 {
-    s_mode = EVENT_MODE_ONESHOT;
+    event_cpu_t *ev = event_this_cpu();
 
-    /* Program absolute compare value (CVAL). */
-    write_cntv_cval(absolute_deadline);
+    /* Replaces any pending one-shot; 0 would read as "none". */
+    ev->oneshot_deadline = absolute_deadline ? absolute_deadline : 1u;
+    event_program(ev);
+}
 
-    /* enable=1, imask=0 */
-    write_cntv_ctl(0x1);
+uint64_t event_oneshot_deadline(void)
+{
+    return event_this_cpu()->oneshot_deadline;
 }
 
-void event_handle_irq(void)
+void event_tick_stop(void)
 {
-    /* Any timer interrupt implies the compare fired. */
-    s_ticks++;
+    event_cpu_t *ev = event_this_cpu();
+    if (ev->mode != EVENT_MODE_PERIODIC) {
+        return;
+    }
+    ev->mode = EVENT_MODE_STOPPED;
+    event_program(ev);
+}
 
-    if (s_mode == EVENT_MODE_PERIODIC) {
-        /* Rearm by scheduling the next absolute deadline. */
-        uint64_t now = time_now();
+void event_tick_restart(void)
+{
+    event_cpu_t *ev = event_this_cpu();
+    if (ev->mode != EVENT_MODE_STOPPED) {
+        return;
+    }
+    ev->mode = EVENT_MODE_PERIODIC;
+    ev->next_deadline = time_now() + ev->period_ticks;
+    event_program(ev);
+}
 
+void event_disable(void)
+{
+    event_cpu_t *ev = event_this_cpu();
+    ev->mode = EVENT_MODE_OFF;
+    ev->oneshot_deadline = 0;
+    write_cntv_ctl(0x0);
+}
+
+bool event_handle_irq(void)
+{
+    event_cpu_t *ev = event_this_cpu();
+    const uint64_t now = time_now();
+    bool ticked = false;
+
+    /* A due one-shot is consumed; a later one stays pending. */
+    if (ev->oneshot_deadline != 0 && now >= ev->oneshot_deadline) {
+        ev->oneshot_deadline = 0;
+    }
+
+    if (ev->mode == EVENT_MODE_PERIODIC && now >= ev->next_deadline) {
+        ticked = true;
+        ev->next_deadline += ev->period_ticks;
         /*
          * If we serviced late (e.g. interrupts masked), avoid drifting into
          * the past.
          */
-        if (now >= s_next_deadline) {
-            s_next_deadline = now + s_period_ticks;
-        } else {
-            s_next_deadline += s_period_ticks;
+        if (ev->next_deadline <= now) {
+            ev->next_deadline = now + ev->period_ticks;
         }
-
-        write_cntv_cval(s_next_deadline);
-        return;
     }
 
-    /* One-shot: disarm to avoid refiring on a stale compare. */
-    s_mode = EVENT_MODE_OFF;
-    write_cntv_ctl(0x0);
+    /* Rearm for the earliest remaining event (or disarm). */
+    event_program(ev);
+    return ticked;
 }
 
 /* ---------------- Compatibility wrappers ---------------- */
 
 void timer_init_hz(uint32_t hz)
 {
-#if CONFIG_TICKLESS
-    (void)hz;
-    /* Tickless build: do not start a periodic tick. */
-    s_mode = EVENT_MODE_OFF;
-    write_cntv_ctl(0x0);
-#else
+    if (s_tick_base == 0) {
+        s_tick_base = time_now();
+    }
+    /* Tickless builds also tick while busy; the idle loop stops it. */
     event_arm_periodic(hz);
-#endif
 }
 
-void timer_handle_irq(void)
+bool timer_handle_irq(void)
 {
-    event_handle_irq();
+    return event_handle_irq();
 }
 
 uint64_t timer_ticks_read(void)
 {
-    return s_ticks;
+    const uint64_t period = hz_to_period_ticks(CONFIG_TICK_HZ);
+    if (period == 0 || s_tick_base == 0) {
+        return 0;
+    }
+    return (time_now() - s_tick_base) / period;
 }
 
@@ -1,6 +1,7 @@
 #ifndef TIMER_GENERIC_H
 #define TIMER_GENERIC_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 /*
@@ -9,26 +10,66 @@
  * The underlying implementation uses the ARM Generic Timer (CNTV).
  * - time_now() is the clocksource: read the current counter.
  * - event_*() is the clockevent: program the compare and handle IRQs.
+ *   Clockevent calls act on the calling CPU's timer, with IRQs masked.
+ *   The periodic tick and one one-shot deadline can be armed together.
  */
 
+typedef enum {
+    EVENT_MODE_OFF = 0,
+    EVENT_MODE_PERIODIC,
+    EVENT_MODE_STOPPED,            /* periodic, paused by event_tick_stop() */
+} event_mode_t;
+
+/*
+ * Clockevent state of one CPU, kept in the per-CPU block (smp/percpu.h).
+ * Only timer_generic.c looks inside.
+ */
+typedef struct event_cpu {
+    event_mode_t mode;             /* periodic tick on/off/stopped */
+    uint64_t period_ticks;
+    uint64_t next_deadline;        /* next periodic tick */
+    uint64_t oneshot_deadline;     /* 0 = no one-shot pending */
+} event_cpu_t;
+
 /* Clocksource: current counter value (CNTVCT) in counter ticks. */
 uint64_t time_now(void);
 
-/* Clockevent: arm oneshot at an absolute counter deadline (CNTVCT units). */
+/* Clocksource frequency (CNTFRQ) in Hz. */
+uint64_t time_freq(void);
+
+/*
+ * Clockevent: arm oneshot at an absolute counter deadline (CNTVCT units).
+ * Replaces a pending one-shot and leaves the periodic tick running.
+ */
 void event_arm_oneshot(uint64_t deadline);
 
+/* Clockevent: pending one-shot deadline on this CPU, or 0 if none. */
+uint64_t event_oneshot_deadline(void);
+
 /* Clockevent: arm periodic interrupts at the given rate (Hz). */
 void event_arm_periodic(uint32_t hz);
 
-/* Clockevent: disable event generation. */
+/*
+ * Clockevent: pause / resume the periodic tick on this CPU (tickless idle).
+ * A pending one-shot stays armed. Both are no-ops if no tick was started;
+ * restart begins a fresh period from now.
+ */
+void event_tick_stop(void);
+void event_tick_restart(void);
+
+/* Clockevent: disable event generation (tick and one-shot). */
 void event_disable(void);
 
-/* Clockevent: IRQ handler bookkeeping + re-arm as needed. */
-void event_handle_irq(void);
+/*
+ * Clockevent: IRQ handler bookkeeping + re-arm as needed. Returns true if a
+ * periodic tick elapsed (false for a one-shot-only or spurious interrupt).
+ */
+bool event_handle_irq(void);
 
 /* Compatibility wrappers used by existing kernel code. */
 void timer_init_hz(uint32_t hz);
-void timer_handle_irq(void);
+bool timer_handle_irq(void);
+/* Ticks of CONFIG_TICK_HZ since timer bring-up (derived from the counter). */
 uint64_t timer_ticks_read(void);
 
 /*
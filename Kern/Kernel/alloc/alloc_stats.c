@@ -26,6 +26,7 @@ bool kernel_get_alloc_stats(kernel_alloc_stats_t *out) {
     out->have_thread_cache = thread_cache_get_stats(&out->thread_cache);
     out->have_ipc_msg_cache = ipc_msg_cache_get_stats(&out->ipc_msg_cache);
     out->have_cap_entry_cache = cap_entry_cache_get_stats(&out->cap_entry_cache);
+    (void)kstack_cache_get_stats(&out->kstack_cache);
 
     return true;
 }
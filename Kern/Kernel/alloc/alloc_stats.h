@@ -9,6 +9,7 @@
 
 #include <stdbool.h>
 
+#include "alloc/kstack_cache.h"
 #include "alloc/slab_cache.h"
 #include "kheap.h"
 #include "mm/pmm.h"
@@ -22,6 +23,9 @@ typedef struct kernel_alloc_stats {
     slab_cache_stats_t ipc_msg_cache;
     slab_cache_stats_t cap_entry_cache;
 
+    /* Kernel thread stacks. */
+    kstack_cache_stats_t kstack_cache;
+
     /* Buffer allocator (variable sized). */
     kheap_stats_t kheap;
 
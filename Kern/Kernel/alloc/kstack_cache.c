@@ -0,0 +1,167 @@
+/*
+ * kstack_cache.c — kernel stack cache (see kstack_cache.h).
+ */
+
+#include "alloc/kstack_cache.h"
+
+#include <stddef.h>
+
+#include "config.h"
+#include "contracts.h"
+#include "mm/pmm.h"
+#include "sched/thread.h"
+#include "sync/spinlock.h"
+
+typedef struct kstack_free {
+    struct kstack_free *next;
+} kstack_free_t;
+
+static spinlock_t g_kstack_lock = SPINLOCK_INIT;
+static kstack_free_t *g_kstack_free;
+static uint32_t g_kstack_count;
+static kstack_cache_stats_t g_kstack_stats;
+
+static void kstack_release_pages(void *base, uint32_t pages) {
+    pmm_free_pages(pmm_virt_to_phys((uint64_t)(uintptr_t)base), pages);
+}
+
+static void kstack_push_locked(void *base) {
+    kstack_free_t *n = (kstack_free_t *)base;
+    n->next = g_kstack_free;
+    g_kstack_free = n;
+    g_kstack_count++;
+}
+
+static void *kstack_pop_locked(void) {
+    kstack_free_t *n = g_kstack_free;
+    if (!n) {
+        return NULL;
+    }
+    g_kstack_free = n->next;
+    g_kstack_count--;
+    return n;
+}
+
+static bool kstack_memory_low(void) {
+    uint64_t free_pages = 0;
+    if (!pmm_get_stats(&free_pages, NULL)) {
+        return false;
+    }
+    return free_pages < (uint64_t)CONFIG_KSTACK_CACHE_LOW_PAGES;
+}
+
+/*
+ * Grab up to a batch of stacks in one contiguous PMM allocation (one buddy
+ * block), falling back to smaller runs when memory is fragmented. Returns one
+ * stack and caches the rest; NULL if not even one stack is available.
+ */
+static void *kstack_refill(void) {
+    for (uint32_t n = CONFIG_KSTACK_CACHE_BATCH; n > 0; n /= 2u) {
+        uint64_t pa = 0;
+        if (!pmm_alloc_pages(n * KSTACK_PAGES_DEFAULT, &pa)) {
+            continue;
+        }
+        uint8_t *va = (uint8_t *)(uintptr_t)pmm_phys_to_virt(pa);
+
+        uint64_t flags = spin_lock_irqsave(&g_kstack_lock);
+        for (uint32_t i = 1; i < n; i++) {
+            kstack_push_locked(va + (size_t)i * KSTACK_SIZE_DEFAULT);
+        }
+        g_kstack_stats.refills++;
+        spin_unlock_irqrestore(&g_kstack_lock, flags);
+        return va;
+    }
+    return NULL;
+}
+
+void *kstack_alloc(void) {
+    ASSERT_THREAD_CONTEXT();
+    uint64_t flags = spin_lock_irqsave(&g_kstack_lock);
+    g_kstack_stats.alloc_calls++;
+    void *base = kstack_pop_locked();
+    if (base) {
+        g_kstack_stats.hits++;
+    }
+    spin_unlock_irqrestore(&g_kstack_lock, flags);
+
+    return base ? base : kstack_refill();
+}
+
+void kstack_free(void *base) {
+    ASSERT_THREAD_CONTEXT();
+    if (!base) {
+        return;
+    }
+
+    const bool low = kstack_memory_low();
+    uint64_t flags = spin_lock_irqsave(&g_kstack_lock);
+    g_kstack_stats.free_calls++;
+    if (!low && g_kstack_count < CONFIG_KSTACK_CACHE_MAX) {
+        kstack_push_locked(base);
+        spin_unlock_irqrestore(&g_kstack_lock, flags);
+        return;
+    }
+    g_kstack_stats.released++;
+    spin_unlock_irqrestore(&g_kstack_lock, flags);
+
+    kstack_release_pages(base, KSTACK_PAGES_DEFAULT);
+    if (low) {
+        /* Under pressure the rest of the cache goes back too. */
+        (void)kstack_cache_trim();
+    }
+}
+
+void *kstack_alloc_pages(uint32_t pages) {
+    ASSERT_THREAD_CONTEXT();
+    if (pages == KSTACK_PAGES_DEFAULT) {
+        return kstack_alloc();
+    }
+    if (pages < KSTACK_PAGES_MIN || pages > KSTACK_PAGES_MAX) {
+        return NULL;
+    }
+    uint64_t pa = 0;
+    if (!pmm_alloc_pages(pages, &pa)) {
+        return NULL;
+    }
+    return (void *)(uintptr_t)pmm_phys_to_virt(pa);
+}
+
+void kstack_free_pages(void *base, uint32_t pages) {
+    ASSERT_THREAD_CONTEXT();
+    if (pages == KSTACK_PAGES_DEFAULT) {
+        kstack_free(base);
+        return;
+    }
+    if (base) {
+        kstack_release_pages(base, pages);
+    }
+}
+
+uint32_t kstack_cache_trim(void) {
+    ASSERT_THREAD_CONTEXT();
+    uint64_t flags = spin_lock_irqsave(&g_kstack_lock);
+    kstack_free_t *list = g_kstack_free;
+    const uint32_t n = g_kstack_count;
+    g_kstack_free = NULL;
+    g_kstack_count = 0;
+    g_kstack_stats.released += n;
+    spin_unlock_irqrestore(&g_kstack_lock, flags);
+
+    while (list) {
+        kstack_free_t *next = list->next;
+        kstack_release_pages(list, KSTACK_PAGES_DEFAULT);
+        list = next;
+    }
+    return n;
+}
+
+bool kstack_cache_get_stats(kstack_cache_stats_t *out) {
+    if (!out) {
+        return false;
+    }
+    uint64_t flags = spin_lock_irqsave(&g_kstack_lock);
+    *out = g_kstack_stats;
+    out->cached = g_kstack_count;
+    spin_unlock_irqrestore(&g_kstack_lock, flags);
+    return true;
+}
@@ -0,0 +1,56 @@
+#pragma once
+/*
+ * kstack_cache.h — cache of ready-to-use kernel thread stacks.
+ *
+ * Purpose:
+ *  - Make thread create/destroy O(1) in the common case: stacks are taken
+ *    from and returned to a free list instead of the PMM.
+ *  - The list is refilled CONFIG_KSTACK_CACHE_BATCH stacks at a time, so one
+ *    PMM scan serves several thread creations.
+ *  - Stacks freed above CONFIG_KSTACK_CACHE_MAX go back to the PMM. A free
+ *    while the PMM is below CONFIG_KSTACK_CACHE_LOW_PAGES free pages empties
+ *    the whole cache, and so does a PMM allocation that would otherwise
+ *    fail (kstack_cache_trim() from the PMM's reclaim path).
+ *
+ * Notes:
+ *  - Only KSTACK_PAGES_DEFAULT-page stacks are cached; other sizes
+ *    (kstack_alloc_pages()) come straight from the PMM.
+ *  - Thread-context only. One spinlock, never held across PMM calls.
+ *  - A free stack stores the list link in its lowest word.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct kstack_cache_stats {
+    uint64_t alloc_calls;
+    uint64_t free_calls;
+    uint64_t hits;           /* allocations served from the cache */
+    uint64_t refills;        /* PMM refill batches */
+    uint64_t released;       /* stacks handed back to the PMM */
+    uint64_t cached;         /* stacks currently on the free list */
+} kstack_cache_stats_t;
+
+/* Returns the direct-mapped base of a KSTACK_SIZE_DEFAULT stack, or NULL. */
+void *kstack_alloc(void);
+
+/* Return a stack from kstack_alloc(). */
+void kstack_free(void *base);
+
+/*
+ * A stack of `pages` pages (KSTACK_PAGES_MIN..KSTACK_PAGES_MAX): the default
+ * size goes through the cache, any other size is one contiguous PMM run.
+ * Returns NULL if out of memory or `pages` is out of range.
+ */
+void *kstack_alloc_pages(uint32_t pages);
+
+/* Return a stack from kstack_alloc_pages() with the same `pages`. */
+void kstack_free_pages(void *base, uint32_t pages);
+
+/* Release every cached stack to the PMM. Returns the number released.
+ * Called by the PMM when it runs dry; must not be called with a PMM or
+ * cache lock held. */
+uint32_t kstack_cache_trim(void);
+
+/* Returns false on invalid args. */
+bool kstack_cache_get_stats(kstack_cache_stats_t *out);
@@ -0,0 +1,227 @@
+/*
+ * magazine.c — per-CPU magazine layer (see magazine.h).
+ */
+
+#include "alloc/magazine.h"
+
+#include <stddef.h>
+
+#include "alloc/slab_cache.h"
+#include "contracts.h"
+#include "irq.h"
+#include "smp/percpu.h"
+
+struct magazine {
+    struct magazine *next;      /* depot chaining */
+    uint32_t rounds;
+    void *objs[CONFIG_MAG_ROUNDS];
+};
+
+/* Magazines themselves; a plain slab cache (no magazine layer of its own). */
+static slab_cache_t g_magazine_cache;
+static bool g_magazine_cache_ready;
+static spinlock_t g_magazine_cache_lock = SPINLOCK_INIT;
+
+static magazine_t *mag_new(void) {
+    magazine_t *mg = (magazine_t *)slab_alloc(&g_magazine_cache);
+    if (mg) {
+        mg->next = NULL;
+        mg->rounds = 0;
+    }
+    return mg;
+}
+
+static inline void mag_push(magazine_t **list, magazine_t *mg) {
+    mg->next = *list;
+    *list = mg;
+}
+
+static inline magazine_t *mag_pop(magazine_t **list) {
+    magazine_t *mg = *list;
+    if (mg) {
+        *list = mg->next;
+        mg->next = NULL;
+    }
+    return mg;
+}
+
+static inline void mag_swap(mag_cpu_t *mc) {
+    magazine_t *t = mc->loaded;
+    mc->loaded = mc->previous;
+    mc->previous = t;
+}
+
+void mag_layer_init(mag_layer_t *m, mag_fill_fn fill, mag_drain_fn drain, void *ctx) {
+    if (!m || !fill || !drain) {
+        panic("mag_layer_init: bad args");
+    }
+    /* Owners may set layers up lazily, so the shared cache is guarded. */
+    uint64_t flags = spin_lock_irqsave(&g_magazine_cache_lock);
+    if (!g_magazine_cache_ready) {
+        slab_cache_init_ex(&g_magazine_cache, "magazine", sizeof(magazine_t),
+                           (size_t)_Alignof(magazine_t), SLAB_CACHE_NO_MAGAZINES);
+        g_magazine_cache_ready = true;
+    }
+    spin_unlock_irqrestore(&g_magazine_cache_lock, flags);
+
+    for (uint32_t i = 0; i < (uint32_t)CONFIG_MAX_CPUS; i++) {
+        m->cpu[i].loaded = NULL;
+        m->cpu[i].previous = NULL;
+        m->cpu[i].allocs = 0;
+        m->cpu[i].frees = 0;
+    }
+    spin_init(&m->depot_lock);
+    m->depot_full = NULL;
+    m->depot_empty = NULL;
+    m->nr_full = 0;
+    m->nr_empty = 0;
+    m->depot_exchanges = 0;
+    m->fill = fill;
+    m->drain = drain;
+    m->ctx = ctx;
+}
+
+/*
+ * Both magazines are empty (or missing): trade the previous one for a full
+ * magazine from the depot, else fill one from the backing allocator.
+ * IRQs masked. Returns true once mc->loaded has rounds.
+ */
+static bool mag_alloc_slow(mag_layer_t *m, mag_cpu_t *mc) {
+    spin_lock(&m->depot_lock);
+    magazine_t *full = mag_pop(&m->depot_full);
+    magazine_t *spare = NULL;
+    if (full) {
+        m->nr_full--;
+        m->depot_exchanges++;
+        if (mc->previous) {
+            mag_push(&m->depot_empty, mc->previous);
+            m->nr_empty++;
+        }
+    } else if (!mc->loaded && !mc->previous) {
+        spare = mag_pop(&m->depot_empty);
+        if (spare) m->nr_empty--;
+    }
+    spin_unlock(&m->depot_lock);
+
+    if (full) {
+        mc->previous = mc->loaded;
+        mc->loaded = full;
+        return true;
+    }
+
+    /* Depot is dry: one batch from the backing allocator. */
+    if (!mc->loaded) {
+        if (mc->previous) {
+            mag_swap(mc);
+        } else {
+            mc->loaded = spare ? spare : mag_new();
+        }
+    }
+    magazine_t *mg = mc->loaded;
+    if (!mg) {
+        return false;
+    }
+    mg->rounds = m->fill(m->ctx, mg->objs, (uint32_t)CONFIG_MAG_ROUNDS);
+    return mg->rounds != 0;
+}
+
+void *mag_alloc(mag_layer_t *m) {
+    ASSERT_THREAD_CONTEXT();
+    uint64_t flags = irq_save();
+    mag_cpu_t *mc = &m->cpu[this_cpu_read(cpu)];
+
+    void *obj = NULL;
+    if (!(mc->loaded && mc->loaded->rounds)) {
+        if (mc->previous && mc->previous->rounds) {
+            mag_swap(mc);
+        } else if (!mag_alloc_slow(m, mc)) {
+            irq_restore(flags);
+            /* No magazine to be had: go to the backing allocator directly. */
+            if (m->fill(m->ctx, &obj, 1) == 0) {
+                return NULL;
+            }
+            flags = irq_save();
+            m->cpu[this_cpu_read(cpu)].allocs++;
+            irq_restore(flags);
+            return obj;
+        }
+    }
+    magazine_t *mg = mc->loaded;
+    obj = mg->objs[--mg->rounds];
+    mc->allocs++;
+    irq_restore(flags);
+    return obj;
+}
+
+/*
+ * The loaded magazine is full (or missing) and the previous one is not
+ * empty: park the previous one in the depot and load an empty magazine.
+ * A depot already holding CONFIG_MAG_DEPOT_MAX full magazines gets none;
+ * the previous magazine's rounds go back to the backing allocator in one
+ * batch instead. IRQs masked. Returns true once mc->loaded has room.
+ */
+static bool mag_free_slow(mag_layer_t *m, mag_cpu_t *mc) {
+    magazine_t *prev = mc->previous;
+    magazine_t *empty = NULL;
+    bool parked = false;
+
+    spin_lock(&m->depot_lock);
+    if (!prev || m->nr_full < (uint32_t)CONFIG_MAG_DEPOT_MAX) {
+        if (prev) {
+            mag_push(&m->depot_full, prev);
+            m->nr_full++;
+            m->depot_exchanges++;
+            parked = true;
+        }
+        empty = mag_pop(&m->depot_empty);
+        if (empty) m->nr_empty--;
+    }
+    spin_unlock(&m->depot_lock);
+
+    if (prev && !parked) {
+        m->drain(m->ctx, prev->objs, prev->rounds);
+        prev->rounds = 0;
+        empty = prev;
+    } else if (!empty) {
+        empty = mag_new();
+    }
+
+    mc->previous = mc->loaded;
+    mc->loaded = empty;
+    return empty != NULL;
+}
+
+void mag_free(mag_layer_t *m, void *obj) {
+    ASSERT_THREAD_CONTEXT();
+    uint64_t flags = irq_save();
+    mag_cpu_t *mc = &m->cpu[this_cpu_read(cpu)];
+    mc->frees++;
+
+    if (!(mc->loaded && mc->loaded->rounds < (uint32_t)CONFIG_MAG_ROUNDS)) {
+        if (mc->previous && mc->previous->rounds == 0) {
+            mag_swap(mc);
+        } else if (!mag_free_slow(m, mc)) {
+            irq_restore(flags);
+            m->drain(m->ctx, &obj, 1);
+            return;
+        }
+    }
+    magazine_t *mg = mc->loaded;
+    mg->objs[mg->rounds++] = obj;
+    irq_restore(flags);
+}
+
+void mag_get_stats(const mag_layer_t *m, mag_stats_t *out) {
+    if (!m || !out) {
+        return;
+    }
+    out->allocs = 0;
+    out->frees = 0;
+    for (uint32_t i = 0; i < (uint32_t)CONFIG_MAX_CPUS; i++) {
+        out->allocs += __atomic_load_n(&m->cpu[i].allocs, __ATOMIC_RELAXED);
+        out->frees += __atomic_load_n(&m->cpu[i].frees, __ATOMIC_RELAXED);
+    }
+    out->depot_exchanges = __atomic_load_n(&m->depot_exchanges, __ATOMIC_RELAXED);
+    out->depot_full = __atomic_load_n(&m->nr_full, __ATOMIC_RELAXED);
+    out->depot_empty = __atomic_load_n(&m->nr_empty, __ATOMIC_RELAXED);
+}
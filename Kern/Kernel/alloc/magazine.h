@@ -0,0 +1,83 @@
+#pragma once
+/*
+ * magazine.h — per-CPU magazine layer (Bonwick) in front of an object
+ * allocator.
+ *
+ * Purpose:
+ *  - Serve most allocations and frees from the calling CPU without taking
+ *    a lock or touching a shared cache line.
+ *  - Each CPU holds a loaded and a previous magazine (arrays of up to
+ *    CONFIG_MAG_ROUNDS cached objects). Allocation pops from the loaded
+ *    one, free pushes to it; when it runs dry or full the two are swapped,
+ *    and only when both are unusable does the CPU go to the depot.
+ *  - The depot (one spinlock per layer) trades whole magazines: an empty
+ *    one for a full one on allocation, a full one for an empty one on
+ *    free. A dry depot fills a magazine from the backing allocator in one
+ *    batch; a depot holding CONFIG_MAG_DEPOT_MAX full magazines drains
+ *    the surplus back to it in one batch.
+ *
+ * Notes:
+ *  - Used by slab caches (alloc/slab_cache.h) and the kmalloc buckets.
+ *  - Thread-context only. The per-CPU part runs with IRQs masked and
+ *    takes no lock; its slot is picked by the per-CPU block's logical id
+ *    (smp/percpu.h). The depot lock is a leaf: the backing allocator and
+ *    the magazine cache are called with no layer lock held.
+ *  - Magazines come from a private slab cache and are never freed.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "smp/smp.h"
+#include "sync/spinlock.h"
+
+typedef struct magazine magazine_t;
+
+/*
+ * Backing allocator hooks. fill() stores up to `n` fresh objects in `objs`
+ * and returns how many it produced; drain() takes `n` objects back.
+ */
+typedef uint32_t (*mag_fill_fn)(void *ctx, void **objs, uint32_t n);
+typedef void     (*mag_drain_fn)(void *ctx, void **objs, uint32_t n);
+
+typedef struct mag_cpu {
+    magazine_t *loaded;
+    magazine_t *previous;
+    uint64_t    allocs;     /* objects handed out on this CPU */
+    uint64_t    frees;      /* objects taken back on this CPU */
+} __attribute__((aligned(CACHE_LINE))) mag_cpu_t;
+
+typedef struct mag_layer {
+    mag_cpu_t    cpu[CONFIG_MAX_CPUS];
+    spinlock_t   depot_lock;
+    magazine_t  *depot_full;    /* non-empty magazines */
+    magazine_t  *depot_empty;
+    uint32_t     nr_full;
+    uint32_t     nr_empty;
+    uint64_t     depot_exchanges;
+    mag_fill_fn  fill;
+    mag_drain_fn drain;
+    void        *ctx;
+} mag_layer_t;
+
+typedef struct mag_stats {
+    uint64_t allocs;            /* summed over CPUs */
+    uint64_t frees;
+    uint64_t depot_exchanges;   /* magazines traded with the depot */
+    uint32_t depot_full;
+    uint32_t depot_empty;
+} mag_stats_t;
+
+/* Before the layer is used by any CPU. */
+void mag_layer_init(mag_layer_t *m, mag_fill_fn fill, mag_drain_fn drain, void *ctx);
+
+/* An object from this CPU's magazines, else the depot or the backing
+ * allocator; NULL if the backing allocator is out. */
+void *mag_alloc(mag_layer_t *m);
+
+/* Cache `obj` on this CPU; falls back to drain() if no magazine is free. */
+void mag_free(mag_layer_t *m, void *obj);
+
+/* Best-effort snapshot (per-CPU counters are read without locks). */
+void mag_get_stats(const mag_layer_t *m, mag_stats_t *out);
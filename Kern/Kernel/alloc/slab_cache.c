@@ -13,6 +13,8 @@
  * This allocator uses 4KiB PMM pages as slabs.
  * Each slab page starts with a small header, followed by an array of fixed-size objects.
  * Freed objects store a next pointer in their first word (intrusive free list).
+ * The header links the slab into its cache's partial/full/empty list and
+ * records the owning cache, so a freed pointer is checked without a search.
  */
 
 #define SLAB_PAGE_SIZE 4096u
@@ -22,14 +24,34 @@
 #define CONFIG_POISON_SLAB_FREE 1
 #endif
 
+#define SLAB_PAGE_MAGIC 0x534C4143u /* 'SLAC'; distinct from kheap's 'SLAB' */
+
 typedef struct slab_page {
     struct slab_page *next;
+    struct slab_page *prev;
+    slab_cache_t *cache;
     void *freelist;
+    uint32_t magic;
     uint16_t obj_count;
     uint16_t inuse;
     /* object region starts after this header */
 } slab_page_t;
 
+static void slab_list_push(slab_page_t **head, slab_page_t *sp) {
+    sp->prev = NULL;
+    sp->next = *head;
+    if (sp->next) sp->next->prev = sp;
+    *head = sp;
+}
+
+static void slab_list_unlink(slab_page_t **head, slab_page_t *sp) {
+    if (sp->prev) sp->prev->next = sp->next;
+    else *head = sp->next;
+    if (sp->next) sp->next->prev = sp->prev;
+    sp->next = NULL;
+    sp->prev = NULL;
+}
+
 static inline uint32_t u32_max(uint32_t a, uint32_t b) { return a > b ? a : b; }
 
 static inline uintptr_t align_up(uintptr_t v, uintptr_t a) {
@@ -63,7 +85,7 @@ static void slab_page_build_freelist(slab_page_t *sp, uint32_t obj_size, uint32_
     }
 }
 
-static slab_page_t *slab_page_alloc(uint32_t obj_size, uint32_t obj_align) {
+static slab_page_t *slab_page_alloc(slab_cache_t *c) {
     uint64_t pa = 0;
     if (!pmm_alloc_pages(1, &pa)) {
         return NULL;
@@ -71,15 +93,32 @@ static slab_page_t *slab_page_alloc(uint32_t obj_size, uint32_t obj_align) {
 
     slab_page_t *sp = (slab_page_t *)(uintptr_t)pmm_phys_to_virt(pa);
     sp->next = NULL;
+    sp->prev = NULL;
+    sp->cache = c;
     sp->freelist = NULL;
+    sp->magic = SLAB_PAGE_MAGIC;
     sp->obj_count = 0;
     sp->inuse = 0;
 
-    slab_page_build_freelist(sp, obj_size, obj_align);
+    slab_page_build_freelist(sp, c->obj_size, c->obj_align);
     return sp;
 }
 
+static void slab_page_release(slab_page_t *sp) {
+    sp->magic = 0;
+    sp->cache = NULL;
+    pmm_free_page(pmm_virt_to_phys((uint64_t)(uintptr_t)sp));
+}
+
+static uint32_t slab_mag_fill(void *ctx, void **objs, uint32_t n);
+static void slab_mag_drain(void *ctx, void **objs, uint32_t n);
+
 void slab_cache_init(slab_cache_t *c, const char *name, size_t obj_size, size_t align) {
+    slab_cache_init_ex(c, name, obj_size, align, 0);
+}
+
+void slab_cache_init_ex(slab_cache_t *c, const char *name, size_t obj_size, size_t align,
+                        uint32_t flags) {
     if (!c) {
         panic("slab_cache_init: null");
     }
@@ -109,7 +148,11 @@ void slab_cache_init(slab_cache_t *c, const char *name, size_t obj_size, size_t
     c->name = name ? name : "slab";
     c->obj_size = sz;
     c->obj_align = want_align;
-    c->pages = NULL;
+    c->partial = NULL;
+    c->full = NULL;
+    c->empty = NULL;
+    c->nr_empty = 0;
+    mcs_init(&c->lock);
 
     /* Stats (best-effort, always-on for now). */
     c->alloc_calls = 0;
@@ -117,45 +160,41 @@ void slab_cache_init(slab_cache_t *c, const char *name, size_t obj_size, size_t
     c->inuse_objects = 0;
     c->peak_inuse_objects = 0;
     c->slab_pages_allocated = 0;
+    c->slab_pages_freed = 0;
     c->alloc_failures = 0;
-}
 
-void *slab_alloc(slab_cache_t *c) {
-    ASSERT_THREAD_CONTEXT();
-    if (!c) {
-        panic("slab_alloc: null cache");
+    c->magazines = (flags & SLAB_CACHE_NO_MAGAZINES) == 0;
+    if (c->magazines) {
+        mag_layer_init(&c->mag, slab_mag_fill, slab_mag_drain, c);
     }
+}
 
-    c->alloc_calls++;
-
-    /* Find a page with free objects. */
-    for (slab_page_t *sp = c->pages; sp; sp = sp->next) {
-        if (sp->freelist) {
-            void *obj = sp->freelist;
-            sp->freelist = *(void **)obj;
-            sp->inuse++;
-
-            c->inuse_objects++;
-            if (c->inuse_objects > c->peak_inuse_objects) {
-                c->peak_inuse_objects = c->inuse_objects;
-            }
-            return obj;
-        }
+/* One object out of the slabs (no call accounting). Caller holds c->lock. */
+static void *slab_take_locked(slab_cache_t *c) {
+    /* Prefer a partial slab; then a cached empty one; then a new page. */
+    slab_page_t *sp = c->partial;
+    if (!sp && c->empty) {
+        sp = c->empty;
+        slab_list_unlink(&c->empty, sp);
+        c->nr_empty--;
+        slab_list_push(&c->partial, sp);
     }
-
-    /* Allocate a new slab page from PMM and add it to the cache. */
-    slab_page_t *sp = slab_page_alloc(c->obj_size, c->obj_align);
     if (!sp) {
-        c->alloc_failures++;
-        return NULL;
+        sp = slab_page_alloc(c);
+        if (!sp) {
+            return NULL;
+        }
+        c->slab_pages_allocated++;
+        slab_list_push(&c->partial, sp);
     }
-    c->slab_pages_allocated++;
-    sp->next = c->pages;
-    c->pages = sp;
 
     void *obj = sp->freelist;
     sp->freelist = *(void **)obj;
     sp->inuse++;
+    if (sp->inuse == sp->obj_count) {
+        slab_list_unlink(&c->partial, sp);
+        slab_list_push(&c->full, sp);
+    }
 
     c->inuse_objects++;
     if (c->inuse_objects > c->peak_inuse_objects) {
@@ -164,44 +203,140 @@ void *slab_alloc(slab_cache_t *c) {
     return obj;
 }
 
-void slab_free(slab_cache_t *c, void *p) {
-    ASSERT_THREAD_CONTEXT();
-    if (!c || !p) {
-        return;
-    }
-
-    c->free_calls++;
-
-    uintptr_t page_base = (uintptr_t)p & ~(uintptr_t)(SLAB_PAGE_SIZE - 1);
-    slab_page_t *sp = (slab_page_t *)page_base;
-
+static slab_page_t *slab_page_of(const slab_cache_t *c, void *p) {
+    slab_page_t *sp = (slab_page_t *)((uintptr_t)p & ~(uintptr_t)(SLAB_PAGE_SIZE - 1));
     /* Validate that the page belongs to this cache. */
-    bool found = false;
-    for (slab_page_t *it = c->pages; it; it = it->next) {
-        if (it == sp) {
-            found = true;
-            break;
-        }
-    }
-    if (!found) {
+    if (sp->magic != SLAB_PAGE_MAGIC || sp->cache != c) {
         panic("slab_free: foreign ptr");
     }
+    return sp;
+}
+
+/*
+ * Put one object back into its slab (no call accounting). Caller holds
+ * c->lock. Returns an emptied slab the caller must release after dropping
+ * the lock, or NULL.
+ */
+static slab_page_t *slab_put_locked(slab_cache_t *c, void *p) {
+    slab_page_t *sp = slab_page_of(c, p);
     if (sp->inuse == 0) {
         panic("slab_free: underflow");
     }
 
     /* Push object back to freelist (intrusive). */
-#if CONFIG_POISON_SLAB_FREE
-    memset(p, 0xA5, c->obj_size);
-#endif
     *(void **)p = sp->freelist;
     sp->freelist = p;
+    if (sp->inuse == sp->obj_count) {
+        slab_list_unlink(&c->full, sp);
+        slab_list_push(&c->partial, sp);
+    }
     sp->inuse--;
 
+    /* Keep a few empty slabs for the next burst; the rest go to the PMM. */
+    slab_page_t *release = NULL;
+    if (sp->inuse == 0) {
+        slab_list_unlink(&c->partial, sp);
+        if (c->nr_empty < (uint32_t)CONFIG_SLAB_EMPTY_MAX) {
+            slab_list_push(&c->empty, sp);
+            c->nr_empty++;
+        } else {
+            release = sp;
+            c->slab_pages_freed++;
+        }
+    }
+
     if (c->inuse_objects == 0) {
         panic("slab_free: cache underflow");
     }
     c->inuse_objects--;
+    return release;
+}
+
+/* Magazine layer backing: whole batches under one lock hold. */
+static uint32_t slab_mag_fill(void *ctx, void **objs, uint32_t n) {
+    slab_cache_t *c = (slab_cache_t *)ctx;
+    mcs_node_t node;
+    uint64_t flags = mcs_lock_irqsave(&c->lock, &node);
+    uint32_t got = 0;
+    while (got < n) {
+        void *obj = slab_take_locked(c);
+        if (!obj) break;
+        objs[got++] = obj;
+    }
+    mcs_unlock_irqrestore(&c->lock, &node, flags);
+    return got;
+}
+
+static void slab_mag_drain(void *ctx, void **objs, uint32_t n) {
+    slab_cache_t *c = (slab_cache_t *)ctx;
+    for (uint32_t i = 0; i < n; ) {
+        slab_page_t *release = NULL;
+        mcs_node_t node;
+        uint64_t flags = mcs_lock_irqsave(&c->lock, &node);
+        while (i < n && !release) {
+            release = slab_put_locked(c, objs[i++]);
+        }
+        mcs_unlock_irqrestore(&c->lock, &node, flags);
+        if (release) {
+            slab_page_release(release);
+        }
+    }
+}
+
+void *slab_alloc(slab_cache_t *c) {
+    ASSERT_THREAD_CONTEXT();
+    if (!c) {
+        panic("slab_alloc: null cache");
+    }
+
+    if (c->magazines) {
+        void *obj = mag_alloc(&c->mag);
+        if (!obj) {
+            __atomic_fetch_add(&c->alloc_calls, 1u, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&c->alloc_failures, 1u, __ATOMIC_RELAXED);
+        }
+        return obj;
+    }
+
+    mcs_node_t node;
+    uint64_t flags = mcs_lock_irqsave(&c->lock, &node);
+    c->alloc_calls++;
+    void *obj = slab_take_locked(c);
+    if (!obj) {
+        c->alloc_failures++;
+    }
+    mcs_unlock_irqrestore(&c->lock, &node, flags);
+    return obj;
+}
+
+void slab_free(slab_cache_t *c, void *p) {
+    ASSERT_THREAD_CONTEXT();
+    if (!c || !p) {
+        return;
+    }
+
+    /* Ownership is checked here: objects parked in a magazine reach the
+     * slab only later, from another context. */
+    (void)slab_page_of(c, p);
+#if CONFIG_POISON_SLAB_FREE
+    /* Poison freed object (helps catch UAF). */
+    memset(p, 0xA5, c->obj_size);
+#endif
+
+    if (c->magazines) {
+        mag_free(&c->mag, p);
+        return;
+    }
+
+    mcs_node_t node;
+    uint64_t flags = mcs_lock_irqsave(&c->lock, &node);
+    c->free_calls++;
+    slab_page_t *release = slab_put_locked(c, p);
+    mcs_unlock_irqrestore(&c->lock, &node, flags);
+
+    if (release) {
+        slab_page_release(release);
+    }
 }
 
 bool slab_cache_get_stats(const slab_cache_t *c, slab_cache_stats_t *out) {
@@ -213,6 +348,16 @@ bool slab_cache_get_stats(const slab_cache_t *c, slab_cache_stats_t *out) {
     out->inuse_objects = c->inuse_objects;
     out->peak_inuse_objects = c->peak_inuse_objects;
     out->slab_pages_allocated = c->slab_pages_allocated;
+    out->slab_pages_freed = c->slab_pages_freed;
     out->alloc_failures = c->alloc_failures;
+    out->depot_exchanges = 0;
+    if (c->magazines) {
+        mag_stats_t ms;
+        mag_get_stats(&c->mag, &ms);
+        out->alloc_calls += ms.allocs;
+        out->free_calls = ms.frees;
+        out->inuse_objects = ms.allocs - ms.frees;
+        out->depot_exchanges = ms.depot_exchanges;
+    }
     return true;
 }
@@ -8,22 +8,36 @@
  *  - Thread-context only (no allocation/free in IRQ context)
  *
  * Notes:
- *  - Single-core bring-up: no locks.
- *  - Stats/introspection can be expanded later.
+ *  - One MCS lock per cache (taken with IRQs masked); it is held across the
+ *    PMM refill, so the lock order is slab -> pmm.
+ *  - Slab pages sit on a partial, full or empty list; each page header
+ *    names its cache. Allocation takes from the first partial (else empty)
+ *    slab and free finds the slab from the object address, both O(1).
+ *  - Empty slabs beyond CONFIG_SLAB_EMPTY_MAX per cache go back to the PMM.
+ *  - A per-CPU magazine layer (alloc/magazine.h) sits in front of every
+ *    cache unless it is created with SLAB_CACHE_NO_MAGAZINES, so most
+ *    calls never take the cache lock. The ownership check on free is then
+ *    made before the object is cached; double frees are caught only when
+ *    the object reaches the slab.
  */
 
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "alloc/magazine.h"
+#include "sync/mcs_lock.h"
+
 /* Per-cache observability (best-effort; expanded over time). */
 typedef struct slab_cache_stats {
     uint64_t alloc_calls;
     uint64_t free_calls;
     uint64_t inuse_objects;
-    uint64_t peak_inuse_objects;
+    uint64_t peak_inuse_objects;   /* out of the slabs, magazine rounds included */
     uint64_t slab_pages_allocated;
+    uint64_t slab_pages_freed;     /* empty slabs returned to the PMM */
     uint64_t alloc_failures;
+    uint64_t depot_exchanges;      /* magazines traded with the depot */
 } slab_cache_stats_t;
 
 typedef struct slab_page slab_page_t;
@@ -32,18 +46,31 @@ typedef struct slab_cache {
     const char *name;
     uint32_t    obj_size;   /* aligned object size */
     uint32_t    obj_align;  /* alignment used for objects */
-    slab_page_t *pages;     /* singly-linked list of pages */
+    slab_page_t *partial;   /* some objects free */
+    slab_page_t *full;      /* no objects free */
+    slab_page_t *empty;     /* all objects free */
+    uint32_t    nr_empty;
+    mcs_lock_t  lock;       /* protects the lists, freelists and stats */
+    bool        magazines;
+    mag_layer_t mag;
 
-    /* Stats (best-effort; single-core bring-up, no locking). */
+    /* Stats (updated under lock; alloc/free/inuse live in `mag` when the
+     * cache has magazines). */
     uint64_t    alloc_calls;
     uint64_t    free_calls;
     uint64_t    inuse_objects;
     uint64_t    peak_inuse_objects;
     uint64_t    slab_pages_allocated;
+    uint64_t    slab_pages_freed;
     uint64_t    alloc_failures;
 } slab_cache_t;
 
+/* slab_cache_init_ex() flags. */
+#define SLAB_CACHE_NO_MAGAZINES 0x1u
+
 void slab_cache_init(slab_cache_t *c, const char *name, size_t obj_size, size_t align);
+void slab_cache_init_ex(slab_cache_t *c, const char *name, size_t obj_size, size_t align,
+                        uint32_t flags);
 void *slab_alloc(slab_cache_t *c);
 void slab_free(slab_cache_t *c, void *p);
 
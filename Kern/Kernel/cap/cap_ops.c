@@ -5,19 +5,57 @@
 
 #include "cap_ops.h"
 
+#include <stdint.h>
+
 #include "cap/cap_entry.h"
 #include "debug/panic.h"
+#include "sched/thread.h"
 
 // Small helper for internal selftests.
 #ifdef DEBUG
 static void expect(int cond, const char *msg)
 {
     if (!cond) {
-        panic("cap_ops_selftest: %s", msg);
+        panic_with_prefix("cap_ops_selftest: ", msg);
     }
 }
 #endif
 
+// Two-table operations lock in address order.
+static void cap_lock_pair(cap_table_t *a, cap_table_t *b)
+{
+    if (a == b) {
+        cap_table_lock(a);
+        return;
+    }
+    if ((uintptr_t)a > (uintptr_t)b) {
+        cap_table_t *tmp = a;
+        a = b;
+        b = tmp;
+    }
+    cap_table_lock(a);
+    cap_table_lock(b);
+}
+
+static void cap_unlock_pair(cap_table_t *a, cap_table_t *b)
+{
+    if (a != b) {
+        cap_table_unlock(b);
+    }
+    cap_table_unlock(a);
+}
+
+// The thread a CAP_TYPE_THREAD entry holds, if `h` names one. Caller holds
+// t->lock.
+static thread_t *cap_thread_of(cap_table_t *t, cap_handle_t h)
+{
+    cap_entry_t *e = cap_table_lookup(t, h, 0);
+    if (!e || e->type != CAP_TYPE_THREAD) {
+        return NULL;
+    }
+    return (thread_t *)e->obj;
+}
+
 cap_status_t cap_create(cap_table_t *t,
                         cap_type_t type,
                         cap_rights_t rights,
@@ -27,7 +65,10 @@ cap_status_t cap_create(cap_table_t *t,
     if (!t || !out) {
         return CAP_ERR_INVALID;
     }
-    return cap_table_insert(t, type, rights, obj, out);
+    cap_table_lock(t);
+    cap_status_t st = cap_table_insert(t, type, rights, obj, out);
+    cap_table_unlock(t);
+    return st;
 }
 
 cap_status_t cap_dup(cap_table_t *src,
@@ -40,14 +81,16 @@ cap_status_t cap_dup(cap_table_t *src,
         return CAP_ERR_INVALID;
     }
 
+    cap_lock_pair(src, dst);
     // Requires explicit DUP right.
+    cap_status_t st = CAP_ERR_DENIED;
     cap_entry_t *e = cap_table_lookup(src, h, CAP_R_DUP);
-    if (!e) {
-        return CAP_ERR_DENIED;
+    if (e) {
+        cap_rights_t new_rights = (e->rights & mask);
+        st = cap_table_insert(dst, e->type, new_rights, e->obj, out);
     }
-
-    cap_rights_t new_rights = (e->rights & mask);
-    return cap_table_insert(dst, e->type, new_rights, e->obj, out);
+    cap_unlock_pair(src, dst);
+    return st;
 }
 
 cap_status_t cap_transfer(cap_table_t *src,
@@ -61,23 +104,20 @@ cap_status_t cap_transfer(cap_table_t *src,
     }
 
     // Implement transfer as dup + drop, with rollback if src removal fails.
+    cap_lock_pair(src, dst);
+    cap_status_t st = CAP_ERR_DENIED;
     cap_entry_t *e = cap_table_lookup(src, h, CAP_R_TRANSFER);
-    if (!e) {
-        return CAP_ERR_DENIED;
-    }
-
-    cap_status_t st = cap_table_insert(dst, e->type, (e->rights & mask), e->obj, out);
-    if (st != CAP_OK) {
-        return st;
+    if (e) {
+        st = cap_table_insert(dst, e->type, (e->rights & mask), e->obj, out);
     }
-
-    st = cap_table_remove(src, h);
-    if (st != CAP_OK) {
-        (void)cap_table_remove(dst, *out);
-        return st;
+    if (st == CAP_OK) {
+        st = cap_table_remove(src, h);
+        if (st != CAP_OK) {
+            (void)cap_table_remove(dst, *out);
+        }
     }
-
-    return CAP_OK;
+    cap_unlock_pair(src, dst);
+    return st;
 }
 
 cap_status_t cap_drop(cap_table_t *t, cap_handle_t h)
@@ -85,7 +125,15 @@ cap_status_t cap_drop(cap_table_t *t, cap_handle_t h)
     if (!t) {
         return CAP_ERR_INVALID;
     }
-    return cap_table_remove(t, h);
+    cap_table_lock(t);
+    thread_t *thr = cap_thread_of(t, h);
+    cap_status_t st = cap_table_remove(t, h);
+    if (st == CAP_OK && thr) {
+        // Nobody can join it any more.
+        thread_detach(thr);
+    }
+    cap_table_unlock(t);
+    return st;
 }
 
 cap_status_t cap_invalidate(cap_table_t *t, cap_handle_t h)
@@ -93,7 +141,14 @@ cap_status_t cap_invalidate(cap_table_t *t, cap_handle_t h)
     if (!t) {
         return CAP_ERR_INVALID;
     }
-    return cap_table_invalidate(t, h);
+    cap_table_lock(t);
+    thread_t *thr = cap_thread_of(t, h);
+    cap_status_t st = cap_table_invalidate(t, h);
+    if (st == CAP_OK && thr) {
+        thread_detach(thr);
+    }
+    cap_table_unlock(t);
+    return st;
 }
 
 void cap_ops_selftest(cap_table_t *t)
@@ -110,16 +165,20 @@ void cap_ops_selftest(cap_table_t *t)
     cap_status_t st = cap_create(t, CAP_TYPE_SERVICE, (CAP_R_READ | CAP_R_DUP | CAP_R_TRANSFER), (void *)0x1234, &h);
     expect(st == CAP_OK, "cap_create failed");
 
+    cap_table_lock(t);
     cap_entry_t *e = cap_table_lookup(t, h, CAP_R_READ);
     expect(e != NULL, "cap_lookup failed");
     expect(e->type == CAP_TYPE_SERVICE, "type mismatch");
     expect(e->obj == (void *)0x1234, "obj mismatch");
+    cap_table_unlock(t);
 
     st = cap_drop(t, h);
     expect(st == CAP_OK, "cap_drop failed");
 
     // Stale handle must fail due to gen bump.
+    cap_table_lock(t);
     e = cap_table_lookup(t, h, CAP_R_READ);
+    cap_table_unlock(t);
     expect(e == NULL, "stale handle should fail");
 
     // Dup/transfer smoke.
@@ -1,6 +1,7 @@
 // Capability operations (kernel-internal)
 //
-// These are explicit, auditable primitives built atop cap_table_t.
+// These are explicit, auditable primitives built atop cap_table_t. Each takes
+// the table lock (two tables: in address order) for its whole operation.
 // A Core-facing ABI for capability operations may be added in the future, but the
 // kernel must first have a correct internal substrate.
 
@@ -40,11 +41,14 @@ cap_status_t cap_transfer(cap_table_t *src,
                           cap_handle_t *out);
 
 // Drop a capability (remove entry, bump generation, free entry object).
+// Dropping a thread capability detaches the thread (thread_detach()): it can
+// no longer be joined and is freed by the reaper once it exits.
 cap_status_t cap_drop(cap_table_t *t, cap_handle_t h);
 
 // Revoke / invalidate stub.
 // For now this is equivalent to drop, but named explicitly for future
-// revocation work (e.g. invalidating derived copies).
+// revocation work (e.g. invalidating derived copies). Thread capabilities
+// are detached as by cap_drop().
 cap_status_t cap_invalidate(cap_table_t *t, cap_handle_t h);
 
 // Debug-only self test for basic correctness. No output required.
@@ -109,6 +109,7 @@ void cap_table_init(cap_table_t *t) {
         t->free_stack[i] = i;
     }
     t->free_top = (uint32_t)CONFIG_CAP_TABLE_SLOTS;
+    mutex_init(&t->lock, "cap_table");
 }
 
 cap_status_t cap_table_insert(cap_table_t *t,
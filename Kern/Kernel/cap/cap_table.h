@@ -2,6 +2,13 @@
 //
 // Capability storage + lookup rules.
 // This is not exposed to Core; Core will eventually hold opaque cap_handle_t values.
+//
+// Locking: each table has a sleeping mutex, and every cap_table_* primitive
+// below expects the caller to hold it (cap_table_lock()). The cap_ops.h
+// operations take it themselves. Callers that resolve a handle to an object
+// keep the lock across their use of the object whenever dropping the handle
+// could free it (thread caps), but never across an indefinite block such as
+// an IPC receive.
 
 #pragma once
 
@@ -10,6 +17,7 @@
 
 #include "cap/cap_rights.h"
 #include "cap/cap_types.h"
+#include "sync/mutex.h"
 
 // Stable opaque handle type.
 // Packing (v1): [gen:32][index:32]
@@ -60,10 +68,14 @@ typedef struct cap_table {
     uint32_t gens[CONFIG_CAP_TABLE_SLOTS];
     uint32_t free_stack[CONFIG_CAP_TABLE_SLOTS];
     uint32_t free_top;
+    mutex_t lock;
 } cap_table_t;
 
 void cap_table_init(cap_table_t *t);
 
+static inline void cap_table_lock(cap_table_t *t) { mutex_lock(&t->lock); }
+static inline void cap_table_unlock(cap_table_t *t) { mutex_unlock(&t->lock); }
+
 // Create a new entry in the table (allocates a slab-backed cap_entry_t).
 cap_status_t cap_table_insert(cap_table_t *t,
                               cap_type_t type,
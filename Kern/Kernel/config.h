@@ -14,9 +14,10 @@
 #endif
 
 /*
- * When enabled, the kernel will not start a periodic timer tick by default.
- * One-shot timer events are expected to be armed explicitly based on the next
- * deadline.
+ * Tickless idle. The periodic tick runs only while a CPU has work: when its
+ * idle loop finds nothing runnable it stops the tick and programs the timer
+ * once for the earliest pending deadline (see sched_idle_wait()). The tick
+ * restarts when the CPU switches to a thread.
  */
 #ifndef CONFIG_TICKLESS
 #define CONFIG_TICKLESS 0
@@ -28,14 +29,187 @@
  * Cooperative scheduling means:
  *  - IRQ handlers never switch threads.
  *  - Thread switches occur only via explicit yield() (or explicit safe points).
- * A preemptive mode may be introduced in the future.
+ *
+ * With CONFIG_SCHED_COOPERATIVE=0 the timer tick charges the running thread's
+ * time slice and the IRQ exit path switches threads once it expires, unless
+ * preemption is disabled (preempt_count != 0).
  */
 #ifndef CONFIG_SCHED_COOPERATIVE
 #define CONFIG_SCHED_COOPERATIVE 1
 #endif
 
+/* Time slice length in timer ticks (preemptive mode). */
+#ifndef CONFIG_SCHED_TIMESLICE_TICKS
+#define CONFIG_SCHED_TIMESLICE_TICKS 2
+#endif
+
+/*
+ * Background QoS throttling. Threads in the background band (priority at or
+ * below SCHED_PRIO_QOS_BACKGROUND) may run for at most CONFIG_SCHED_BG_MAX_PCT
+ * percent of every CONFIG_SCHED_BG_WINDOW_TICKS ticks on a CPU. Past that
+ * the CPU passes them over, idling if nothing else is ready, until the
+ * window ends, so batch work leaves headroom for latency-sensitive threads.
+ * 100 disables throttling.
+ */
+#ifndef CONFIG_SCHED_BG_WINDOW_TICKS
+#define CONFIG_SCHED_BG_WINDOW_TICKS 10
+#endif
+
+#ifndef CONFIG_SCHED_BG_MAX_PCT
+#define CONFIG_SCHED_BG_MAX_PCT 50
+#endif
+
+/*
+ * Load balancing (SMP). Every CONFIG_SCHED_BALANCE_TICKS ticks each CPU pulls
+ * a thread from the busiest peer if that narrows the load gap; idle CPUs also
+ * steal whenever they would otherwise idle. Thread load is a runnable-time
+ * average with a time constant of CONFIG_SCHED_LOAD_TAU_MS.
+ */
+#ifndef CONFIG_SCHED_BALANCE_TICKS
+#define CONFIG_SCHED_BALANCE_TICKS 4
+#endif
+
+#ifndef CONFIG_SCHED_LOAD_TAU_MS
+#define CONFIG_SCHED_LOAD_TAU_MS 32
+#endif
+
+/*
+ * Capacity-aware placement on CPUs of unequal capacity (DTB
+ * capacity-dmips-mhz): threads whose load is at least this percentage of a
+ * fully busy thread are placed for the most capacity per thread (big cores
+ * first); background threads (below SCHED_PRIO_DEFAULT) pack onto the
+ * smallest cores. No effect when every CPU has the same capacity.
+ */
+#ifndef CONFIG_SCHED_HEAVY_LOAD_PCT
+#define CONFIG_SCHED_HEAVY_LOAD_PCT 50
+#endif
+
+/*
+ * Deadline (EDF) class admission bound: the summed budget/deadline densities
+ * of the deadline threads on one CPU may not exceed this percentage. The
+ * remainder keeps priority-class threads (and IRQ work) from starving.
+ */
+#ifndef CONFIG_SCHED_EDF_MAX_UTIL_PCT
+#define CONFIG_SCHED_EDF_MAX_UTIL_PCT 90
+#endif
+
+/*
+ * Run the scheduler scaling benchmark (sched/sched_bench.c) at boot and
+ * print per-CPU-count timings. Off by default.
+ */
+#ifndef CONFIG_SCHED_BENCH
+#define CONFIG_SCHED_BENCH 0
+#endif
+
+/*
+ * Kernel timer wheel resolution (timer/timer_wheel.h), in microseconds.
+ * Sleeps and timeouts are rounded up to this granule.
+ */
+#ifndef CONFIG_KTIMER_GRANULE_US
+#define CONFIG_KTIMER_GRANULE_US 1000
+#endif
+
+/*
+ * Kernel stack cache (alloc/kstack_cache.h): stacks fetched from the PMM per
+ * refill, stacks kept cached at most, and the PMM free-page level below
+ * which freed stacks bypass the cache.
+ */
+#ifndef CONFIG_KSTACK_CACHE_BATCH
+#define CONFIG_KSTACK_CACHE_BATCH 4
+#endif
+
+#ifndef CONFIG_KSTACK_CACHE_MAX
+#define CONFIG_KSTACK_CACHE_MAX 16
+#endif
+
+#ifndef CONFIG_KSTACK_CACHE_LOW_PAGES
+#define CONFIG_KSTACK_CACHE_LOW_PAGES 256
+#endif
+
+/*
+ * Empty slabs each slab cache (alloc/slab_cache.h) keeps for reuse; further
+ * slabs that empty out are returned to the PMM.
+ */
+#ifndef CONFIG_SLAB_EMPTY_MAX
+#define CONFIG_SLAB_EMPTY_MAX 2
+#endif
+
+/*
+ * Magazine layer (alloc/magazine.h): objects per magazine (14 rounds make
+ * a 128-byte magazine) and full magazines a layer's depot keeps before
+ * draining the surplus back to the backing allocator.
+ */
+#ifndef CONFIG_MAG_ROUNDS
+#define CONFIG_MAG_ROUNDS 14
+#endif
+
+#ifndef CONFIG_MAG_DEPOT_MAX
+#define CONFIG_MAG_DEPOT_MAX 8
+#endif
+
+/*
+ * Per-CPU page caches (mm/pmm.c): pages moved from the buddy lists per
+ * refill of an empty cache, the level past which a free drains the cache,
+ * and the level it drains back down to.
+ */
+#ifndef CONFIG_PMM_PCP_BATCH
+#define CONFIG_PMM_PCP_BATCH 16
+#endif
+
+#ifndef CONFIG_PMM_PCP_HIGH
+#define CONFIG_PMM_PCP_HIGH 64
+#endif
+
+#ifndef CONFIG_PMM_PCP_LOW
+#define CONFIG_PMM_PCP_LOW 32
+#endif
+
+/*
+ * Upper bound on CPUs brought online (QEMU virt: -smp N). Per-CPU state is
+ * statically sized by this; CPUs beyond it are left parked in firmware.
+ * The GICv2 SGI target list limits this to 8.
+ */
+#ifndef CONFIG_MAX_CPUS
+#define CONFIG_MAX_CPUS 8
+#endif
+
 #if (CONFIG_TICK_HZ <= 0)
 #error "CONFIG_TICK_HZ must be > 0"
 #endif
 
+#if (CONFIG_SCHED_TIMESLICE_TICKS <= 0)
+#error "CONFIG_SCHED_TIMESLICE_TICKS must be > 0"
+#endif
+
+#if (CONFIG_SCHED_BG_WINDOW_TICKS <= 0) || (CONFIG_SCHED_BG_MAX_PCT <= 0) || \
+    (CONFIG_SCHED_BG_MAX_PCT > 100) || \
+    (CONFIG_SCHED_BG_WINDOW_TICKS * CONFIG_SCHED_BG_MAX_PCT < 100)
+#error "CONFIG_SCHED_BG_MAX_PCT must be in 1..100 and leave at least one tick per window"
+#endif
+
+#if (CONFIG_SCHED_BALANCE_TICKS <= 0) || (CONFIG_SCHED_LOAD_TAU_MS <= 0)
+#error "CONFIG_SCHED_BALANCE_TICKS and CONFIG_SCHED_LOAD_TAU_MS must be > 0"
+#endif
+
+#if (CONFIG_SCHED_EDF_MAX_UTIL_PCT <= 0) || (CONFIG_SCHED_EDF_MAX_UTIL_PCT > 100)
+#error "CONFIG_SCHED_EDF_MAX_UTIL_PCT must be in 1..100"
+#endif
+
+#if (CONFIG_SLAB_EMPTY_MAX < 0)
+#error "CONFIG_SLAB_EMPTY_MAX must be >= 0"
+#endif
+
+#if (CONFIG_MAG_ROUNDS <= 0) || (CONFIG_MAG_DEPOT_MAX <= 0)
+#error "CONFIG_MAG_ROUNDS and CONFIG_MAG_DEPOT_MAX must be > 0"
+#endif
+
+#if (CONFIG_PMM_PCP_BATCH <= 0) || (CONFIG_PMM_PCP_LOW < 0) || \
+    (CONFIG_PMM_PCP_LOW >= CONFIG_PMM_PCP_HIGH) || (CONFIG_PMM_PCP_BATCH > CONFIG_PMM_PCP_HIGH)
+#error "CONFIG_PMM_PCP_*: need BATCH > 0, LOW < HIGH and BATCH <= HIGH"
+#endif
+
+#if (CONFIG_MAX_CPUS <= 0) || (CONFIG_MAX_CPUS > 8)
+#error "CONFIG_MAX_CPUS must be in 1..8"
+#endif
+
 #endif /* CAPAZ_CONFIG_H */
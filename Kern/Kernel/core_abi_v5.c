@@ -0,0 +1,415 @@
+#include "core_kernel_abi_v5.h"
+
+#include "contracts.h"
+#include "ipc/endpoint.h"
+#include "kheap.h"
+#include "sched/sched.h"
+#include "sched/thread.h"
+#include "task/task.h"
+#include "timer_generic.h"
+#include "uart_pl011.h"
+
+#include "cap/cap_entry.h"
+#include "cap/cap_ops.h"
+#include "cap/cap_status_ks.h"
+
+_Static_assert(KS_SCHED_PRIO_MIN == SCHED_PRIO_MIN, "ABI v5: priority floor mismatch");
+_Static_assert(KS_SCHED_PRIO_MAX == SCHED_PRIO_MAX, "ABI v5: priority ceiling mismatch");
+_Static_assert(KS_SCHED_PRIO_DEFAULT == SCHED_PRIO_DEFAULT, "ABI v5: default priority mismatch");
+_Static_assert(KS_SCHED_LAT_BUCKETS == SCHED_LAT_BUCKETS, "ABI v5: latency histogram mismatch");
+_Static_assert((uint32_t)KS_THREAD_QOS_DEFAULT == (uint32_t)THREAD_QOS_DEFAULT &&
+               (uint32_t)KS_THREAD_QOS_USER_INTERACTIVE == (uint32_t)THREAD_QOS_USER_INTERACTIVE &&
+               (uint32_t)KS_THREAD_QOS_USER_INITIATED == (uint32_t)THREAD_QOS_USER_INITIATED &&
+               (uint32_t)KS_THREAD_QOS_UTILITY == (uint32_t)THREAD_QOS_UTILITY &&
+               (uint32_t)KS_THREAD_QOS_BACKGROUND == (uint32_t)THREAD_QOS_BACKGROUND,
+               "ABI v5: QoS class mismatch");
+_Static_assert(KS_THREAD_AFFINITY_ANY == THREAD_AFFINITY_ANY, "ABI v5: affinity mismatch");
+_Static_assert(KS_THREAD_STACK_PAGES_MIN == KSTACK_PAGES_MIN &&
+               KS_THREAD_STACK_PAGES_DEFAULT == KSTACK_PAGES_DEFAULT &&
+               KS_THREAD_STACK_PAGES_MAX == KSTACK_PAGES_MAX &&
+               KSTACK_PAGE_SIZE == 4096u,
+               "ABI v5: stack sizing mismatch");
+_Static_assert(KS_TASK_CPU_PERIOD_MIN_US == TASK_BW_PERIOD_MIN_US &&
+               KS_TASK_CPU_PERIOD_MAX_US == TASK_BW_PERIOD_MAX_US,
+               "ABI v5: CPU bandwidth period mismatch");
+
+// Reuse the "current task cap-space" convention from ABI v2.
+static inline cap_table_t *current_caps(void) {
+    thread_t *cur = sched_current();
+    if (!cur || !cur->task) {
+        return NULL;
+    }
+    return cur->task->caps;
+}
+
+// Resolve KS_THREAD_SELF or a CAP_TYPE_THREAD handle carrying `need_rights`.
+// For a handle the task's cap table stays locked until thread_handle_put(),
+// so the thread cannot be joined and freed while the caller uses it.
+static thread_t *thread_from_handle(ks_cap_handle_t h,
+                                    cap_rights_t need_rights,
+                                    ks_sched_status_t *out_status) {
+    if (h == KS_THREAD_SELF) {
+        *out_status = KS_SCHED_OK;
+        return sched_current();
+    }
+    cap_table_t *caps = current_caps();
+    if (!caps) {
+        *out_status = KS_SCHED_ERR_INVALID;
+        return NULL;
+    }
+    cap_table_lock(caps);
+    cap_entry_t *ent = cap_table_lookup(caps, (cap_handle_t)h, need_rights);
+    if (!ent) {
+        cap_table_unlock(caps);
+        *out_status = KS_SCHED_ERR_RIGHTS;
+        return NULL;
+    }
+    if (ent->type != CAP_TYPE_THREAD || !ent->obj) {
+        cap_table_unlock(caps);
+        *out_status = KS_SCHED_ERR_INVALID;
+        return NULL;
+    }
+    *out_status = KS_SCHED_OK;
+    return (thread_t *)ent->obj;
+}
+
+// Release a thread resolved by thread_from_handle().
+static void thread_handle_put(ks_cap_handle_t h) {
+    if (h != KS_THREAD_SELF) {
+        cap_table_unlock(current_caps());
+    }
+}
+
+// Resolve a CAP_TYPE_TASK handle carrying `need_rights`.
+static task_t *task_from_handle(ks_cap_handle_t h,
+                                cap_rights_t need_rights,
+                                ks_sched_status_t *out_status) {
+    cap_table_t *caps = current_caps();
+    if (!caps) {
+        *out_status = KS_SCHED_ERR_INVALID;
+        return NULL;
+    }
+    // Tasks outlive their handles, so the lock covers the lookup only.
+    cap_table_lock(caps);
+    cap_entry_t *ent = cap_table_lookup(caps, (cap_handle_t)h, need_rights);
+    task_t *tk = NULL;
+    if (!ent) {
+        *out_status = KS_SCHED_ERR_RIGHTS;
+    } else if (ent->type != CAP_TYPE_TASK || !ent->obj) {
+        *out_status = KS_SCHED_ERR_INVALID;
+    } else {
+        *out_status = KS_SCHED_OK;
+        tk = (task_t *)ent->obj;
+    }
+    cap_table_unlock(caps);
+    return tk;
+}
+
+static void ks_log(const char *s) {
+    if (!s) return;
+    uart_puts(s);
+    uart_putc('\n');
+}
+
+static void *ks_alloc(size_t size) {
+    ASSERT_THREAD_CONTEXT();
+    return kmalloc(size);
+}
+
+static void ks_free(void *ptr) {
+    ASSERT_THREAD_CONTEXT();
+    kfree(ptr);
+}
+
+static void ks_yield(void) {
+    ASSERT_THREAD_CONTEXT();
+    yield();
+}
+
+// Capability ops (v2 semantics) exposed through v5.
+static ks_cap_status_t ks_cap_dup_impl(ks_cap_handle_t h,
+                                       ks_cap_rights_t mask,
+                                       ks_cap_handle_t *out) {
+    ASSERT_THREAD_CONTEXT();
+    if (!out) return KS_CAP_ERR_INVALID;
+    cap_table_t *t = current_caps();
+    if (!t) return KS_CAP_ERR_INVALID;
+
+    cap_handle_t new_h = 0;
+    cap_status_t s = cap_dup(t, (cap_handle_t)h, t, (cap_rights_t)mask, &new_h);
+    *out = (ks_cap_handle_t)new_h;
+    return cap_status_to_ks_status(s);
+}
+
+static ks_cap_status_t ks_cap_transfer_impl(ks_cap_handle_t h,
+                                            ks_cap_rights_t mask,
+                                            ks_cap_handle_t *out) {
+    ASSERT_THREAD_CONTEXT();
+    if (!out) return KS_CAP_ERR_INVALID;
+    cap_table_t *t = current_caps();
+    if (!t) return KS_CAP_ERR_INVALID;
+
+    cap_handle_t new_h = 0;
+    cap_status_t s = cap_transfer(t, (cap_handle_t)h, t, (cap_rights_t)mask, &new_h);
+    *out = (ks_cap_handle_t)new_h;
+    return cap_status_to_ks_status(s);
+}
+
+static ks_cap_status_t ks_cap_drop_impl(ks_cap_handle_t h) {
+    ASSERT_THREAD_CONTEXT();
+    cap_table_t *t = current_caps();
+    if (!t) return KS_CAP_ERR_INVALID;
+    return cap_status_to_ks_status(cap_drop(t, (cap_handle_t)h));
+}
+
+static ks_cap_status_t ks_cap_invalidate_impl(ks_cap_handle_t h) {
+    ASSERT_THREAD_CONTEXT();
+    cap_table_t *t = current_caps();
+    if (!t) return KS_CAP_ERR_INVALID;
+    return cap_status_to_ks_status(cap_invalidate(t, (cap_handle_t)h));
+}
+
+// IPC (v3)
+static ks_ipc_status_t ks_endpoint_create_impl(ks_cap_rights_t rights, ks_cap_handle_t *out) {
+    ASSERT_THREAD_CONTEXT();
+    if (!out) return KS_IPC_ERR_INVALID;
+    cap_table_t *t = current_caps();
+    if (!t) return KS_IPC_ERR_INVALID;
+
+    cap_handle_t h = 0;
+    ks_ipc_status_t st = endpoint_create_cap(t, (cap_rights_t)rights, &h);
+    *out = (ks_cap_handle_t)h;
+    return st;
+}
+
+static ks_ipc_status_t ks_ipc_send_impl(ks_cap_handle_t endpoint, const ks_ipc_msg_t *msg) {
+    ASSERT_THREAD_CONTEXT();
+    cap_table_t *t = current_caps();
+    if (!t) return KS_IPC_ERR_INVALID;
+    return ipc_send_cap(t, (cap_handle_t)endpoint, msg);
+}
+
+static ks_ipc_status_t ks_ipc_recv_impl(ks_cap_handle_t endpoint, ks_ipc_msg_t *out) {
+    ASSERT_THREAD_CONTEXT();
+    cap_table_t *t = current_caps();
+    if (!t) return KS_IPC_ERR_INVALID;
+    return ipc_recv_cap(t, (cap_handle_t)endpoint, out);
+}
+
+// Scheduling (v4)
+static ks_sched_status_t ks_thread_get_priority_impl(ks_cap_handle_t thread, uint32_t *out) {
+    ASSERT_THREAD_CONTEXT();
+    if (!out) return KS_SCHED_ERR_INVALID;
+
+    ks_sched_status_t st = KS_SCHED_OK;
+    thread_t *t = thread_from_handle(thread, CAP_R_READ, &st);
+    if (!t) return st;
+
+    *out = sched_get_priority(t);
+    thread_handle_put(thread);
+    return KS_SCHED_OK;
+}
+
+static ks_sched_status_t ks_thread_set_priority_impl(ks_cap_handle_t thread, uint32_t priority) {
+    ASSERT_THREAD_CONTEXT();
+    if (priority > KS_SCHED_PRIO_MAX) return KS_SCHED_ERR_INVALID;
+
+    ks_sched_status_t st = KS_SCHED_OK;
+    thread_t *t = thread_from_handle(thread, CAP_R_CONTROL, &st);
+    if (!t) return st;
+
+    const bool ok = sched_set_priority(t, priority);
+    thread_handle_put(thread);
+    return ok ? KS_SCHED_OK : KS_SCHED_ERR_INVALID;
+}
+
+static uint64_t ticks_to_ns(uint64_t ticks, uint64_t freq) {
+    return (ticks / freq) * 1000000000u + ((ticks % freq) * 1000000000u) / freq;
+}
+
+// Accounting (v4.1)
+static ks_sched_status_t ks_thread_get_stats_impl(ks_cap_handle_t thread, ks_sched_stats_t *out) {
+    ASSERT_THREAD_CONTEXT();
+    if (!out) return KS_SCHED_ERR_INVALID;
+
+    ks_sched_status_t st = KS_SCHED_OK;
+    thread_t *t = thread_from_handle(thread, CAP_R_READ, &st);
+    if (!t) return st;
+
+    sched_stats_t s;
+    const bool ok = sched_get_stats(t, &s);
+    thread_handle_put(thread);
+    if (!ok) return KS_SCHED_ERR_INVALID;
+
+    const uint64_t freq = time_freq();
+    out->run_ns          = ticks_to_ns(s.run_time, freq);
+    out->wait_ns         = ticks_to_ns(s.wait_time, freq);
+    out->nr_voluntary    = s.nr_voluntary;
+    out->nr_involuntary  = s.nr_involuntary;
+    out->nr_wakeups      = s.nr_wakeups;
+    out->wake_lat_max_ns = ticks_to_ns(s.wake_lat_max, freq);
+    for (uint32_t i = 0; i < KS_SCHED_LAT_BUCKETS; i++) {
+        out->wake_lat_hist[i] = s.wake_lat_hist[i];
+    }
+    return KS_SCHED_OK;
+}
+
+// Threads (v5)
+static ks_sched_status_t ks_thread_create_impl(const ks_thread_attr_t *attr,
+                                               void (*entry)(void *), void *arg,
+                                               ks_cap_handle_t *out) {
+    ASSERT_THREAD_CONTEXT();
+    if (!entry || !out) return KS_SCHED_ERR_INVALID;
+    thread_t *cur = sched_current();
+    if (!cur || !cur->task || !cur->task->caps) return KS_SCHED_ERR_INVALID;
+
+    thread_attr_t ta = THREAD_ATTR_INIT;
+    if (attr) {
+        ta.name        = attr->name;
+        ta.stack_pages = attr->stack_pages;
+        ta.priority    = attr->priority;
+        ta.affinity    = attr->affinity;
+        ta.qos         = attr->qos;
+    }
+    if (!thread_attr_valid(&ta)) return KS_SCHED_ERR_INVALID;
+    thread_t *t = thread_create_ex(&ta, entry, arg);
+    if (!t) return KS_SCHED_ERR_NO_MEM;
+    t->task = cur->task;
+    // The capability holds the thread until thread_join() frees both.
+    thread_set_joinable(t);
+
+    cap_handle_t h = 0;
+    cap_status_t st = cap_create(cur->task->caps, CAP_TYPE_THREAD,
+                                 (cap_rights_t)(CAP_R_READ | CAP_R_CONTROL), (void *)t, &h);
+    if (st != CAP_OK) {
+        t->state = THREAD_DEAD;
+        thread_destroy(t);
+        return (st == CAP_ERR_NO_MEM) ? KS_SCHED_ERR_NO_MEM : KS_SCHED_ERR_INVALID;
+    }
+
+    *out = (ks_cap_handle_t)h;
+    sched_enqueue(t, t->priority);
+    return KS_SCHED_OK;
+}
+
+static ks_sched_status_t ks_thread_join_impl(ks_cap_handle_t thread) {
+    ASSERT_THREAD_CONTEXT();
+    if (thread == KS_THREAD_SELF) return KS_SCHED_ERR_INVALID;
+
+    ks_sched_status_t st = KS_SCHED_OK;
+    thread_t *t = thread_from_handle(thread, CAP_R_CONTROL, &st);
+    if (!t) return st;
+    if (t == sched_current() || !(t->flags & THREAD_F_JOINABLE)) {
+        thread_handle_put(thread);
+        return KS_SCHED_ERR_INVALID;
+    }
+
+    // Retire the handle under the lock before joining: exactly one caller
+    // gets this far, and nobody can reach the thread once it is freed.
+    const cap_status_t cs = cap_table_remove(current_caps(), (cap_handle_t)thread);
+    thread_handle_put(thread);
+    if (cs != CAP_OK) return KS_SCHED_ERR_INVALID;
+    thread_join(t);
+    return KS_SCHED_OK;
+}
+
+// QoS (v5.1)
+static ks_sched_status_t ks_thread_set_qos_impl(ks_cap_handle_t thread, uint32_t qos) {
+    ASSERT_THREAD_CONTEXT();
+    if (qos > KS_THREAD_QOS_BACKGROUND) return KS_SCHED_ERR_INVALID;
+
+    ks_sched_status_t st = KS_SCHED_OK;
+    thread_t *t = thread_from_handle(thread, CAP_R_CONTROL, &st);
+    if (!t) return st;
+
+    const bool ok = sched_set_qos(t, (thread_qos_t)qos);
+    thread_handle_put(thread);
+    return ok ? KS_SCHED_OK : KS_SCHED_ERR_INVALID;
+}
+
+static ks_sched_status_t ks_thread_get_qos_impl(ks_cap_handle_t thread, uint32_t *out) {
+    ASSERT_THREAD_CONTEXT();
+    if (!out) return KS_SCHED_ERR_INVALID;
+
+    ks_sched_status_t st = KS_SCHED_OK;
+    thread_t *t = thread_from_handle(thread, CAP_R_READ, &st);
+    if (!t) return st;
+
+    *out = (uint32_t)sched_get_qos(t);
+    thread_handle_put(thread);
+    return KS_SCHED_OK;
+}
+
+// CPU bandwidth (v5.2)
+static ks_sched_status_t ks_task_set_cpu_quota_impl(ks_cap_handle_t task, uint32_t quota_us,
+                                                    uint32_t period_us) {
+    ASSERT_THREAD_CONTEXT();
+    ks_sched_status_t st = KS_SCHED_OK;
+    task_t *tk = task_from_handle(task, CAP_R_CONTROL, &st);
+    if (!tk) return st;
+
+    return task_set_cpu_bandwidth(tk, quota_us, period_us) ? KS_SCHED_OK : KS_SCHED_ERR_INVALID;
+}
+
+static ks_sched_status_t ks_task_get_cpu_stats_impl(ks_cap_handle_t task,
+                                                    ks_task_cpu_stats_t *out) {
+    ASSERT_THREAD_CONTEXT();
+    if (!out) return KS_SCHED_ERR_INVALID;
+
+    ks_sched_status_t st = KS_SCHED_OK;
+    task_t *tk = NULL;
+    if (task == KS_TASK_SELF) {
+        thread_t *cur = sched_current();
+        tk = cur ? cur->task : NULL;
+        if (!tk) return KS_SCHED_ERR_INVALID;
+    } else {
+        tk = task_from_handle(task, CAP_R_READ, &st);
+        if (!tk) return st;
+    }
+
+    task_cpu_stats_t s;
+    if (!task_get_cpu_stats(tk, &s)) return KS_SCHED_ERR_INVALID;
+
+    const uint64_t freq = time_freq();
+    out->usage_ns     = ticks_to_ns(s.usage, freq);
+    out->throttled_ns = ticks_to_ns(s.throttled_time, freq);
+    out->nr_throttled = s.nr_throttled;
+    return KS_SCHED_OK;
+}
+
+// v5 extends v4; keep the v4 prefix stable.
+static const kernel_services_v5_t g_kernel_services_v5 = {
+    .abi_version = CAPAZ_KERNEL_SERVICES_V5_MAJOR,
+    .reserved0   = 0,
+    .log         = ks_log,
+    .alloc       = ks_alloc,
+    .free        = ks_free,
+    .yield       = ks_yield,
+
+    .cap_dup        = ks_cap_dup_impl,
+    .cap_transfer   = ks_cap_transfer_impl,
+    .cap_drop       = ks_cap_drop_impl,
+    .cap_invalidate = ks_cap_invalidate_impl,
+
+    .endpoint_create = ks_endpoint_create_impl,
+    .ipc_send        = ks_ipc_send_impl,
+    .ipc_recv        = ks_ipc_recv_impl,
+
+    .thread_get_priority = ks_thread_get_priority_impl,
+    .thread_set_priority = ks_thread_set_priority_impl,
+
+    .thread_get_stats = ks_thread_get_stats_impl,
+
+    .thread_create = ks_thread_create_impl,
+    .thread_join   = ks_thread_join_impl,
+
+    .thread_set_qos = ks_thread_set_qos_impl,
+    .thread_get_qos = ks_thread_get_qos_impl,
+
+    .task_set_cpu_quota = ks_task_set_cpu_quota_impl,
+    .task_get_cpu_stats = ks_task_get_cpu_stats_impl,
+};
+
+const kernel_services_v5_t *kernel_services_v5(void) {
+    return &g_kernel_services_v5;
+}
@@ -8,8 +8,7 @@
 #include "irq.h"
 #include "mm/mem.h"          // memset, memcpy
 #include "ipc/ipc_message.h"
-#include "sched/sched.h"
-#include "sched/thread.h"
+#include "timer_generic.h"
 #include "cap/cap_ops.h"
 #include "cap/cap_entry.h"
 #include "cap/cap_rights.h"
@@ -35,7 +34,9 @@ endpoint_t *endpoint_alloc(void) {
         panic("endpoint_alloc: OOM");
     }
     memset(e, 0, sizeof(*e));
-    e->id = s_next_endpoint_id++;
+    spin_init(&e->lock);
+    waitq_init(&e->recv_wait);
+    e->id = __atomic_fetch_add(&s_next_endpoint_id, 1u, __ATOMIC_RELAXED);
     return e;
 }
 
@@ -82,17 +83,21 @@ static inline endpoint_t *endpoint_from_handle(cap_table_t *caps,
         if (out_status) *out_status = KS_IPC_ERR_INVALID;
         return NULL;
     }
+    // Not held across the send/receive: a receive may block indefinitely.
+    cap_table_lock(caps);
     cap_entry_t *ent = cap_table_lookup(caps, h, need_rights);
+    endpoint_t *e = NULL;
+    ks_ipc_status_t st = KS_IPC_OK;
     if (!ent) {
-        if (out_status) *out_status = KS_IPC_ERR_RIGHTS;
-        return NULL;
-    }
-    if (ent->type != CAP_TYPE_ENDPOINT || !ent->obj) {
-        if (out_status) *out_status = KS_IPC_ERR_INVALID;
-        return NULL;
+        st = KS_IPC_ERR_RIGHTS;
+    } else if (ent->type != CAP_TYPE_ENDPOINT || !ent->obj) {
+        st = KS_IPC_ERR_INVALID;
+    } else {
+        e = (endpoint_t *)ent->obj;
     }
-    if (out_status) *out_status = KS_IPC_OK;
-    return (endpoint_t *)ent->obj;
+    cap_table_unlock(caps);
+    if (out_status) *out_status = st;
+    return e;
 }
 
 ks_ipc_status_t endpoint_create_cap(cap_table_t *caps,
@@ -156,24 +161,19 @@ ks_ipc_status_t ipc_send_cap(cap_table_t *caps,
         memcpy(m->data, msg->data, m->len);
     }
 
-    // Enqueue under IRQ mask.
-    uint64_t flags = irq_save();
+    // Enqueue and hand the message to the longest-waiting receiver, if any.
+    uint64_t flags = spin_lock_irqsave(&e->lock);
     q_push_tail(e, m);
-
-    // Wake a waiting receiver if present.
-    thread_t *w = e->waiting_recv;
-    if (w) {
-        e->waiting_recv = NULL;
-        // Wake the blocked receiver.
-        sched_wake(w);
-    }
-    irq_restore(flags);
+    (void)waitq_wake_one(&e->recv_wait);
+    spin_unlock_irqrestore(&e->lock, flags);
     return KS_IPC_OK;
 }
 
-ks_ipc_status_t ipc_recv_cap(cap_table_t *caps,
-                             cap_handle_t endpoint_h,
-                             ks_ipc_msg_t *out) {
+// Shared receive path. deadline == UINT64_MAX waits forever.
+static ks_ipc_status_t ipc_recv_common(cap_table_t *caps,
+                                       cap_handle_t endpoint_h,
+                                       ks_ipc_msg_t *out,
+                                       uint64_t deadline) {
     ASSERT_THREAD_CONTEXT();
     if (!out) {
         return KS_IPC_ERR_INVALID;
@@ -183,45 +183,54 @@ ks_ipc_status_t ipc_recv_cap(cap_table_t *caps,
     endpoint_t *e = endpoint_from_handle(caps, endpoint_h, CAP_R_RECV, &status);
     if (!e) return status;
 
+    uint64_t flags = spin_lock_irqsave(&e->lock);
+    ipc_msg_t *m = NULL;
     for (;;) {
-        uint64_t flags = irq_save();
-        ipc_msg_t *m = q_pop_head(e);
+        m = q_pop_head(e);
         if (m) {
-            irq_restore(flags);
-            // Copy out and free.
-            out->tag = m->tag;
-            out->len = m->len;
-            if (out->len > KS_IPC_MSG_MAX) {
-                // Should never happen; clamp defensively.
-                out->len = KS_IPC_MSG_MAX;
-            }
-            if (out->len > 0) {
-                memcpy(out->data, m->data, out->len);
-            }
-            ipc_msg_free(m);
-            return KS_IPC_OK;
+            break;
         }
-
         if (e->closed) {
-            irq_restore(flags);
-            return KS_IPC_ERR_CLOSED;
-        }
-
-        // Queue empty: block until a sender wakes us.
-        thread_t *cur = sched_current();
-        if (!cur) {
-            irq_restore(flags);
-            return KS_IPC_ERR_INVALID;
+            status = KS_IPC_ERR_CLOSED;
+            break;
         }
-        // Only one waiter supported in this minimal design.
-        if (e->waiting_recv && e->waiting_recv != cur) {
-            irq_restore(flags);
-            return KS_IPC_ERR_RIGHTS;
+        if (deadline != UINT64_MAX && time_now() >= deadline) {
+            status = KS_IPC_ERR_TIMEOUT;
+            break;
         }
-        e->waiting_recv = cur;
-        irq_restore(flags);
+        // Queue empty: sleep until a sender wakes us (the lock is dropped
+        // while asleep). Another receiver may still take the message first,
+        // so loop and look again.
+        (void)waitq_wait(&e->recv_wait, &e->lock, deadline);
+    }
+    spin_unlock_irqrestore(&e->lock, flags);
+    if (!m) {
+        return status;
+    }
 
-        // Block and reschedule. When we resume, loop and try again.
-        sched_block_current();
+    // Copy out and free.
+    out->tag = m->tag;
+    out->len = m->len;
+    if (out->len > KS_IPC_MSG_MAX) {
+        // Should never happen; clamp defensively.
+        out->len = KS_IPC_MSG_MAX;
     }
+    if (out->len > 0) {
+        memcpy(out->data, m->data, out->len);
+    }
+    ipc_msg_free(m);
+    return KS_IPC_OK;
+}
+
+ks_ipc_status_t ipc_recv_cap(cap_table_t *caps,
+                             cap_handle_t endpoint_h,
+                             ks_ipc_msg_t *out) {
+    return ipc_recv_common(caps, endpoint_h, out, UINT64_MAX);
+}
+
+ks_ipc_status_t ipc_recv_cap_until(cap_table_t *caps,
+                                   cap_handle_t endpoint_h,
+                                   ks_ipc_msg_t *out,
+                                   uint64_t deadline) {
+    return ipc_recv_common(caps, endpoint_h, out, deadline);
 }
@@ -5,19 +5,23 @@
 
 #include "core_kernel_abi_v3.h"   // ks_ipc_msg_t, ks_ipc_status_t
 #include "cap/cap_table.h"        // cap_table_t, cap_handle_t, cap_rights_t
-
-// Forward declaration to avoid pulling sched headers into all users.
-typedef struct thread thread_t;
+#include "sched/waitqueue.h"
+#include "sync/spinlock.h"
 
 typedef struct endpoint {
     uint64_t id;
 
+    // Guards the queue and recv_wait (senders and receivers may run on
+    // different CPUs).
+    spinlock_t lock;
+
     // Message queue (doubly-linked list of ipc_msg_t)
     struct ipc_msg *q_head;
     struct ipc_msg *q_tail;
 
-    // Single waiting receiver: minimal blocking primitive.
-    thread_t *waiting_recv;
+    // Receivers blocked on an empty queue, woken one per message. Any
+    // number of threads may receive on one endpoint.
+    wait_queue_t recv_wait;
 
     bool closed;
 } endpoint_t;
@@ -40,3 +44,10 @@ ks_ipc_status_t ipc_send_cap(cap_table_t *caps,
 ks_ipc_status_t ipc_recv_cap(cap_table_t *caps,
                              cap_handle_t endpoint_h,
                              ks_ipc_msg_t *out);
+
+// ipc_recv_cap() that gives up with KS_IPC_ERR_TIMEOUT once the counter
+// reaches `deadline` (time_now() units). A past deadline polls.
+ks_ipc_status_t ipc_recv_cap_until(cap_table_t *caps,
+                                   cap_handle_t endpoint_h,
+                                   ks_ipc_msg_t *out,
+                                   uint64_t deadline);
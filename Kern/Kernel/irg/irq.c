@@ -1,17 +1,23 @@
-/* Nesting-aware IRQ context indicator (single-core). */
+/* Nesting-aware IRQ context indicator (per CPU). */
 
 #include "irq.h"
 #include "panic.h"
+#include "smp/percpu.h"
+
+// Handlers run with IRQs masked (no nesting), so an unmasked caller is in
+// thread context. Checking that first also keeps a migrating thread from
+// reading another CPU's depth.
+bool in_irq(void) {
+    if (!irq_irqs_disabled()) return false;
+    return this_cpu_read(irq_depth) != 0;
+}
 
-static volatile uint32_t s_irq_depth = 0;
-
-bool in_irq(void) { return s_irq_depth != 0; }
-
-void irq_enter(void) { s_irq_depth++; }
+void irq_enter(void) { this_cpu_ptr()->irq_depth++; }
 
 void irq_exit(void) {
-    if (s_irq_depth == 0) panic("irq: depth underflow");
-    s_irq_depth--;
+    percpu_t *pc = this_cpu_ptr();
+    if (pc->irq_depth == 0) panic("irq: depth underflow");
+    pc->irq_depth--;
 }
 
 #include "gicv2.h"
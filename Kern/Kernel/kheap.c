@@ -7,6 +7,8 @@
 #include "uart_pl011.h"
 #include "mem.h"
 #include "contracts.h"
+#include "alloc/magazine.h"
+#include "sync/mcs_lock.h"
 
 #ifndef KMAIN_DEBUG
 #define KMAIN_DEBUG 0
@@ -39,7 +41,18 @@ typedef struct big_alloc_hdr {
 
 static free_node_t *g_freelist[NUM_BUCKETS];
 
-/* Hardening: allocation counters and peak usage. */
+/* Protects the bucket freelists and the counters below (IRQs masked). */
+static mcs_lock_t g_kheap_lock = MCS_LOCK_INIT;
+
+/* Per-CPU magazines in front of each bucket; set up on first use. */
+static mag_layer_t g_kheap_mag[NUM_BUCKETS];
+static bool g_kheap_mag_ready = false;
+
+/*
+ * Hardening: allocation counters and peak usage. Small blocks count as in
+ * use from the moment they leave their bucket, magazine rounds included;
+ * small kmalloc/kfree calls are counted by the magazine layers.
+ */
 static uint64_t g_kheap_cur_bytes = 0;
 static uint64_t g_kheap_peak_bytes = 0;
 static uint64_t g_kheap_small_allocs[NUM_BUCKETS];
@@ -104,11 +117,65 @@ static void refill_bucket(int b)
     }
 }
 
+/* Magazine layer backing: move blocks between bucket and magazine. */
+static uint32_t kheap_mag_fill(void *ctx, void **objs, uint32_t n)
+{
+    int b = (int)(uintptr_t)ctx;
+    mcs_node_t node;
+    uint64_t flags = mcs_lock_irqsave(&g_kheap_lock, &node);
+    uint32_t got = 0;
+    while (got < n) {
+        if (!g_freelist[b]) {
+            /* Lock order: kheap -> pmm. */
+            refill_bucket(b);
+        }
+        free_node_t *f = g_freelist[b];
+        if (!f) break;
+        g_freelist[b] = f->next;
+        objs[got++] = f;
+    }
+    g_kheap_small_allocs[b] += got;
+    kheap_account_alloc((uint64_t)got * g_bucket_sizes[b]);
+    mcs_unlock_irqrestore(&g_kheap_lock, &node, flags);
+    return got;
+}
+
+static void kheap_mag_drain(void *ctx, void **objs, uint32_t n)
+{
+    int b = (int)(uintptr_t)ctx;
+    mcs_node_t node;
+    uint64_t flags = mcs_lock_irqsave(&g_kheap_lock, &node);
+    for (uint32_t i = 0; i < n; i++) {
+        free_node_t *f = (free_node_t *)objs[i];
+        f->next = g_freelist[b];
+        g_freelist[b] = f;
+    }
+    g_kheap_small_frees[b] += n;
+    kheap_account_free((uint64_t)n * g_bucket_sizes[b]);
+    mcs_unlock_irqrestore(&g_kheap_lock, &node, flags);
+}
+
+static void kheap_mag_init(void)
+{
+    if (__atomic_load_n(&g_kheap_mag_ready, __ATOMIC_ACQUIRE)) return;
+    mcs_node_t node;
+    uint64_t flags = mcs_lock_irqsave(&g_kheap_lock, &node);
+    if (!g_kheap_mag_ready) {
+        for (int i = 0; i < NUM_BUCKETS; i++) {
+            mag_layer_init(&g_kheap_mag[i], kheap_mag_fill, kheap_mag_drain,
+                           (void *)(uintptr_t)i);
+        }
+        __atomic_store_n(&g_kheap_mag_ready, true, __ATOMIC_RELEASE);
+    }
+    mcs_unlock_irqrestore(&g_kheap_lock, &node, flags);
+}
+
 void kheap_init(void)
 {
     for (int i = 0; i < NUM_BUCKETS; i++) {
         g_freelist[i] = 0;
     }
+    kheap_mag_init();
 
 #if KMAIN_DEBUG
     uart_puts("KHEAP: init\n");
@@ -122,7 +189,7 @@ void *kheap_alloc_pages(uint32_t pages, uint64_t *out_pa)
 if (pages == 0) return 0;
     uint64_t pa = 0;
     if (!pmm_alloc_pages(pages, &pa)) {
-        g_kheap_fail_calls++; return 0;
+        __atomic_fetch_add(&g_kheap_fail_calls, 1u, __ATOMIC_RELAXED); return 0;
     }
     if (out_pa) *out_pa = pa;
     return (void *)(uintptr_t)pmm_phys_to_virt(pa);
@@ -134,33 +201,28 @@ void kheap_free_pages(void *va, uint32_t pages)
     ASSERT_THREAD_CONTEXT();
 if (!va || pages == 0) return;
     uint64_t pa0 = pmm_virt_to_phys((uint64_t)(uintptr_t)va);
-    pa0 = align_down_4k(pa0);
-    for (uint32_t i = 0; i < pages; i++) {
-        pmm_free_page(pa0 + ((uint64_t)i * PAGE_SIZE));
-    }
+    pmm_free_pages(align_down_4k(pa0), pages);
 }
 
 void *kmalloc(size_t size)
 {
     ASSERT_THREAD_CONTEXT();
-    g_kheap_kmalloc_calls++;
-    if (size == 0) return 0;
+    if (size == 0) {
+        __atomic_fetch_add(&g_kheap_kmalloc_calls, 1u, __ATOMIC_RELAXED);
+        return 0;
+    }
 
-    /* Small-object fast path: fixed buckets. */
+    /* Small-object fast path: fixed buckets behind per-CPU magazines. */
     int b = bucket_for_size(size);
     if (b >= 0) {
-        if (!g_freelist[b]) {
-            refill_bucket(b);
-        }
-        free_node_t *n = g_freelist[b];
-        if (!n) {
-            return 0;
+        kheap_mag_init();
+        void *p = mag_alloc(&g_kheap_mag[b]);
+        if (!p) {
+            __atomic_fetch_add(&g_kheap_kmalloc_calls, 1u, __ATOMIC_RELAXED);
         }
-        g_freelist[b] = n->next;
-        g_kheap_small_allocs[b]++;
-        kheap_account_alloc((uint64_t)g_bucket_sizes[b]);
-        return (void *)n;
+        return p;
     }
+    __atomic_fetch_add(&g_kheap_kmalloc_calls, 1u, __ATOMIC_RELAXED);
 
     /* Large allocation: page-granularity, with a small header for kfree. */
     uint64_t total = (uint64_t)size + (uint64_t)sizeof(big_alloc_hdr_t);
@@ -172,8 +234,11 @@ void *kmalloc(size_t size)
     big_alloc_hdr_t *hdr = (big_alloc_hdr_t *)base_va;
     hdr->magic = BIG_MAGIC;
     hdr->pages = pages;
+    mcs_node_t node;
+    uint64_t flags = mcs_lock_irqsave(&g_kheap_lock, &node);
     g_kheap_big_alloc_calls++;
     kheap_account_alloc((uint64_t)pages * PAGE_SIZE);
+    mcs_unlock_irqrestore(&g_kheap_lock, &node, flags);
 
     return (void *)(uintptr_t)((uint8_t *)base_va + sizeof(big_alloc_hdr_t));
 }
@@ -181,8 +246,10 @@ void *kmalloc(size_t size)
 void kfree(void *ptr)
 {
     ASSERT_THREAD_CONTEXT();
-    g_kheap_kfree_calls++;
-    if (!ptr) return;
+    if (!ptr) {
+        __atomic_fetch_add(&g_kheap_kfree_calls, 1u, __ATOMIC_RELAXED);
+        return;
+    }
 
     uint64_t va = (uint64_t)(uintptr_t)ptr;
     uint64_t page_va = align_down_4k(va);
@@ -191,25 +258,28 @@ void kfree(void *ptr)
     if (magic == SLAB_MAGIC) {
         const slab_page_hdr_t *hdr = (const slab_page_hdr_t *)(uintptr_t)page_va;
         uint16_t b = hdr->bucket_index;
-        if (b >= NUM_BUCKETS) return;
+        if (b >= NUM_BUCKETS) {
+            __atomic_fetch_add(&g_kheap_kfree_calls, 1u, __ATOMIC_RELAXED);
+            return;
+        }
         /* Poison freed memory (basic UAF detection). */
         memset(ptr, KHEAP_POISON_BYTE, (size_t)hdr->block_size);
-        free_node_t *n = (free_node_t *)ptr;
-        n->next = g_freelist[b];
-        g_freelist[b] = n;
-        g_kheap_small_frees[b]++;
-        kheap_account_free((uint64_t)hdr->block_size);
+        mag_free(&g_kheap_mag[b], ptr);
         return;
     }
 
+    __atomic_fetch_add(&g_kheap_kfree_calls, 1u, __ATOMIC_RELAXED);
     if (magic == BIG_MAGIC) {
         const big_alloc_hdr_t *hdr = (const big_alloc_hdr_t *)(uintptr_t)page_va;
         uint32_t pages = hdr->pages;
         if (pages == 0) return;
         /* Poison freed pages (basic UAF detection). */
         memset((void *)(uintptr_t)page_va, KHEAP_POISON_BYTE, (size_t)pages * (size_t)PAGE_SIZE);
+        mcs_node_t node;
+        uint64_t flags = mcs_lock_irqsave(&g_kheap_lock, &node);
         g_kheap_big_free_calls++;
         kheap_account_free((uint64_t)pages * PAGE_SIZE);
+        mcs_unlock_irqrestore(&g_kheap_lock, &node, flags);
         kheap_free_pages((void *)(uintptr_t)page_va, pages);
         return;
     }
@@ -223,8 +293,16 @@ void kheap_get_stats(kheap_stats_t *out)
     if (!out) return;
     out->cur_bytes = g_kheap_cur_bytes;
     out->peak_bytes = g_kheap_peak_bytes;
-    out->kmalloc_calls = g_kheap_kmalloc_calls;
-    out->kfree_calls = g_kheap_kfree_calls;
+    out->kmalloc_calls = __atomic_load_n(&g_kheap_kmalloc_calls, __ATOMIC_RELAXED);
+    out->kfree_calls = __atomic_load_n(&g_kheap_kfree_calls, __ATOMIC_RELAXED);
+    if (__atomic_load_n(&g_kheap_mag_ready, __ATOMIC_ACQUIRE)) {
+        for (int i = 0; i < NUM_BUCKETS; i++) {
+            mag_stats_t ms;
+            mag_get_stats(&g_kheap_mag[i], &ms);
+            out->kmalloc_calls += ms.allocs;
+            out->kfree_calls += ms.frees;
+        }
+    }
     out->big_alloc_calls = g_kheap_big_alloc_calls;
     out->big_free_calls = g_kheap_big_free_calls;
     out->fail_calls = g_kheap_fail_calls;
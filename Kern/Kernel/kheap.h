@@ -16,7 +16,10 @@
  * Implementation notes:
  * - Large allocations are page-granularity via PMM.
  * - Small allocations use fixed buckets backed by PMM pages.
- * - Single-core bring-up (no locks).
+ * - Each bucket sits behind a per-CPU magazine layer (alloc/magazine.h);
+ *   the global MCS lock (IRQs masked) guarding the buckets is taken only
+ *   to move whole magazines of blocks. Lock order is kheap -> pmm.
+ * - cur/peak bytes count small blocks held in magazines as in use.
  */
 
 void kheap_init(void);
@@ -23,7 +23,10 @@
 #include "gicv2.h"
 #include "timer_generic.h"
 #include "work/work_queue.h"
+#include "timer/timer_wheel.h"
 #include "sched.h"
+#include "smp/smp.h"
+#include "smp/percpu.h"
 #include "kheap.h"   // kbuf_alloc/kbuf_free (buffer-tier allocator)
 #include "panic.h"   // panic()
 
@@ -35,10 +38,12 @@ const kernel_services_v1_t *kernel_services_v1(void);
 
 #include "MathHelper.h"
 #include "sched/thread.h"
+#include "sched/sched_bench.h"
 #include "ipc/ipc_message.h"
 #include "cap/cap_entry.h"
 #include "cap/cap_table.h"
 #include "cap/cap_ops.h"
+#include "sched/deadline_queue.h"
 #include "ipc/ipc_selftest.h"
 #include "ipc/endpoint.h"
 #include "task/task.h"
@@ -134,9 +139,7 @@ static void pmm_quick_alloc_test(void) {
     pmm_print_free_total("AfterAlloc2");
 
     if (run_pa) {
-        for (uint32_t i = 0; i < 64; i++) {
-            pmm_free_page(run_pa + ((uint64_t)i * 0x1000ULL));
-        }
+        pmm_free_pages(run_pa, 64);
         uart_puts("Free2: contiguous 64 pages\n");
         pmm_print_free_total("AfterFree2");
     }
@@ -214,13 +217,31 @@ static void timer_irq_handler(uint32_t irq, void *ctx, trap_frame_t *tf)
     (void)irq; (void)ctx; (void)tf;
 
     /* Top-half: acknowledge/re-arm the timer. */
-    timer_handle_irq();
+    const bool ticked = timer_handle_irq();
+
+    /* Kernel timers, then the deadline class (which re-arms the one-shot). */
+    ktimer_run();
+    sched_deadline_event();
+    if (!ticked) {
+        return;
+    }
 
-    /* Enqueue the deferred tick work item (no allocation in IRQ). */
-    if (!g_tick_work_pending) {
+    /*
+     * Load tracking and balancing run in both modes; the time slice is only
+     * charged when preemptive (IRQ exit performs the switch).
+     */
+    sched_tick();
+
+#if CONFIG_SCHED_COOPERATIVE
+    /*
+     * Enqueue the deferred tick work item (no allocation in IRQ). The work
+     * queue is drained by core/main on CPU0, so only CPU0's tick feeds it.
+     */
+    if (cpu_id() == 0 && !g_tick_work_pending) {
         g_tick_work_pending = true;
         (void)workq_enqueue_from_irq(&g_deferred_workq, &g_tick_item);
     }
+#endif
 }
 
 /*
@@ -275,6 +296,8 @@ static void core_thread_entry(void *arg)
     // Hand services table to Core, then enter Core.
     core_set_services(kernel_services_v1());
     core_set_services_v3(kernel_services_v3());
+    core_set_services_v4(kernel_services_v4());
+    core_set_services_v5(kernel_services_v5());
     (void)core_main();
 
     for (;;) {
@@ -298,13 +321,16 @@ static void core_thread_entry(void *arg)
             continue;
         }
 
-        /* Sleep until the next interrupt enqueues more work. */
-        __asm__ volatile ("wfi");
+        /* Block until an interrupt enqueues more work; the CPU can idle. */
+        workq_wait(&g_deferred_workq);
     }
 }
 
 void kmain(const boot_info_t *boot_info)
 {
+    /* Per-CPU block (TPIDR_EL1) first: IRQ and scheduler paths rely on it. */
+    percpu_init_cpu(cpu_id());
+
     /* Ensure we have a working UART even before DTB parsing. */
     uart_init(0);
 
@@ -368,9 +394,15 @@ void kmain(const boot_info_t *boot_info)
 #endif
 
     
-    /* Initialize bitmap PMM using TTBR1 high-half direct map. */
+    /* Initialize the buddy PMM using TTBR1 high-half direct map. */
     pmm_init(boot_info);
 
+#ifdef DEBUG
+    pmm_selftest();
+    dlq_selftest();
+    ktimer_selftest();
+#endif
+
 #if KMAIN_DEBUG
     /* Quick sanity test: allocate/free cycles and print free/total. */
     pmm_quick_alloc_test();
@@ -409,13 +441,20 @@ void kmain(const boot_info_t *boot_info)
 
     /* 100Hz tick (10ms). */
     /*
-     * Start the periodic tick (unless built in tickless mode).
-     * Timer IRQ handling remains registered for one-shot deadlines.
+     * Start the periodic tick. With CONFIG_TICKLESS it is stopped whenever a
+     * CPU idles (sched_idle_wait()) and one-shot deadlines wake it instead.
      */
     timer_init_hz(CONFIG_TICK_HZ);
 
+    /* Start secondary CPUs (PSCI); each sets up its own GIC/timer and idles. */
+    (void)smp_init();
+
+    /* Frees exited threads. */
+    thread_reaper_start();
+
     /* Create and enqueue a dedicated Core thread. */
-    thread_t *core_thr = thread_create_named("core/main", core_thread_entry, NULL);
+    thread_t *core_thr = thread_create_named("core/main", core_thread_entry, NULL,
+                                             SCHED_PRIO_DEFAULT);
     if (!core_thr) {
         uart_puts("kmain: failed to create core thread\n");
         for (;;) {
@@ -423,7 +462,11 @@ void kmain(const boot_info_t *boot_info)
         }
     }
     core_thr->task = &g_kernel_task;
-    sched_enqueue(core_thr);
+    sched_enqueue(core_thr, core_thr->priority);
+
+#if CONFIG_SCHED_BENCH
+    sched_bench_start();
+#endif
 
     irq_global_enable();
 
@@ -433,13 +476,6 @@ void kmain(const boot_info_t *boot_info)
     uart_puts(CAPAZ_BUILD_DATE);
     uart_putnl();
     
-    /* Enter the cooperative scheduler. */
-    yield();
-
-    /* Bootstrap thread becomes the idle thread. */
-    for (;;) {
-        __asm__ volatile ("wfi");
-        /* Give other runnable threads a chance to run. */
-        yield();
-    }
+    /* Enter the scheduler; this CPU's idle thread takes over from here. */
+    sched_exit_bootstrap();
 }
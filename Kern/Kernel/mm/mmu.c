@@ -8,8 +8,8 @@
  * same L0 table.  That is convenient for bring‑up but does not
  * enforce a default‑deny policy: user space sees all of kernel
  * memory.  Here we allocate a new L0 and L1 table, map only the
- * device region (physical 0x0000_0000–0x3FFF_FFFF) and the kernel
- * RAM region (physical 0x4000_0000–0x7FFF_FFFF) into the higher
+ * device region (physical 0x0000_0000–0x3FFF_FFFF) and every RAM
+ * bank the DTB lists inside the platform RAM window into the higher
  * half virtual address space, and install the new tables with
  * TCR.EPD0=1 so that TTBR0 is not consulted.  This is a stepping
  * stone towards more granular mappings and W^X enforcement.
@@ -18,6 +18,7 @@
 
 #include "mmu.h"
 #include "dtb.h"
+#include "platform.h"
 #include "uart_pl011.h"
 #include "panic.h"
 #include <stdint.h>
@@ -66,13 +67,11 @@ static inline uint64_t mmu_pa_to_va(uint64_t pa)
 }
 
 #define RAM_BLOCK_SIZE (2ULL * 1024 * 1024)
-#define RAM_DIRECTMAP_SIZE (512ULL * RAM_BLOCK_SIZE) /* legacy 1GiB window; no longer clamps DTB RAM mapping */
+#define RAM_DIRECTMAP_SIZE (512ULL * RAM_BLOCK_SIZE) /* fallback 1GiB window without DTB memory ranges */
 
-/* Fixed PMM metadata reservation (pages) immediately after kernel runtime end. */
-#define PMM_METADATA_PAGES 16ULL
 #define L1_BLOCK_SIZE (1ULL << 30)
 #define L2_BLOCK_SIZE RAM_BLOCK_SIZE
-#define MAX_L2_TABLES 128 /* supports up to 128 GiB of RAM mapping with per-GiB L2 tables */
+#define MAX_L2_TABLES PLATFORM_RAM_WINDOW_GIB /* one per GiB of the platform RAM window */
 
 static inline uint64_t align_down_2m(uint64_t x) { return x & ~(RAM_BLOCK_SIZE - 1); }
 static inline uint64_t align_up_2m(uint64_t x) { return (x + (RAM_BLOCK_SIZE - 1)) & ~(RAM_BLOCK_SIZE - 1); }
@@ -157,6 +156,11 @@ static uint64_t *l2_for_l1[512];
 static uint64_t l3_pool[64][512] __attribute__((aligned(4096)));
 static size_t l3_pool_used = 0;
 
+/* TTBR0 table for secondary CPU bring-up: L0[0] -> l1_table, i.e. VA == PA
+ * for every RAM/device window the kernel maps. Only used until the secondary
+ * has branched to the high half. */
+static uint64_t idmap_l0_table[512] __attribute__((aligned(4096)));
+
 
 /* W^X invariants self-test helpers */
 
@@ -375,7 +379,7 @@ static void page_alloc_init(void)
      */
     uint64_t end_va  = (uint64_t)__kernel_runtime_end;
     uint64_t end_pa  = virt_to_phys(end_va);
-    alloc_phys = ((end_pa + 0xFFFULL) & ~0xFFFULL) + (PMM_METADATA_PAGES * 0x1000ULL);
+    alloc_phys = ((end_pa + 0xFFFULL) & ~0xFFFULL) + (platform_pmm_metadata_pages() * 0x1000ULL);
     alloc_virt = HH_PHYS_4000_BASE + (alloc_phys - RAM_BASE);
 }
 
@@ -464,6 +468,7 @@ void mmu_init(const boot_info_t *boot_info)
      */
     uint64_t l1_pa = virt_to_phys((uint64_t)l1);
     l0[256] = l1_pa | DESC_TABLE;
+    idmap_l0_table[0] = l1_pa | DESC_TABLE;
 
     /* L1[0]: map the device/MMIO region (physical 0x0000_0000..0x3FFF_FFFF)
      * as a 1‑GiB block of Device memory.  We mark it non‑shareable,
@@ -508,9 +513,12 @@ void mmu_init(const boot_info_t *boot_info)
         uint64_t range_start = mem_ranges[r].base;
         uint64_t range_end   = mem_ranges[r].base + mem_ranges[r].size;
 
-        /* We only direct-map RAM starting at RAM_BASE. */
+        /* We only direct-map RAM inside the platform RAM window. Banks
+         * may be discontiguous; holes between them stay unmapped. */
         if (range_end <= RAM_BASE) continue;
         if (range_start < RAM_BASE) range_start = RAM_BASE;
+        if (range_end > PLATFORM_RAM_WINDOW_END) range_end = PLATFORM_RAM_WINDOW_END;
+        if (range_end <= range_start) continue;
 
         uint64_t pa = align_down_2m(range_start);
         uint64_t pa_end = align_up_2m(range_end);
@@ -677,3 +685,36 @@ void mmu_init(const boot_info_t *boot_info)
     /* Prove W^X invariants with current image layout. */
     mmu_assert_layout_and_wx();
 }
+
+void mmu_get_secondary_regs(mmu_cpu_regs_t *out)
+{
+    if (!out) return;
+    out->mair  = MAIR_DEFAULT;
+    /* TTBR0 walks stay enabled (EPD0=0) until mmu_secondary_finish(). */
+    out->tcr   = TCR_BOOT;
+    out->ttbr0 = virt_to_phys((uint64_t)idmap_l0_table);
+    out->ttbr1 = virt_to_phys((uint64_t)l0_table);
+}
+
+void mmu_secondary_finish(void)
+{
+    uint64_t tcr  = TCR_BOOT | (1ULL << 7);
+    uint64_t vbar = (uint64_t)kernel_vectors;
+
+    asm volatile (
+        "msr tcr_el1, %[tcr]\n"
+        "isb\n"
+        "msr ttbr0_el1, xzr\n"
+        "isb\n"
+        /* Drop any identity-map translations this CPU cached. */
+        "tlbi vmalle1\n"
+        "dsb nsh\n"
+        "isb\n"
+        "msr vbar_el1, %[vbar]\n"
+        "isb\n"
+        :
+        : [tcr]  "r"(tcr),
+          [vbar] "r"(vbar)
+        : "memory"
+    );
+}
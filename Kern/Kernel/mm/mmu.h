@@ -11,4 +11,26 @@
  */
 void mmu_init(const boot_info_t *boot_info);
 
+/*
+ * Translation registers a secondary CPU loads before enabling its MMU
+ * (see Arch/aarch64/secondary_entry.S). ttbr0 is an identity map of the
+ * kernel's L1 table so the instructions that turn the MMU on keep executing
+ * at their physical address; ttbr1 is the kernel's L0 table.
+ */
+typedef struct mmu_cpu_regs {
+    uint64_t mair;
+    uint64_t tcr;
+    uint64_t ttbr0;
+    uint64_t ttbr1;
+} mmu_cpu_regs_t;
+
+/* Valid after mmu_init(). */
+void mmu_get_secondary_regs(mmu_cpu_regs_t *out);
+
+/*
+ * Secondary CPU, already executing at its high-half alias: disable TTBR0
+ * (EPD0=1) and install the kernel exception vectors, matching the boot CPU.
+ */
+void mmu_secondary_finish(void);
+
 #endif
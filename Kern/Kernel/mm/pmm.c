@@ -6,19 +6,26 @@
 #include <stdbool.h>
 
 #include "platform.h"
+#include "alloc/kstack_cache.h"
 #include "dtb.h"
 #include "uart_pl011.h"
 #include "panic.h"
+#include "config.h"
 #include "contracts.h"
+#include "smp/percpu.h"
+#include "smp/smp.h"
+#include "sync/mcs_lock.h"
+#include "sync/spinlock.h"
 
 /* Must match platform.c + mmu.c direct-map assumptions. */
 #define PAGE_SIZE 0x1000ULL
-#define RAM_BASE 0x40000000ULL
-#define RAM_DIRECTMAP_SIZE 0x40000000ULL /* 1 GiB */
+#define RAM_BASE PLATFORM_RAM_BASE
 #define HH_PHYS_4000_BASE 0xFFFF800040000000ULL
 
-/* Option B: fixed metadata reservation immediately after kernel runtime end. */
-#define PMM_METADATA_PAGES 16ULL
+/*
+ * Metadata (state + bitmaps) sits immediately after the kernel runtime end,
+ * platform_pmm_metadata_pages() long: sized from the DTB RAM span.
+ */
 
 /* Linker symbol: page-aligned end of the kernel runtime footprint (.bss included). */
 extern uint8_t __kernel_runtime_end[];
@@ -26,16 +33,31 @@ extern uint8_t __kernel_runtime_end[];
 /* freestanding libc */
 void *memset(void *dst, int c, size_t n);
 
+/*
+ * Buddy free lists: a free block of 2^order pages is linked through a header
+ * written into its first page (reached through the direct map), so the lists
+ * need no metadata beyond the bitmap. Blocks are naturally aligned relative
+ * to base_pa, which is itself aligned to the largest block.
+ */
+typedef struct pmm_block {
+    struct pmm_block *next;
+    struct pmm_block *prev;
+    uint32_t order;
+} pmm_block_t;
+
 typedef struct pmm_state {
-    uint64_t base_pa;        /* inclusive */
+    uint64_t base_pa;        /* inclusive, aligned to PMM_MAX_BLOCK_PAGES pages */
     uint64_t limit_pa;       /* exclusive */
     uint64_t total_pages;
     uint64_t free_pages;
 
     uint8_t *bitmap;         /* VA (high-half direct map) */
     uint64_t bitmap_bytes;
+    uint8_t *cached;         /* pages in a per-CPU cache; same layout, atomic ops */
+
+    pmm_block_t *free_list[PMM_MAX_ORDER + 1];
+    uint64_t nr_free[PMM_MAX_ORDER + 1];   /* blocks on each list */
 
-    uint64_t next_hint;      /* page index hint */
     uint64_t meta_base_pa;
     uint64_t meta_pages;
 } pmm_state_t;
@@ -43,6 +65,26 @@ typedef struct pmm_state {
 /* Stored in the metadata region; also cached as a VA pointer. */
 static pmm_state_t *g_pmm = 0;
 
+/* Serializes bitmap updates across CPUs (held with IRQs masked). */
+static mcs_lock_t g_pmm_lock = MCS_LOCK_INIT;
+
+/*
+ * Per-CPU page caches: single pages are allocated from and freed to the
+ * calling CPU's hot list, which is refilled from and drained to the buddy
+ * lists CONFIG_PMM_PCP_BATCH pages at a time under one g_pmm_lock hold.
+ * Cached pages keep their bitmap bit set (they count as used for the
+ * pressure watermarks) and also have their bit set in st->cached, which
+ * catches double frees without trusting the page's contents. CPUs update
+ * neighbouring cached bits under different locks, hence the atomic ops.
+ * The owner takes the lock with IRQs masked, so the line stays local;
+ * peers take it only to drain on memory pressure.
+ * The hot lists live in the per-CPU block (percpu_t.pmm_pcp).
+ * Lock order: pcp lock, then g_pmm_lock.
+ */
+typedef struct pmm_pcp_page {
+    struct pmm_pcp_page *next;
+} pmm_pcp_page_t;
+
 /* Hardening: PMM pressure/counters. */
 static uint64_t g_pmm_alloc_calls = 0;
 static uint64_t g_pmm_free_calls = 0;
@@ -90,6 +132,20 @@ static inline bool bit_test(const uint8_t *bm, uint64_t idx) {
     return ((bm[idx >> 3] >> (idx & 7)) & 1u) != 0;
 }
 
+/* Cache-membership bits: returns the previous value. */
+static inline bool cached_set(uint8_t *bm, uint64_t idx) {
+    const uint8_t m = (uint8_t)(1u << (idx & 7));
+    return (__atomic_fetch_or(&bm[idx >> 3], m, __ATOMIC_RELAXED) & m) != 0;
+}
+
+static inline void cached_clear(uint8_t *bm, uint64_t idx) {
+    (void)__atomic_fetch_and(&bm[idx >> 3], (uint8_t)~(1u << (idx & 7)), __ATOMIC_RELAXED);
+}
+
+static inline bool cached_test(const uint8_t *bm, uint64_t idx) {
+    return ((__atomic_load_n(&bm[idx >> 3], __ATOMIC_RELAXED) >> (idx & 7)) & 1u) != 0;
+}
+
 /*
  * Bitmap convention:
  *   bit == 1  => page is RESERVED/ALLOCATED
@@ -159,38 +215,105 @@ static void bitmap_mark_range_reserved(pmm_state_t *st, uint64_t start_pa, uint6
     }
 }
 
-static void pmm_panic(const char *msg) {
-    panic_with_prefix("PMM PANIC: ", msg);
+static inline uint64_t pmm_idx_to_pa(const pmm_state_t *st, uint64_t idx) {
+    return st->base_pa + idx * PAGE_SIZE;
+}
+
+static inline pmm_block_t *pmm_block_at(const pmm_state_t *st, uint64_t idx) {
+    return (pmm_block_t *)(uintptr_t)phys_to_hh_virt(pmm_idx_to_pa(st, idx));
 }
 
-#if 0  /* Unused helper retained for future use; disabled to avoid -Wunused-function under -Werror. */
-/* Compute the max end of clamped DTB memory ranges, or fall back to RAM_DIRECTMAP_SIZE. */
-static uint64_t compute_limit_from_dtb(void) {
-    dtb_range_t mem[64];
-    uint32_t mem_n = (uint32_t)(sizeof(mem) / sizeof(mem[0]));
-    if (!dtb_get_memory_ranges(mem, &mem_n) || mem_n == 0) {
-        return RAM_BASE + RAM_DIRECTMAP_SIZE;
+static inline uint64_t pmm_block_idx(const pmm_state_t *st, const pmm_block_t *b) {
+    return (hh_virt_to_phys((uint64_t)(uintptr_t)b) - st->base_pa) / PAGE_SIZE;
+}
+
+static void pmm_list_push(pmm_state_t *st, uint64_t idx, uint32_t order) {
+    pmm_block_t *b = pmm_block_at(st, idx);
+    b->order = order;
+    b->prev = NULL;
+    b->next = st->free_list[order];
+    if (b->next) b->next->prev = b;
+    st->free_list[order] = b;
+    st->nr_free[order]++;
+}
+
+static void pmm_list_unlink(pmm_state_t *st, pmm_block_t *b) {
+    if (b->prev) b->prev->next = b->next;
+    else st->free_list[b->order] = b->next;
+    if (b->next) b->next->prev = b->prev;
+    st->nr_free[b->order]--;
+}
+
+/*
+ * Is the (bitmap-free) page `idx` the head of a free block of `order`?
+ * A free page at a 2^order-aligned index whose partner block is being
+ * freed can only be the head of a free block of at most that order, so
+ * its header is current and the order check is exact.
+ */
+static inline bool pmm_is_free_head(const pmm_state_t *st, uint64_t idx, uint32_t order) {
+    if (idx + (1ULL << order) > st->total_pages) return false;
+    if (bit_test(st->bitmap, idx)) return false;
+    return pmm_block_at(st, idx)->order == order;
+}
+
+/*
+ * Return the free, bitmap-clear block [idx, idx + 2^order) to the lists,
+ * merging it with its buddy for as long as the buddy is free and whole.
+ */
+static void pmm_block_free_locked(pmm_state_t *st, uint64_t idx, uint32_t order) {
+    while (order < PMM_MAX_ORDER) {
+        const uint64_t buddy = idx ^ (1ULL << order);
+        if (!pmm_is_free_head(st, buddy, order)) break;
+        pmm_list_unlink(st, pmm_block_at(st, buddy));
+        idx &= ~(1ULL << order);
+        order++;
     }
+    pmm_list_push(st, idx, order);
+}
 
-    uint64_t max_end = RAM_BASE;
-    for (uint32_t i = 0; i < mem_n; i++) {
-        uint64_t start = mem[i].base;
-        uint64_t end = mem[i].base + mem[i].size;
-        /* Clamp to our direct-map window. */
-        if (end <= RAM_BASE) continue;
-        if (start < RAM_BASE) start = RAM_BASE;
-        uint64_t window_end = RAM_BASE + RAM_DIRECTMAP_SIZE;
-        if (start >= window_end) continue;
-        if (end > window_end) end = window_end;
-        if (end > max_end) max_end = end;
+/* Largest order a block at `idx` may have without passing `end`. */
+static inline uint32_t pmm_fit_order(uint64_t idx, uint64_t end) {
+    uint32_t order = 0;
+    while (order < PMM_MAX_ORDER &&
+           (idx & ((2ULL << order) - 1ULL)) == 0 &&
+           idx + (2ULL << order) <= end) {
+        order++;
     }
+    return order;
+}
 
-    if (max_end <= RAM_BASE) {
-        max_end = RAM_BASE + RAM_DIRECTMAP_SIZE;
+/* Hand the free, bitmap-clear pages [idx, end) back as maximal aligned blocks. */
+static void pmm_range_to_lists(pmm_state_t *st, uint64_t idx, uint64_t end) {
+    while (idx < end) {
+        const uint32_t order = pmm_fit_order(idx, end);
+        pmm_list_push(st, idx, order);
+        idx += 1ULL << order;
     }
-    return max_end;
 }
-#endif
+
+/* Build the free lists from the bitmap once the reservations are in. */
+static void pmm_build_free_lists(pmm_state_t *st) {
+    uint64_t i = 0;
+    while (i < st->total_pages) {
+        /* Skip reserved stretches (bank holes) a byte at a time. */
+        if ((i & 7) == 0 && st->bitmap[i >> 3] == 0xFF) { i += 8; continue; }
+        if (bit_test(st->bitmap, i)) { i++; continue; }
+        uint64_t end = i + 1;
+        while (end < st->total_pages && !bit_test(st->bitmap, end)) end++;
+        pmm_range_to_lists(st, i, end);
+        i = end;
+    }
+}
+
+static inline uint32_t pmm_order_for(uint32_t count) {
+    uint32_t order = 0;
+    while ((1ULL << order) < (uint64_t)count) order++;
+    return order;
+}
+
+static void pmm_panic(const char *msg) {
+    panic_with_prefix("PMM PANIC: ", msg);
+}
 
 void pmm_init(const boot_info_t *boot_info) {
     if (!boot_info) {
@@ -219,28 +342,52 @@ void pmm_init(const boot_info_t *boot_info) {
         pmm_panic("invalid PMM window from usable ranges");
     }
 
-    /* Clamp to our TTBR1 direct-map window for short-term correctness. */
+    /* Clamp to the TTBR1 direct-map window (usable ranges already are). */
     const uint64_t win_start = RAM_BASE;
-    const uint64_t win_end = RAM_BASE + RAM_DIRECTMAP_SIZE;
+    const uint64_t win_end = PLATFORM_RAM_WINDOW_END;
     if (base_pa < win_start) base_pa = win_start;
     if (limit_pa > win_end) limit_pa = win_end;
     base_pa = align_up_4k(base_pa);
     limit_pa = align_down_4k(limit_pa);
 
+    /* Buddy blocks are aligned relative to base_pa; the pages this adds below
+     * the first usable range start out reserved like any other hole. */
+    base_pa &= ~(PMM_MAX_BLOCK_PAGES * PAGE_SIZE - 1ULL);
+    if (base_pa < win_start) base_pa = win_start;
+
     if (limit_pa <= base_pa) {
         pmm_panic("PMM window empty after clamp");
     }
 
-    /* Metadata region: fixed reservation immediately after kernel runtime end. */
+    /* Metadata region: reserved immediately after kernel runtime end. */
     uint64_t runtime_end_pa = hh_virt_to_phys((uint64_t)__kernel_runtime_end);
     uint64_t meta_base_pa = align_up_4k(runtime_end_pa);
-    uint64_t meta_bytes = PMM_METADATA_PAGES * PAGE_SIZE;
+    uint64_t meta_pages = platform_pmm_metadata_pages();
+    uint64_t meta_bytes = meta_pages * PAGE_SIZE;
     uint64_t meta_end_pa = meta_base_pa + meta_bytes;
 
-    /* Metadata must live in the mapped direct-map window (TTBR1). */
+    /* Metadata must live in the mapped direct-map window (TTBR1), inside
+     * the RAM bank that holds the kernel (not in a hole past its end). */
     if (meta_base_pa < win_start || meta_end_pa > win_end) {
         pmm_panic("metadata region outside mapped RAM window");
     }
+    {
+        dtb_range_t mem[64];
+        uint32_t mem_n = (uint32_t)(sizeof(mem) / sizeof(mem[0]));
+        bool in_bank = false;
+        if (dtb_get_memory_ranges(mem, &mem_n) && mem_n != 0) {
+            for (uint32_t i = 0; i < mem_n; i++) {
+                if (meta_base_pa >= mem[i].base && meta_end_pa <= mem[i].base + mem[i].size) {
+                    in_bank = true;
+                }
+            }
+        } else {
+            in_bank = true;
+        }
+        if (!in_bank) {
+            pmm_panic("metadata region runs past the kernel's RAM bank");
+        }
+    }
 
     uint64_t meta_base_va = phys_to_hh_virt(meta_base_pa);
 
@@ -251,19 +398,24 @@ void pmm_init(const boot_info_t *boot_info) {
     st->limit_pa = limit_pa;
     st->total_pages = (st->limit_pa - st->base_pa) / PAGE_SIZE;
     st->free_pages = 0;
-    st->next_hint = 0;
+    for (uint32_t o = 0; o <= PMM_MAX_ORDER; o++) {
+        st->free_list[o] = NULL;
+        st->nr_free[o] = 0;
+    }
     st->meta_base_pa = meta_base_pa;
-    st->meta_pages = PMM_METADATA_PAGES;
+    st->meta_pages = meta_pages;
 
     uint64_t bitmap_bytes = (st->total_pages + 7ULL) / 8ULL;
     uint64_t state_bytes = (uint64_t)sizeof(pmm_state_t);
     uint64_t bitmap_off = (state_bytes + 7ULL) & ~7ULL;
-    if (bitmap_off + bitmap_bytes > meta_bytes) {
+    if (bitmap_off + 2ULL * bitmap_bytes > meta_bytes) {
         pmm_panic("metadata pages insufficient for bitmap");
     }
 
     st->bitmap = (uint8_t *)(uintptr_t)(meta_base_va + bitmap_off);
     st->bitmap_bytes = bitmap_bytes;
+    st->cached = st->bitmap + bitmap_bytes;
+    memset(st->cached, 0, bitmap_bytes);
 
     /* Initialize: everything reserved, then clear bits for usable ranges. */
     bitmap_mark_all_reserved(st);
@@ -329,54 +481,233 @@ void pmm_init(const boot_info_t *boot_info) {
     /* PMM metadata pages. */
     bitmap_mark_range_reserved(st, meta_base_pa, meta_end_pa);
 
+    pmm_build_free_lists(st);
+
     g_pmm = st;
     /* Initialize pressure counters from the post-reservation state. */
     pmm_update_pressure(st);
     pmm_dump_summary();
 }
 
-bool pmm_alloc_pages(uint32_t count, uint64_t *out_pa) {
-    ASSERT_THREAD_CONTEXT();
-    g_pmm_alloc_pages_calls++;
-    if (count > 1) g_pmm_alloc_contig_calls++;
-    pmm_state_t *st = g_pmm;
-    if (!st || !out_pa || count == 0) return false;
+/* Take a free block of exactly `order` pages, splitting a larger one. */
+static bool pmm_take_block_locked(pmm_state_t *st, uint32_t order, uint64_t *out_idx) {
+    uint32_t o = order;
+    while (o <= PMM_MAX_ORDER && !st->free_list[o]) o++;
+    if (o > PMM_MAX_ORDER) return false;
+
+    pmm_block_t *b = st->free_list[o];
+    pmm_list_unlink(st, b);
+    const uint64_t idx = pmm_block_idx(st, b);
+    /* Split: the upper halves go back down the lists. */
+    while (o > order) {
+        o--;
+        pmm_list_push(st, idx + (1ULL << o), o);
+    }
+    *out_idx = idx;
+    return true;
+}
+
+/*
+ * Runs longer than the largest block: take a stretch of whole, adjacent
+ * free max-order blocks. Linear in the number of max-order slots, not
+ * in pages.
+ */
+static bool pmm_take_run_locked(pmm_state_t *st, uint64_t count, uint64_t *out_idx) {
+    const uint64_t blocks = (count + PMM_MAX_BLOCK_PAGES - 1ULL) / PMM_MAX_BLOCK_PAGES;
+    if (st->nr_free[PMM_MAX_ORDER] < blocks) return false;
+
+    uint64_t run = 0;
+    for (uint64_t i = 0; i + PMM_MAX_BLOCK_PAGES <= st->total_pages; i += PMM_MAX_BLOCK_PAGES) {
+        if (!pmm_is_free_head(st, i, PMM_MAX_ORDER)) { run = 0; continue; }
+        if (++run < blocks) continue;
+
+        const uint64_t first = i + PMM_MAX_BLOCK_PAGES - run * PMM_MAX_BLOCK_PAGES;
+        for (uint64_t j = 0; j < run; j++) {
+            pmm_list_unlink(st, pmm_block_at(st, first + j * PMM_MAX_BLOCK_PAGES));
+        }
+        *out_idx = first;
+        return true;
+    }
+    return false;
+}
+
+static bool pmm_alloc_pages_locked(pmm_state_t *st, uint32_t count, uint64_t *out_pa) {
     if (st->free_pages < (uint64_t)count) return false;
 
-    uint64_t n = st->total_pages;
-    if ((uint64_t)count > n) return false;
+    /* Round up to a block; a run past the largest block is a stretch of them. */
+    uint64_t idx = 0;
+    uint64_t got = 0;
+    if ((uint64_t)count <= PMM_MAX_BLOCK_PAGES) {
+        const uint32_t order = pmm_order_for(count);
+        if (!pmm_take_block_locked(st, order, &idx)) return false;
+        got = 1ULL << order;
+    } else {
+        if (!pmm_take_run_locked(st, count, &idx)) return false;
+        got = (((uint64_t)count + PMM_MAX_BLOCK_PAGES - 1ULL) / PMM_MAX_BLOCK_PAGES) *
+              PMM_MAX_BLOCK_PAGES;
+    }
 
-    uint64_t start = st->next_hint;
-    if (start >= n) start = 0;
+    for (uint64_t j = 0; j < (uint64_t)count; j++) {
+        bit_set(st->bitmap, idx + j);
+    }
+    /* The rounded-up tail stays free. */
+    pmm_range_to_lists(st, idx + (uint64_t)count, idx + got);
 
-    for (uint64_t pass = 0; pass < 2; pass++) {
-        uint64_t i0 = (pass == 0) ? start : 0;
-        uint64_t i1 = (pass == 0) ? n : start;
+    st->free_pages -= (uint64_t)count;
+    pmm_update_pressure(st);
+    *out_pa = pmm_idx_to_pa(st, idx);
+    return true;
+}
 
-        if (i1 < (uint64_t)count) continue;
+static bool pmm_alloc_global(pmm_state_t *st, uint32_t count, uint64_t *out_pa) {
+    mcs_node_t node;
+    uint64_t flags = mcs_lock_irqsave(&g_pmm_lock, &node);
+    bool ok = pmm_alloc_pages_locked(st, count, out_pa);
+    mcs_unlock_irqrestore(&g_pmm_lock, &node, flags);
+    return ok;
+}
 
-        for (uint64_t i = i0; i + (uint64_t)count <= i1; i++) {
-            /* Check for a run of `count` free bits. */
-            bool ok = true;
-            for (uint32_t j = 0; j < count; j++) {
-                if (bit_test(st->bitmap, i + (uint64_t)j)) { ok = false; break; }
-            }
-            if (!ok) continue;
+/* Give a detached hot list back to the buddy lists. */
+static void pmm_pcp_give_back(pmm_state_t *st, pmm_pcp_page_t *list) {
+    mcs_node_t node;
+    uint64_t flags = mcs_lock_irqsave(&g_pmm_lock, &node);
+    while (list) {
+        pmm_pcp_page_t *pg = list;
+        list = pg->next;
+        const uint64_t idx = (hh_virt_to_phys((uint64_t)(uintptr_t)pg) - st->base_pa) / PAGE_SIZE;
+        cached_clear(st->cached, idx);
+        bit_clear(st->bitmap, idx);
+        st->free_pages++;
+        pmm_block_free_locked(st, idx, 0);
+    }
+    pmm_update_pressure(st);
+    mcs_unlock_irqrestore(&g_pmm_lock, &node, flags);
+}
 
-            /* Commit: mark all bits reserved. */
-            for (uint32_t j = 0; j < count; j++) {
-                bit_set(st->bitmap, i + (uint64_t)j);
-            }
+/* Detach up to `n` pages from the head of a hot list. Caller holds pcp->lock. */
+static pmm_pcp_page_t *pmm_pcp_detach(pmm_pcp_t *pcp, uint32_t n) {
+    pmm_pcp_page_t *list = pcp->head;
+    pmm_pcp_page_t *last = NULL;
+    pmm_pcp_page_t *pg = list;
+    for (uint32_t i = 0; i < n && pg; i++) {
+        last = pg;
+        pg = pg->next;
+        pcp->count--;
+    }
+    if (!last) return NULL;
+    last->next = NULL;
+    pcp->head = pg;
+    return list;
+}
+
+/* Refill an empty hot list with up to a batch of pages. Caller holds pcp->lock. */
+static void pmm_pcp_refill(pmm_state_t *st, pmm_pcp_t *pcp) {
+    mcs_node_t node;
+    mcs_lock(&g_pmm_lock, &node);
+    for (uint32_t i = 0; i < (uint32_t)CONFIG_PMM_PCP_BATCH; i++) {
+        uint64_t idx = 0;
+        if (!pmm_take_block_locked(st, 0, &idx)) break;
+        bit_set(st->bitmap, idx);
+        st->free_pages--;
+        (void)cached_set(st->cached, idx);
+        pmm_pcp_page_t *pg = (pmm_pcp_page_t *)pmm_block_at(st, idx);
+        pg->next = pcp->head;
+        pcp->head = pg;
+        pcp->count++;
+    }
+    pmm_update_pressure(st);
+    mcs_unlock(&g_pmm_lock, &node);
+}
 
-            st->free_pages -= (uint64_t)count;
-            pmm_update_pressure(st);
-            st->next_hint = i + (uint64_t)count;
-            *out_pa = st->base_pa + (i * PAGE_SIZE);
-            return true;
+/*
+ * Empty every CPU's hot list into the buddy lists, so scattered cached
+ * pages can coalesce again. Returns true if anything was returned.
+ */
+static bool pmm_pcp_drain_all(pmm_state_t *st) {
+    bool any = false;
+    for (uint32_t cpu = 0; cpu < (uint32_t)CONFIG_MAX_CPUS; cpu++) {
+        pmm_pcp_t *pcp = &per_cpu_ptr(cpu)->pmm_pcp;
+        uint64_t flags = spin_lock_irqsave(&pcp->lock);
+        pmm_pcp_page_t *list = pmm_pcp_detach(pcp, pcp->count);
+        spin_unlock_irqrestore(&pcp->lock, flags);
+        if (list) {
+            pmm_pcp_give_back(st, list);
+            any = true;
         }
     }
+    return any;
+}
 
-    return false;
+/*
+ * Out of memory: take back what the caches in front of the PMM hold (per-CPU
+ * pages, cached kernel stacks) so it can coalesce again. Called with no
+ * lock held. Returns true if anything came back.
+ */
+static bool pmm_reclaim(pmm_state_t *st) {
+    const bool drained = pmm_pcp_drain_all(st);
+    return kstack_cache_trim() != 0 || drained;
+}
+
+static bool pmm_pcp_alloc(pmm_state_t *st, uint64_t *out_pa) {
+    uint64_t flags = irq_save();
+    pmm_pcp_t *pcp = &this_cpu_ptr()->pmm_pcp;
+    spin_lock(&pcp->lock);
+    pcp->alloc_calls++;
+    if (!pcp->head) pmm_pcp_refill(st, pcp);
+    pmm_pcp_page_t *pg = pcp->head;
+    if (pg) {
+        pcp->head = pg->next;
+        pcp->count--;
+    }
+    spin_unlock_irqrestore(&pcp->lock, flags);
+
+    if (pg) {
+        *out_pa = hh_virt_to_phys((uint64_t)(uintptr_t)pg);
+        cached_clear(st->cached, (*out_pa - st->base_pa) / PAGE_SIZE);
+        return true;
+    }
+    /* The buddy lists are dry; the last pages may sit in peers' caches. */
+    return pmm_reclaim(st) && pmm_alloc_global(st, 1, out_pa);
+}
+
+static void pmm_pcp_free(pmm_state_t *st, uint64_t idx) {
+    uint64_t flags = irq_save();
+    pmm_pcp_t *pcp = &this_cpu_ptr()->pmm_pcp;
+    spin_lock(&pcp->lock);
+    pcp->free_calls++;
+    pmm_pcp_page_t *pg = (pmm_pcp_page_t *)pmm_block_at(st, idx);
+    pg->next = pcp->head;
+    pcp->head = pg;
+    pcp->count++;
+    pmm_pcp_page_t *excess = NULL;
+    if (pcp->count > (uint32_t)CONFIG_PMM_PCP_HIGH) {
+        excess = pmm_pcp_detach(pcp, pcp->count - (uint32_t)CONFIG_PMM_PCP_LOW);
+    }
+    spin_unlock(&pcp->lock);
+    if (excess) pmm_pcp_give_back(st, excess);
+    irq_restore(flags);
+}
+
+/* Pages sitting in the per-CPU caches (racy snapshot). */
+static uint64_t pmm_pcp_cached(void) {
+    uint64_t n = 0;
+    for (uint32_t cpu = 0; cpu < (uint32_t)CONFIG_MAX_CPUS; cpu++) {
+        n += __atomic_load_n(&per_cpu_ptr(cpu)->pmm_pcp.count, __ATOMIC_RELAXED);
+    }
+    return n;
+}
+
+bool pmm_alloc_pages(uint32_t count, uint64_t *out_pa) {
+    ASSERT_THREAD_CONTEXT();
+    pmm_state_t *st = g_pmm;
+    if (!st || !out_pa || count == 0) return false;
+
+    if (count == 1) return pmm_pcp_alloc(st, out_pa);
+
+    __atomic_fetch_add(&g_pmm_alloc_pages_calls, 1u, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&g_pmm_alloc_contig_calls, 1u, __ATOMIC_RELAXED);
+    if (pmm_alloc_global(st, count, out_pa)) return true;
+    return pmm_reclaim(st) && pmm_alloc_global(st, count, out_pa);
 }
 
 bool pmm_alloc_page(uint64_t *out_pa) {
@@ -387,41 +718,141 @@ bool pmm_alloc_page(uint64_t *out_pa) {
 void *pmm_alloc_page_va(uint64_t *out_pa) {
     
     ASSERT_THREAD_CONTEXT();
-    g_pmm_alloc_calls++;
+    __atomic_fetch_add(&g_pmm_alloc_calls, 1u, __ATOMIC_RELAXED);
 uint64_t pa = 0;
     if (!pmm_alloc_page(&pa)) return (void *)0;
     if (out_pa) *out_pa = pa;
     return (void *)(uintptr_t)phys_to_hh_virt(pa);
 }
 
-void pmm_free_page(uint64_t pa) {
-    
+/* May the page at `idx` be given back? Allocated (not in a CPU's cache),
+ * and not PMM metadata. */
+static inline bool pmm_page_freeable(const pmm_state_t *st, uint64_t idx) {
+    const uint64_t pa = pmm_idx_to_pa(st, idx);
+    if (pa >= st->meta_base_pa && pa < (st->meta_base_pa + st->meta_pages * PAGE_SIZE)) {
+        return false;
+    }
+    if (!bit_test(st->bitmap, idx)) return false;
+    return !cached_test(st->cached, idx);
+}
+
+/*
+ * Free [idx, idx + count) in aligned chunks, each coalesced as a whole.
+ * Pages that are already free (double free) or metadata are skipped.
+ */
+static void pmm_free_range_locked(pmm_state_t *st, uint64_t idx, uint64_t count) {
+    const uint64_t end = idx + count;
+    while (idx < end) {
+        uint32_t order = pmm_fit_order(idx, end);
+        const uint64_t n = 1ULL << order;
+        bool whole = true;
+        for (uint64_t j = 0; j < n; j++) {
+            if (!pmm_page_freeable(st, idx + j)) { whole = false; break; }
+        }
+        if (!whole) {
+            order = 0;
+            if (!pmm_page_freeable(st, idx)) { idx++; continue; }
+        }
+        const uint64_t pages = 1ULL << order;
+        for (uint64_t j = 0; j < pages; j++) {
+            bit_clear(st->bitmap, idx + j);
+        }
+        st->free_pages += pages;
+        pmm_block_free_locked(st, idx, order);
+        idx += pages;
+    }
+    pmm_update_pressure(st);
+}
+
+void pmm_free_pages(uint64_t pa, uint32_t count) {
     ASSERT_THREAD_CONTEXT();
-    g_pmm_free_calls++;
-pmm_state_t *st = g_pmm;
-    if (!st) return;
+    pmm_state_t *st = g_pmm;
+    if (!st || count == 0) return;
 
-    if (pa < st->base_pa || pa >= st->limit_pa) {
+    if ((pa & (PAGE_SIZE - 1ULL)) != 0) {
         return;
     }
-    if ((pa & (PAGE_SIZE - 1ULL)) != 0) {
+    if (pa < st->base_pa || pa >= st->limit_pa ||
+        (uint64_t)count > (st->limit_pa - pa) / PAGE_SIZE) {
         return;
     }
 
-    uint64_t idx = (pa - st->base_pa) / PAGE_SIZE;
-    if (idx >= st->total_pages) return;
+    const uint64_t idx = (pa - st->base_pa) / PAGE_SIZE;
 
-    /* Do not allow freeing metadata pages. */
-    if (pa >= st->meta_base_pa && pa < (st->meta_base_pa + st->meta_pages * PAGE_SIZE)) {
+    /* A single page goes to this CPU's cache. Its bit is stable while we
+     * own the page, so the ownership check needs no lock. */
+    if (count == 1) {
+        if (pa >= st->meta_base_pa && pa < (st->meta_base_pa + st->meta_pages * PAGE_SIZE)) {
+            return;
+        }
+        const uint8_t bits = __atomic_load_n(&st->bitmap[idx >> 3], __ATOMIC_RELAXED);
+        if (((bits >> (idx & 7)) & 1u) == 0) return;
+        /* Claiming the cached bit first makes a racing double free lose. */
+        if (cached_set(st->cached, idx)) return;
+        pmm_pcp_free(st, idx);
         return;
     }
 
-    if (bit_test(st->bitmap, idx)) {
-        bit_clear(st->bitmap, idx);
-        st->free_pages++;
-        pmm_update_pressure(st);
-        if (idx < st->next_hint) st->next_hint = idx;
+    mcs_node_t node;
+    uint64_t flags = mcs_lock_irqsave(&g_pmm_lock, &node);
+    g_pmm_free_calls += (uint64_t)count;
+    pmm_free_range_locked(st, idx, (uint64_t)count);
+    mcs_unlock_irqrestore(&g_pmm_lock, &node, flags);
+}
+
+void pmm_free_page(uint64_t pa) {
+    /* pmm_free_pages enforces thread-context. */
+    pmm_free_pages(pa, 1);
+}
+
+void pmm_selftest(void) {
+#ifdef DEBUG
+    pmm_state_t *st = g_pmm;
+    if (!st) {
+        pmm_panic("selftest: not initialized");
+    }
+
+    /* Every order, plus odd and over-max run lengths. */
+    enum { NR_CASES = PMM_MAX_ORDER + 1u + 3u };
+    uint32_t count[NR_CASES];
+    uint64_t pa[NR_CASES];
+    for (uint32_t o = 0; o <= PMM_MAX_ORDER; o++) count[o] = 1u << o;
+    count[PMM_MAX_ORDER + 1u] = 3u;
+    count[PMM_MAX_ORDER + 2u] = (uint32_t)PMM_MAX_BLOCK_PAGES + 1u;
+    count[PMM_MAX_ORDER + 3u] = 2u * (uint32_t)PMM_MAX_BLOCK_PAGES + 1u;
+
+    /* Start from empty per-CPU caches so the buddy counters are exact. */
+    (void)pmm_pcp_drain_all(st);
+    const uint64_t free0 = st->free_pages;
+    uint64_t nr_free0[PMM_MAX_ORDER + 1];
+    for (uint32_t o = 0; o <= PMM_MAX_ORDER; o++) nr_free0[o] = st->nr_free[o];
+
+    for (uint32_t i = 0; i < NR_CASES; i++) {
+        if (!pmm_alloc_pages(count[i], &pa[i])) pmm_panic("selftest: alloc failed");
+        const uint64_t idx = (pa[i] - st->base_pa) / PAGE_SIZE;
+        uint32_t order = pmm_order_for(count[i]);
+        if (order > PMM_MAX_ORDER) order = PMM_MAX_ORDER;
+        if ((idx & ((1ULL << order) - 1ULL)) != 0) pmm_panic("selftest: misaligned run");
+        for (uint32_t j = 0; j < count[i]; j++) {
+            if (!bit_test(st->bitmap, idx + j)) pmm_panic("selftest: page not marked used");
+        }
+    }
+
+    /* Free the 3-page run page by page, the rest whole. */
+    for (uint32_t i = 0; i < NR_CASES; i++) {
+        if (i == PMM_MAX_ORDER + 1u) {
+            for (uint32_t j = 0; j < count[i]; j++) pmm_free_page(pa[i] + (uint64_t)j * PAGE_SIZE);
+        } else {
+            pmm_free_pages(pa[i], count[i]);
+        }
     }
+
+    (void)pmm_pcp_drain_all(st);
+    if (st->free_pages != free0) pmm_panic("selftest: free page count changed");
+    for (uint32_t o = 0; o <= PMM_MAX_ORDER; o++) {
+        if (st->nr_free[o] != nr_free0[o]) pmm_panic("selftest: free lists did not coalesce");
+    }
+#endif
 }
 
 void pmm_dump_summary(void) {
@@ -433,7 +864,7 @@ void pmm_dump_summary(void) {
 
     /* Always emit a stable, human-readable summary; add details under KMAIN_DEBUG. */
     uart_puts("PMM(free/total): ");
-    uart_putu64_dec(st->free_pages);
+    uart_putu64_dec(st->free_pages + pmm_pcp_cached());
     uart_putc('/');
     uart_putu64_dec(st->total_pages);
     uart_puts("\n");
@@ -443,17 +874,24 @@ void pmm_dump_summary(void) {
     uart_puts(" limit_pa="); uart_puthex64(st->limit_pa);
     uart_puts(" total_pages="); uart_puthex64(st->total_pages);
     uart_puts(" free_pages="); uart_puthex64(st->free_pages);
+    uart_puts(" pcp_cached="); uart_puthex64(pmm_pcp_cached());
     uart_puts(" meta_pa="); uart_puthex64(st->meta_base_pa);
     uart_puts(" meta_pages="); uart_puthex64(st->meta_pages);
     uart_puts(" bitmap_bytes="); uart_puthex64(st->bitmap_bytes);
     uart_puts("\n");
+    uart_puts("PMM: free blocks by order:");
+    for (uint32_t o = 0; o <= PMM_MAX_ORDER; o++) {
+        uart_putc(' ');
+        uart_putu64_dec(st->nr_free[o]);
+    }
+    uart_puts("\n");
 #endif
 }
 
 bool pmm_get_stats(uint64_t *out_free_pages, uint64_t *out_total_pages) {
     pmm_state_t *st = g_pmm;
     if (!st) return false;
-    if (out_free_pages) *out_free_pages = st->free_pages;
+    if (out_free_pages) *out_free_pages = st->free_pages + pmm_pcp_cached();
     if (out_total_pages) *out_total_pages = st->total_pages;
     return true;
 }
@@ -462,14 +900,18 @@ bool pmm_get_stats_ex(pmm_stats_ex_t *out)
 {
     pmm_state_t *st = g_pmm;
     if (!st || !out) return false;
-    out->free_pages = st->free_pages;
+    uint64_t alloc_calls = __atomic_load_n(&g_pmm_alloc_pages_calls, __ATOMIC_RELAXED);
+    uint64_t free_calls = g_pmm_free_calls;
+    for (uint32_t cpu = 0; cpu < (uint32_t)CONFIG_MAX_CPUS; cpu++) {
+        alloc_calls += __atomic_load_n(&per_cpu_ptr(cpu)->pmm_pcp.alloc_calls, __ATOMIC_RELAXED);
+        free_calls += __atomic_load_n(&per_cpu_ptr(cpu)->pmm_pcp.free_calls, __ATOMIC_RELAXED);
+    }
+    out->free_pages = st->free_pages + pmm_pcp_cached();
     out->total_pages = st->total_pages;
     out->low_free_pages_seen = (g_pmm_low_free_pages == UINT64_MAX) ? st->free_pages : g_pmm_low_free_pages;
     out->peak_used_pages_seen = g_pmm_peak_used_pages;
-    out->alloc_pages_calls = g_pmm_alloc_pages_calls;
-    out->alloc_contig_calls = g_pmm_alloc_contig_calls;
-    out->free_page_calls = g_pmm_free_calls;
+    out->alloc_pages_calls = alloc_calls;
+    out->alloc_contig_calls = __atomic_load_n(&g_pmm_alloc_contig_calls, __ATOMIC_RELAXED);
+    out->free_page_calls = free_calls;
     return true;
 }
-
-
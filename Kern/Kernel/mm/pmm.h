@@ -5,40 +5,88 @@
 #include <stdbool.h>
 
 #include "boot_info.h"
+#include "smp/smp.h"
+#include "sync/spinlock.h"
 
 /*
- * Bitmap Physical Memory Manager (PMM)
+ * Buddy Physical Memory Manager (PMM)
  *
  * - 4KiB pages
  * - bitmap bit = 1 => allocated/reserved, 0 => free
- * - bitmap and PMM state are stored in a fixed metadata region placed
- *   immediately after the kernel runtime footprint.
+ * - free pages sit on per-order buddy lists (orders 0..PMM_MAX_ORDER);
+ *   allocation splits and free coalesces in O(PMM_MAX_ORDER) steps
+ * - single pages come from and go to a per-CPU cache, refilled from and
+ *   drained to the buddy lists in batches (CONFIG_PMM_PCP_*); these caches
+ *   and the kernel stack cache are flushed before a failed allocation
+ *   gives up
+ * - manages every DTB RAM bank in the direct-mapped window (platform.h);
+ *   holes between banks stay reserved
+ * - bitmap and PMM state are stored in a metadata region placed
+ *   immediately after the kernel runtime footprint and sized from the
+ *   DTB RAM span; the list links live in the free pages themselves.
  *
  * IMPORTANT: TTBR0 is disabled; all PMM metadata must be reachable via
  * TTBR1 high-half direct map.
  */
 
+/* Largest buddy block: 2^9 pages = 2MiB. */
+#define PMM_MAX_ORDER 9u
+#define PMM_MAX_BLOCK_PAGES (1ULL << PMM_MAX_ORDER)
+
+/*
+ * Per-CPU hot list of single pages (see pmm.c). One instance per CPU, kept
+ * in the per-CPU block (smp/percpu.h).
+ */
+typedef struct pmm_pcp {
+    spinlock_t lock;
+    uint32_t count;
+    struct pmm_pcp_page *head;
+    uint64_t alloc_calls;
+    uint64_t free_calls;
+} __attribute__((aligned(CACHE_LINE))) pmm_pcp_t;
+
 void pmm_init(const boot_info_t *bi);
 
 /* Allocate a single 4KiB physical page. Returns true on success. */
 bool pmm_alloc_page(uint64_t *out_pa);
 
-/* Allocate `count` contiguous 4KiB physical pages. Returns true on success. */
+/*
+ * Allocate `count` contiguous 4KiB physical pages. Returns true on success.
+ * The run is aligned to `count` rounded up to a power of two, capped at
+ * PMM_MAX_BLOCK_PAGES pages.
+ */
 bool pmm_alloc_pages(uint32_t count, uint64_t *out_pa);
 
 /* Free a previously allocated page (must be within PMM window). */
 void pmm_free_page(uint64_t pa);
 
+/*
+ * Free `count` contiguous pages starting at `pa`, coalescing whole blocks
+ * at once. Any split of an allocation may be freed, page by page or in
+ * pieces; already-free pages are ignored.
+ */
+void pmm_free_pages(uint64_t pa, uint32_t count);
+
 /* Optional: allocate a page and return its high-half direct-mapped VA (NULL on OOM). */
 void *pmm_alloc_page_va(uint64_t *out_pa);
 
+/*
+ * Debug-only self test (DEBUG builds): allocates and frees runs of every
+ * order plus odd and over-max lengths, and panics unless the free count
+ * and per-order free lists come back unchanged. Boot CPU only, before SMP.
+ */
+void pmm_selftest(void);
+
 /* Debug: print PMM summary to UART. */
 void pmm_dump_summary(void);
 
 /* Query basic PMM counters (returns false if PMM not initialized). */
 bool pmm_get_stats(uint64_t *out_free_pages, uint64_t *out_total_pages);
 
-/* Extended PMM stats for bring-up/hardening. */
+/*
+ * Extended PMM stats for bring-up/hardening. free_pages includes pages in
+ * the per-CPU caches; the watermarks count them as used.
+ */
 typedef struct pmm_stats_ex {
     uint64_t free_pages;
     uint64_t total_pages;
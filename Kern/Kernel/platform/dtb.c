@@ -10,6 +10,8 @@
  *  - parse memreserve map
  *  - parse /memory reg
  *  - find first node with compatible containing "arm,pl011" and read reg[0].addr
+ *  - parse /cpus/cpu@N reg (MPIDR), capacity-dmips-mhz and cpu-map clusters,
+ *    and the /psci conduit
  *
  * This is intentionally tiny and allocation-free for early boot.
  */
@@ -53,6 +55,11 @@ static uint32_t    g_mem_count;
 static dtb_range_t g_rsv_ranges[DTB_MAX_RESERVED_RANGES];
 static uint32_t    g_rsv_count;
 
+static dtb_cpu_t   g_cpus[DTB_MAX_CPUS];
+static uint32_t    g_cpu_phandle[DTB_MAX_CPUS];
+static uint32_t    g_cpu_count;
+static dtb_psci_method_t g_psci_method;
+
 static bool g_parsed;
 
 static void ensure_parsed(void);
@@ -835,13 +842,227 @@ static void collect_reserved_memory_ranges(void) {
     }
 }
 
+static bool node_name_is(const char *name, const char *base) {
+    /* "base" or "base@unit". */
+    uint32_t i = 0;
+    while (base[i] != '\0') {
+        if (name[i] != base[i]) return false;
+        i++;
+    }
+    return name[i] == '\0' || name[i] == '@';
+}
+
+static bool node_name_is_prefix(const char *name, const char *prefix) {
+    /* "prefix", "prefixN", ... (cpu-map: cluster0, core1). */
+    for (uint32_t i = 0; prefix[i] != '\0'; i++) {
+        if (name[i] != prefix[i]) return false;
+    }
+    return true;
+}
+
+/*
+ * /cpus/cpu-map lists CPUs by phandle under cluster (and core/thread)
+ * nodes, which may nest. A CPU belongs to its innermost cluster; clusters
+ * are renumbered densely in CPU order once every phandle is known.
+ */
+#define CPU_MAP_MAX (2u * DTB_MAX_CPUS)
+
+typedef struct cpu_map_entry {
+    uint32_t phandle;
+    uint32_t cluster;   /* raw: order of the cluster node in cpu-map */
+} cpu_map_entry_t;
+
+static void resolve_cpu_map(const cpu_map_entry_t *map, uint32_t n) {
+    uint32_t raw[DTB_MAX_CPUS];
+    uint32_t nraw = 0;
+    for (uint32_t i = 0; i < g_cpu_count; i++) {
+        g_cpus[i].cluster = DTB_CLUSTER_NONE;
+        if (g_cpu_phandle[i] == 0) continue;
+        uint32_t r = DTB_CLUSTER_NONE;
+        for (uint32_t j = 0; j < n; j++) {
+            if (map[j].phandle == g_cpu_phandle[i]) { r = map[j].cluster; break; }
+        }
+        if (r == DTB_CLUSTER_NONE) continue;
+        uint32_t k = 0;
+        while (k < nraw && raw[k] != r) k++;
+        if (k == nraw) raw[nraw++] = r;
+        g_cpus[i].cluster = k;
+    }
+}
+
+/*
+ * /cpus/cpu@N: reg is the MPIDR affinity (#size-cells = 0 under /cpus, so
+ * parse_reg_all() does not apply), plus capacity-dmips-mhz and the phandle
+ * cpu-map refers to. /psci: "method" selects HVC or SMC.
+ */
+static void collect_cpus_and_psci(void) {
+    if (!g_struct || !g_strings) return;
+
+    node_ctx_t stack[MAX_DEPTH];
+    int depth = -1;
+    const uint8_t *p = g_struct;
+    bool in_cpus = false;
+    bool in_psci = false;
+    bool cpu_node = false;
+    bool cpu_has_reg = false;
+    bool cpu_disabled = false;
+    uint64_t cpu_mpidr = 0;
+    uint32_t cpu_capacity = 0;
+    uint32_t cpu_phandle = 0;
+    bool in_cpu_map = false;
+    uint32_t cluster_at[MAX_DEPTH];
+    uint32_t nclusters = 0;
+    cpu_map_entry_t map[CPU_MAP_MAX];
+    uint32_t nmap = 0;
+
+    while (true) {
+        uint32_t token = be32(p); p += 4;
+        if (token == FDT_END) break;
+
+        if (token == FDT_BEGIN_NODE) {
+            const char *name = (const char *)p;
+            size_t nlen = 0;
+            while (p[nlen] != '\0') nlen++;
+            p += (nlen + 1);
+            p = align4(p);
+
+            depth++;
+            if (depth >= MAX_DEPTH) {
+                return;
+            }
+
+            node_ctx_t *ctx = &stack[depth];
+            uint32_t parent_addr = (depth == 0) ? 2 : stack[depth - 1].addr_cells;
+            uint32_t parent_size = (depth == 0) ? 2 : stack[depth - 1].size_cells;
+            ctx->parent_addr_cells = parent_addr;
+            ctx->parent_size_cells = parent_size;
+            ctx->addr_cells = parent_addr;
+            ctx->size_cells = parent_size;
+            ctx->is_memory = false;
+            ctx->is_uart_candidate = false;
+
+            if (depth == 1) {
+                in_cpus = streq(name, "cpus");
+                in_psci = node_name_is(name, "psci");
+            } else if (depth == 2 && in_cpus && node_name_is(name, "cpu")) {
+                cpu_node = true;
+                cpu_has_reg = false;
+                cpu_disabled = false;
+                cpu_mpidr = 0;
+                cpu_capacity = 0;
+                cpu_phandle = 0;
+            } else if (depth == 2 && in_cpus && streq(name, "cpu-map")) {
+                in_cpu_map = true;
+                cluster_at[depth] = DTB_CLUSTER_NONE;
+            } else if (depth > 2 && in_cpu_map) {
+                cluster_at[depth] = node_name_is_prefix(name, "cluster")
+                                        ? nclusters++ : cluster_at[depth - 1];
+            }
+            continue;
+        }
+
+        if (token == FDT_END_NODE) {
+            if (depth == 2 && cpu_node) {
+                if (cpu_has_reg && !cpu_disabled && g_cpu_count < DTB_MAX_CPUS) {
+                    g_cpus[g_cpu_count].mpidr = cpu_mpidr;
+                    g_cpus[g_cpu_count].capacity = cpu_capacity;
+                    g_cpus[g_cpu_count].cluster = DTB_CLUSTER_NONE;
+                    g_cpu_phandle[g_cpu_count] = cpu_phandle;
+                    g_cpu_count++;
+                }
+                cpu_node = false;
+            }
+            if (depth == 2) {
+                in_cpu_map = false;
+            }
+            if (depth == 1) {
+                in_cpus = false;
+                in_psci = false;
+            }
+            depth--;
+            continue;
+        }
+
+        if (token == FDT_NOP) continue;
+
+        if (token == FDT_PROP) {
+            uint32_t len = be32(p); p += 4;
+            uint32_t nameoff = be32(p); p += 4;
+            const uint8_t *data = p;
+            p += len;
+            p = align4(p);
+            if (depth < 0) continue;
+
+            const char *pname = str_at(nameoff);
+            node_ctx_t *ctx = &stack[depth];
+
+            if (streq(pname, "#address-cells")) {
+                if (len >= 4) ctx->addr_cells = be32(data);
+                continue;
+            }
+            if (streq(pname, "#size-cells")) {
+                if (len >= 4) ctx->size_cells = be32(data);
+                continue;
+            }
+
+            if (depth == 2 && cpu_node) {
+                if (streq(pname, "reg")) {
+                    uint32_t cells = ctx->parent_addr_cells;
+                    if (cells >= 1 && cells <= 2 && len >= 4u * cells) {
+                        uint64_t v = 0;
+                        for (uint32_t i = 0; i < cells; i++) {
+                            v = (v << 32) | (uint64_t)be32(data + 4u * i);
+                        }
+                        cpu_mpidr = v;
+                        cpu_has_reg = true;
+                    }
+                } else if (streq(pname, "status")) {
+                    cpu_disabled = !(streq((const char *)data, "okay") ||
+                                     streq((const char *)data, "ok"));
+                } else if (streq(pname, "capacity-dmips-mhz")) {
+                    if (len >= 4) cpu_capacity = be32(data);
+                } else if (streq(pname, "phandle") || streq(pname, "linux,phandle")) {
+                    if (len >= 4) cpu_phandle = be32(data);
+                }
+                continue;
+            }
+
+            if (depth > 2 && in_cpu_map && streq(pname, "cpu")) {
+                if (len >= 4 && cluster_at[depth] != DTB_CLUSTER_NONE && nmap < CPU_MAP_MAX) {
+                    map[nmap].phandle = be32(data);
+                    map[nmap].cluster = cluster_at[depth];
+                    nmap++;
+                }
+                continue;
+            }
+
+            if (depth == 1 && in_psci && streq(pname, "method")) {
+                if (streq((const char *)data, "hvc")) {
+                    g_psci_method = DTB_PSCI_HVC;
+                } else if (streq((const char *)data, "smc")) {
+                    g_psci_method = DTB_PSCI_SMC;
+                }
+                continue;
+            }
+            continue;
+        }
+
+        break;
+    }
+
+    resolve_cpu_map(map, nmap);
+}
+
 static void ensure_parsed(void) {
     if (g_parsed) return;
     g_mem_count = 0;
     g_rsv_count = 0;
+    g_cpu_count = 0;
+    g_psci_method = DTB_PSCI_NONE;
     collect_memreserve_ranges();
     collect_reserved_memory_ranges();
     collect_memory_ranges();
+    collect_cpus_and_psci();
     g_parsed = true;
 }
 
@@ -870,6 +1091,23 @@ bool dtb_get_reserved_ranges(dtb_range_t out[], uint32_t *inout_count) {
     return true;
 }
 
+bool dtb_get_cpus(dtb_cpu_t out[], uint32_t *inout_count) {
+    if (!inout_count) return false;
+    ensure_parsed();
+
+    uint32_t cap = *inout_count;
+    uint32_t n = g_cpu_count;
+    if (cap < n) n = cap;
+    for (uint32_t i = 0; i < n; i++) out[i] = g_cpus[i];
+    *inout_count = n;
+    return (g_cpu_count != 0);
+}
+
+dtb_psci_method_t dtb_get_psci_method(void) {
+    ensure_parsed();
+    return g_psci_method;
+}
+
 uint32_t dtb_get_totalsize(void) {
     ensure_parsed();
     return g_fdt_totalsize;
@@ -46,6 +46,35 @@ typedef struct dtb_range {
 bool dtb_get_memory_ranges(dtb_range_t *out, uint32_t *count);
 bool dtb_get_reserved_ranges(dtb_range_t *out, uint32_t *count);
 
+#ifndef DTB_MAX_CPUS
+#define DTB_MAX_CPUS 8
+#endif
+
+/* dtb_cpu_t.cluster of a CPU that no /cpus/cpu-map cluster lists. */
+#define DTB_CLUSTER_NONE 0xFFFFFFFFu
+
+/* One enabled /cpus/cpu@N node. */
+typedef struct dtb_cpu {
+    uint64_t mpidr;     /* reg: MPIDR_EL1 affinity bits */
+    uint32_t capacity;  /* capacity-dmips-mhz, 0 if absent */
+    uint32_t cluster;   /* cpu-map cluster, numbered 0.. in CPU order */
+} dtb_cpu_t;
+
+/*
+ * Enabled CPUs in DTB order (same capacity-in/count-out convention as the
+ * range getters). Returns false if /cpus is missing or has no cpu nodes.
+ */
+bool dtb_get_cpus(dtb_cpu_t *out, uint32_t *count);
+
+/* PSCI conduit from /psci "method". */
+typedef enum dtb_psci_method {
+    DTB_PSCI_NONE = 0,
+    DTB_PSCI_HVC,
+    DTB_PSCI_SMC,
+} dtb_psci_method_t;
+
+dtb_psci_method_t dtb_get_psci_method(void);
+
 /* Return DTB header totalsize (bytes). Returns 0 if DTB is not initialized. */
 uint32_t dtb_get_totalsize(void);
 
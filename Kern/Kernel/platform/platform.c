@@ -7,16 +7,13 @@
 #define PLATFORM_MAX_RANGES  64
 
 /* QEMU virt baseline RAM starts at 0x4000_0000. */
-#define RAM_BASE 0x40000000ULL
-
-/* TTBR1 direct-map window size (must match mmu.c). */
-#define RAM_DIRECTMAP_SIZE 0x40000000ULL /* 1 GiB */
+#define RAM_BASE PLATFORM_RAM_BASE
 
 /* High-half direct map base for RAM_BASE. Must match boot + mmu.c. */
 #define HH_PHYS_4000_BASE 0xFFFF800040000000ULL
 
-/* Fixed PMM metadata reservation (pages) immediately after kernel runtime end. */
-#define PMM_METADATA_PAGES 16ULL
+/* RAM span assumed when the DTB lists no memory (the boot-mapped GiB). */
+#define RAM_FALLBACK_SIZE 0x40000000ULL
 
 /* Linker-provided end of kernel .bss (kernel runtime footprint end). */
 extern uint8_t __kernel_runtime_end[];
@@ -138,6 +135,40 @@ static void print_ranges(const char *title, const dtb_range_t *r, uint32_t n) {
     }
 }
 
+bool platform_get_ram_span(uint64_t *out_start, uint64_t *out_end) {
+    dtb_range_t mem[PLATFORM_MAX_RANGES];
+    uint32_t mem_n = PLATFORM_MAX_RANGES;
+    if (!dtb_get_memory_ranges(mem, &mem_n)) return false;
+
+    uint64_t lo = UINT64_MAX;
+    uint64_t hi = 0;
+    for (uint32_t i = 0; i < mem_n; i++) {
+        uint64_t start = align_up_4k(mem[i].base);
+        uint64_t end = align_down_4k(mem[i].base + mem[i].size);
+        if (start < RAM_BASE) start = RAM_BASE;
+        if (end > PLATFORM_RAM_WINDOW_END) end = PLATFORM_RAM_WINDOW_END;
+        if (end <= start) continue;
+        if (start < lo) lo = start;
+        if (end > hi) hi = end;
+    }
+    if (hi == 0) return false;
+    if (out_start) *out_start = lo;
+    if (out_end) *out_end = hi;
+    return true;
+}
+
+uint64_t platform_pmm_metadata_pages(void) {
+    uint64_t start = RAM_BASE;
+    uint64_t end = RAM_BASE + RAM_FALLBACK_SIZE;
+    (void)platform_get_ram_span(&start, &end);
+
+    /* Two bitmaps (ownership, per-CPU cache membership) with one bit per
+     * page of the span, plus a page for the PMM state and one of slack for
+     * the PMM aligning its base down to a buddy block. */
+    const uint64_t bitmap_bytes = ((end - start) / PAGE_SIZE + 7ULL) / 8ULL;
+    return (2ULL * bitmap_bytes + PAGE_SIZE - 1ULL) / PAGE_SIZE + 2ULL;
+}
+
 bool platform_get_usable_ranges(const boot_info_t *boot_info, dtb_range_t out[], uint32_t *inout_count) {
     if (!out || !inout_count) return false;
 
@@ -155,7 +186,7 @@ bool platform_get_usable_ranges(const boot_info_t *boot_info, dtb_range_t out[],
         uint64_t end = align_down_4k(mem[i].base + mem[i].size);
         /* Clamp to the direct-mapped RAM window (TTBR1). */
         uint64_t win_start = RAM_BASE;
-        uint64_t win_end = RAM_BASE + RAM_DIRECTMAP_SIZE;
+        uint64_t win_end = PLATFORM_RAM_WINDOW_END;
         if (start < win_start) start = win_start;
         if (end > win_end) end = win_end;
         if (end <= start) continue;
@@ -183,7 +214,7 @@ bool platform_get_usable_ranges(const boot_info_t *boot_info, dtb_range_t out[],
         uint64_t end = align_up_4k(rsv[i].base + rsv[i].size);
         /* Clamp to the direct-mapped RAM window (TTBR1). */
         uint64_t win_start = RAM_BASE;
-        uint64_t win_end = RAM_BASE + RAM_DIRECTMAP_SIZE;
+        uint64_t win_end = PLATFORM_RAM_WINDOW_END;
         if (start < win_start) start = win_start;
         if (end > win_end) end = win_end;
         if (end <= start) continue;
@@ -198,7 +229,7 @@ bool platform_get_usable_ranges(const boot_info_t *boot_info, dtb_range_t out[],
             uint64_t end = align_up_4k(boot_info->kernel_phys_base);
             /* Clamp to the direct-mapped RAM window (TTBR1). */
             uint64_t win_start = RAM_BASE;
-            uint64_t win_end = RAM_BASE + RAM_DIRECTMAP_SIZE;
+            uint64_t win_end = PLATFORM_RAM_WINDOW_END;
             if (start < win_start) start = win_start;
             if (end > win_end) end = win_end;
             if (end > start && all_rsv_n < (uint32_t)(sizeof(all_rsv) / sizeof(all_rsv[0]))) {
@@ -213,7 +244,7 @@ bool platform_get_usable_ranges(const boot_info_t *boot_info, dtb_range_t out[],
             uint64_t end = align_up_4k(runtime_end_pa);
             /* Clamp to the direct-mapped RAM window (TTBR1). */
             uint64_t win_start = RAM_BASE;
-            uint64_t win_end = RAM_BASE + RAM_DIRECTMAP_SIZE;
+            uint64_t win_end = PLATFORM_RAM_WINDOW_END;
             if (start < win_start) start = win_start;
             if (end > win_end) end = win_end;
             if (end > start && all_rsv_n < (uint32_t)(sizeof(all_rsv) / sizeof(all_rsv[0]))) {
@@ -226,9 +257,9 @@ bool platform_get_usable_ranges(const boot_info_t *boot_info, dtb_range_t out[],
         {
             uint64_t runtime_end_pa = hh_virt_to_phys((uint64_t)__kernel_runtime_end);
             uint64_t start = align_up_4k(runtime_end_pa);
-            uint64_t end = start + (PMM_METADATA_PAGES * PAGE_SIZE);
+            uint64_t end = start + (platform_pmm_metadata_pages() * PAGE_SIZE);
             /* Clamp to the TTBR1 direct-map window. */
-            uint64_t window_end = RAM_BASE + RAM_DIRECTMAP_SIZE;
+            uint64_t window_end = PLATFORM_RAM_WINDOW_END;
             if (start < window_end) {
                 if (end > window_end) end = window_end;
                 if (end > start && all_rsv_n < (uint32_t)(sizeof(all_rsv) / sizeof(all_rsv[0]))) {
@@ -251,7 +282,7 @@ bool platform_get_usable_ranges(const boot_info_t *boot_info, dtb_range_t out[],
             uint64_t end = align_up_4k(dtb_phys + dtb_sz);
             /* Clamp to the direct-mapped RAM window (TTBR1). */
             uint64_t win_start = RAM_BASE;
-            uint64_t win_end = RAM_BASE + RAM_DIRECTMAP_SIZE;
+            uint64_t win_end = PLATFORM_RAM_WINDOW_END;
             if (start < win_start) start = win_start;
             if (end > win_end) end = win_end;
             if (end > start && all_rsv_n < (uint32_t)(sizeof(all_rsv) / sizeof(all_rsv[0]))) {
@@ -275,7 +306,7 @@ all_rsv_n = normalize_merge(all_rsv, all_rsv_n);
         uint64_t end = align_down_4k(out[i].base + out[i].size);
         /* Clamp defensively to the direct-mapped RAM window (TTBR1). */
         uint64_t win_start = RAM_BASE;
-        uint64_t win_end = RAM_BASE + RAM_DIRECTMAP_SIZE;
+        uint64_t win_end = PLATFORM_RAM_WINDOW_END;
         if (start < win_start) start = win_start;
         if (end > win_end) end = win_end;
         if (end <= start) continue;
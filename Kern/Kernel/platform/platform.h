@@ -7,6 +7,30 @@
 #include "boot_info.h"
 #include "dtb.h"
 
+/*
+ * Physical RAM the kernel direct-maps through TTBR1 (VA = 0xFFFF800000000000
+ * + PA): [PLATFORM_RAM_BASE, PLATFORM_RAM_WINDOW_END). mmu.c maps every DTB
+ * /memory bank inside it with one L2 table per GiB; RAM outside it is
+ * ignored.
+ */
+#define PLATFORM_RAM_BASE       0x40000000ULL
+#define PLATFORM_RAM_WINDOW_GIB 128ULL
+#define PLATFORM_RAM_WINDOW_END (PLATFORM_RAM_BASE + (PLATFORM_RAM_WINDOW_GIB << 30))
+
+/*
+ * Page-aligned span [*out_start, *out_end) of the DTB memory banks inside
+ * the RAM window, holes between banks included. Returns false if the DTB
+ * lists no RAM there.
+ */
+bool platform_get_ram_span(uint64_t *out_start, uint64_t *out_end);
+
+/*
+ * Pages reserved immediately after the kernel runtime footprint for the
+ * PMM state and bitmaps, sized for the RAM span (falls back to a 1 GiB
+ * span without DTB memory ranges).
+ */
+uint64_t platform_pmm_metadata_pages(void);
+
 /*
  * Derive usable physical memory ranges:
  *   usable = dtb /memory ranges - (DTB reserved ranges) - (implicit reservations)
@@ -14,7 +38,11 @@
  * Implicit reservations include:
  *   - boot stage image + boot tables (RAM_BASE .. kernel_phys_base)
  *   - kernel image
+ *   - PMM metadata (platform_pmm_metadata_pages())
  *   - DTB blob itself
+ *
+ * Ranges are clamped to the direct-mapped RAM window; several banks with
+ * holes between them come out as separate ranges.
  */
 bool platform_get_usable_ranges(const boot_info_t *boot_info,
                                 dtb_range_t *out, uint32_t *inout_count);
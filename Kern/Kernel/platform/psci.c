@@ -0,0 +1,51 @@
+#include "psci.h"
+
+#include "dtb.h"
+
+static dtb_psci_method_t s_method = DTB_PSCI_NONE;
+
+static uint64_t psci_call(uint64_t fn, uint64_t a1, uint64_t a2, uint64_t a3)
+{
+    register uint64_t x0 __asm__("x0") = fn;
+    register uint64_t x1 __asm__("x1") = a1;
+    register uint64_t x2 __asm__("x2") = a2;
+    register uint64_t x3 __asm__("x3") = a3;
+
+    /* SMCCC: x0-x17 may be clobbered by the callee; x0 carries the result. */
+    if (s_method == DTB_PSCI_HVC) {
+        __asm__ volatile("hvc #0"
+                         : "+r"(x0), "+r"(x1), "+r"(x2), "+r"(x3)
+                         :
+                         : "x4", "x5", "x6", "x7", "x8", "x9", "x10", "x11",
+                           "x12", "x13", "x14", "x15", "x16", "x17", "memory");
+    } else {
+        __asm__ volatile("smc #0"
+                         : "+r"(x0), "+r"(x1), "+r"(x2), "+r"(x3)
+                         :
+                         : "x4", "x5", "x6", "x7", "x8", "x9", "x10", "x11",
+                           "x12", "x13", "x14", "x15", "x16", "x17", "memory");
+    }
+    return x0;
+}
+
+bool psci_init(void)
+{
+    s_method = dtb_get_psci_method();
+    return s_method != DTB_PSCI_NONE;
+}
+
+uint32_t psci_version(void)
+{
+    if (s_method == DTB_PSCI_NONE) {
+        return 0;
+    }
+    return (uint32_t)psci_call(PSCI_0_2_FN_PSCI_VERSION, 0, 0, 0);
+}
+
+int32_t psci_cpu_on(uint64_t mpidr, uint64_t entry_pa, uint64_t context_id)
+{
+    if (s_method == DTB_PSCI_NONE) {
+        return PSCI_NOT_SUPPORTED;
+    }
+    return (int32_t)psci_call(PSCI_0_2_FN64_CPU_ON, mpidr, entry_pa, context_id);
+}
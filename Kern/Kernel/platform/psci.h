@@ -0,0 +1,44 @@
+#ifndef PSCI_H
+#define PSCI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * PSCI 0.2+ client (SMC Calling Convention, 64-bit function IDs).
+ *
+ * The conduit (HVC vs SMC) comes from the DTB /psci node; QEMU virt without
+ * EL2/EL3 firmware uses HVC handled by QEMU itself.
+ */
+
+#define PSCI_0_2_FN_PSCI_VERSION  0x84000000u
+#define PSCI_0_2_FN64_CPU_ON      0xC4000003u
+
+/* PSCI return codes. */
+enum {
+    PSCI_SUCCESS            = 0,
+    PSCI_NOT_SUPPORTED      = -1,
+    PSCI_INVALID_PARAMETERS = -2,
+    PSCI_DENIED             = -3,
+    PSCI_ALREADY_ON         = -4,
+    PSCI_ON_PENDING         = -5,
+    PSCI_INTERNAL_FAILURE   = -6,
+    PSCI_NOT_PRESENT        = -7,
+    PSCI_DISABLED           = -8,
+    PSCI_INVALID_ADDRESS    = -9,
+};
+
+/* Select the conduit from the DTB. Returns false if no PSCI node exists. */
+bool psci_init(void);
+
+/* Returns PSCI_VERSION (major << 16 | minor), or 0 if PSCI is unavailable. */
+uint32_t psci_version(void);
+
+/*
+ * Power on the CPU with the given MPIDR affinity. It starts at physical
+ * address entry_pa with the MMU off, in the caller's exception level, and with
+ * x0 = context_id.
+ */
+int32_t psci_cpu_on(uint64_t mpidr, uint64_t entry_pa, uint64_t context_id);
+
+#endif /* PSCI_H */
@@ -0,0 +1,181 @@
+// OS/Kern/Kernel/sched/bandwidth.c
+//
+// Per-task CPU bandwidth control (see bandwidth.h).
+//
+// Periods advance lazily: a charge that finds the current period over
+// starts a new one with a full quota. Only the refill timer ends a
+// throttled period, since it must also requeue the parked threads. Lock
+// order: run queue, then bandwidth lock, then timer wheel; the refill drops
+// the bandwidth lock before requeueing.
+
+#include "sched/bandwidth.h"
+
+#include <stddef.h>
+
+#include "config.h"
+#include "contracts.h"
+#include "irq.h"
+#include "sched/sched.h"
+#include "sched/thread.h"
+#include "task/task.h"
+#include "timer_generic.h"
+
+static inline uint64_t us_to_ticks(uint32_t us) {
+    return ((uint64_t)us * time_freq()) / 1000000u;
+}
+
+// Move the period on so that it contains `now`. Caller holds bw->lock.
+static void bw_advance(task_bw_t *bw, uint64_t now) {
+    if (now < bw->period_end) {
+        return;
+    }
+    const uint64_t missed = (now - bw->period_end) / bw->period;
+    bw->period_end += (missed + 1u) * bw->period;
+    bw->runtime = bw->quota;
+}
+
+static void bw_requeue(struct thread *list) {
+    while (list) {
+        thread_t *t = list;
+        list = t->rq_next;
+        t->rq_next = NULL;
+        sched_bw_unpark(t);
+    }
+}
+
+static void bw_refill_fn(void *arg) {
+    task_bw_t *bw = (task_bw_t *)arg;
+    const uint64_t now = time_now();
+
+    spin_lock(&bw->lock);
+    thread_t *list = NULL;
+    if (bw->throttled) {
+        bw->throttled_time += now - bw->throttle_stamp;
+        __atomic_store_n(&bw->throttled, false, __ATOMIC_RELAXED);
+        bw_advance(bw, now);
+        list = bw->parked;
+        bw->parked = NULL;
+    }
+    spin_unlock(&bw->lock);
+
+    bw_requeue(list);
+}
+
+void task_bw_init(task_bw_t *bw) {
+    spin_init(&bw->lock);
+    bw->quota = 0;
+    bw->period = 0;
+    bw->runtime = 0;
+    bw->period_end = 0;
+    bw->throttled = false;
+    bw->parked = NULL;
+    ktimer_init(&bw->refill, bw_refill_fn, bw);
+    bw->usage = 0;
+    bw->throttled_time = 0;
+    bw->throttle_stamp = 0;
+    bw->nr_throttled = 0;
+}
+
+bool task_set_cpu_bandwidth(task_t *task, uint32_t quota_us, uint32_t period_us) {
+    ASSERT_THREAD_CONTEXT();
+    if (!task) {
+        return false;
+    }
+    task_bw_t *bw = &task->bw;
+
+    if (quota_us == 0) {
+        uint64_t flags = spin_lock_irqsave(&bw->lock);
+        __atomic_store_n(&bw->quota, 0, __ATOMIC_RELAXED);
+        if (bw->throttled) {
+            bw->throttled_time += time_now() - bw->throttle_stamp;
+            __atomic_store_n(&bw->throttled, false, __ATOMIC_RELAXED);
+        }
+        thread_t *list = bw->parked;
+        bw->parked = NULL;
+        spin_unlock_irqrestore(&bw->lock, flags);
+        // Not under the lock: cancel waits for a running refill, which
+        // takes it.
+        (void)ktimer_cancel(&bw->refill);
+        bw_requeue(list);
+        return true;
+    }
+
+    if (period_us < TASK_BW_PERIOD_MIN_US || period_us > TASK_BW_PERIOD_MAX_US ||
+        (uint64_t)quota_us > (uint64_t)period_us * CONFIG_MAX_CPUS) {
+        return false;
+    }
+    const uint64_t quota = us_to_ticks(quota_us);
+    const uint64_t period = us_to_ticks(period_us);
+    if (quota == 0 || period == 0) {
+        return false;
+    }
+
+    uint64_t flags = spin_lock_irqsave(&bw->lock);
+    bw->period = period;
+    __atomic_store_n(&bw->quota, quota, __ATOMIC_RELAXED);
+    // A throttled task keeps waiting for its pending refill, which then
+    // applies the new quota.
+    if (!bw->throttled) {
+        bw->runtime = quota;
+        bw->period_end = time_now() + period;
+    }
+    spin_unlock_irqrestore(&bw->lock, flags);
+    return true;
+}
+
+bool task_get_cpu_stats(task_t *task, task_cpu_stats_t *out) {
+    if (!task || !out) {
+        return false;
+    }
+    task_bw_t *bw = &task->bw;
+    uint64_t flags = spin_lock_irqsave(&bw->lock);
+    out->usage = __atomic_load_n(&bw->usage, __ATOMIC_RELAXED);
+    out->throttled_time = bw->throttled_time;
+    if (bw->throttled) {
+        out->throttled_time += time_now() - bw->throttle_stamp;
+    }
+    out->nr_throttled = bw->nr_throttled;
+    spin_unlock_irqrestore(&bw->lock, flags);
+    return true;
+}
+
+bool task_bw_charge(task_bw_t *bw, uint64_t used, uint64_t now) {
+    __atomic_fetch_add(&bw->usage, used, __ATOMIC_RELAXED);
+    // Unlimited tasks only keep the usage count, without the lock.
+    if (__atomic_load_n(&bw->quota, __ATOMIC_RELAXED) == 0) {
+        return false;
+    }
+
+    spin_lock(&bw->lock);
+    if (bw->quota == 0 || bw->throttled) {
+        const bool throttled = bw->throttled;
+        spin_unlock(&bw->lock);
+        return throttled;
+    }
+    bw_advance(bw, now);
+    if (used < bw->runtime) {
+        bw->runtime -= used;
+        spin_unlock(&bw->lock);
+        return false;
+    }
+
+    // Out of quota: hold the task's threads back until the period ends.
+    bw->runtime = 0;
+    __atomic_store_n(&bw->throttled, true, __ATOMIC_RELAXED);
+    bw->throttle_stamp = now;
+    bw->nr_throttled++;
+    (void)ktimer_arm(&bw->refill, bw->period_end);
+    spin_unlock(&bw->lock);
+    return true;
+}
+
+bool task_bw_park(task_bw_t *bw, struct thread *t) {
+    spin_lock(&bw->lock);
+    const bool parked = bw->throttled;
+    if (parked) {
+        t->rq_next = bw->parked;
+        bw->parked = t;
+    }
+    spin_unlock(&bw->lock);
+    return parked;
+}
@@ -0,0 +1,81 @@
+// OS/Kern/Kernel/sched/bandwidth.h
+//
+// Per-task CPU bandwidth control.
+//
+// A task may be given a quota of CPU time per period, shared by all of its
+// threads on all CPUs. The scheduler charges a running thread from the
+// counter at every switch-out and tick. Once the period's quota is used up
+// the task is throttled: its running threads give way at the next tick (at
+// their next yield() when cooperative), and its threads are parked instead
+// of run when picked. A kernel timer armed for the end of the period
+// refills the quota and requeues the parked threads.
+//
+// Deadline-class threads are exempt (their own budget bounds them), as are
+// threads without a task.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sync/spinlock.h"
+#include "timer/timer_wheel.h"
+
+struct thread;
+struct task;
+
+// Period bounds; the refill timer's granule (CONFIG_KTIMER_GRANULE_US)
+// should stay well below the period.
+#define TASK_BW_PERIOD_MIN_US 1000u
+#define TASK_BW_PERIOD_MAX_US 1000000u
+
+typedef struct task_bw {
+    spinlock_t lock;           // guards everything below
+    uint64_t   quota;          // CPU time per period (counter ticks); 0: unlimited
+    uint64_t   period;
+    uint64_t   runtime;        // quota left in the current period
+    uint64_t   period_end;     // counter value the current period ends at
+    bool       throttled;      // quota used up; cleared only by the refill
+    struct thread *parked;     // held-back READY threads, chained by rq_next
+    ktimer_t   refill;
+    // Accounting (task_get_cpu_stats()); usage is kept without the lock.
+    uint64_t   usage;
+    uint64_t   throttled_time;
+    uint64_t   throttle_stamp;
+    uint64_t   nr_throttled;
+} task_bw_t;
+
+// Task CPU accounting, in counter ticks.
+typedef struct task_cpu_stats {
+    uint64_t usage;            // CPU time charged to the task's threads
+    uint64_t throttled_time;   // time spent throttled
+    uint64_t nr_throttled;     // periods in which the quota ran out
+} task_cpu_stats_t;
+
+void task_bw_init(task_bw_t *bw);
+
+// Limit `task` to `quota_us` of CPU time in every `period_us`
+// (TASK_BW_PERIOD_MIN_US..MAX_US). The quota may exceed the period, up to
+// one period per CPU, for tasks running on several CPUs at once.
+// quota_us == 0 lifts the limit and releases any parked threads. Thread
+// context. Returns false for invalid parameters.
+bool task_set_cpu_bandwidth(struct task *task, uint32_t quota_us, uint32_t period_us);
+
+// Snapshot the task's CPU accounting. Any context. Returns false for a NULL
+// argument.
+bool task_get_cpu_stats(struct task *task, task_cpu_stats_t *out);
+
+static inline bool task_bw_throttled(const task_bw_t *bw) {
+    return __atomic_load_n(&bw->throttled, __ATOMIC_RELAXED);
+}
+
+// Scheduler hooks (sched.c), IRQs masked.
+
+// Charge `used` ticks of CPU time, ending at `now`. Returns true if the
+// task is throttled afterwards.
+bool task_bw_charge(task_bw_t *bw, uint64_t used, uint64_t now);
+
+// Hold READY, unqueued `t` back until the refill. Returns false (and leaves
+// t alone) if the task is no longer throttled. Caller may hold a run-queue
+// lock (run queue before bandwidth lock).
+bool task_bw_park(task_bw_t *bw, struct thread *t);
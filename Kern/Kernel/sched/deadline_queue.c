@@ -1,20 +1,79 @@
 #include "deadline_queue.h"
 
-static int32_t dlq_find_min_index(const deadline_queue_t *q)
+#ifdef DEBUG
+#include "debug/panic.h"
+#endif
+
+/*
+ * Pairing heap. Every node's children form a doubly linked list through
+ * next/prev, where the leftmost child's prev points at its parent so that an
+ * arbitrary node can be unlinked in O(1).
+ */
+
+static void dlq_node_reset(dlq_node_t *n)
+{
+    n->child = NULL;
+    n->next  = NULL;
+    n->prev  = NULL;
+}
+
+/* Link two detached roots; the later deadline becomes the leftmost child. */
+static dlq_node_t *dlq_meld(dlq_node_t *a, dlq_node_t *b)
 {
-    if (!q || q->count == 0) {
-        return -1;
+    if (!a) {
+        return b;
     }
+    if (!b) {
+        return a;
+    }
+    if (b->deadline < a->deadline) {
+        dlq_node_t *t = a;
+        a = b;
+        b = t;
+    }
+
+    b->prev = a;
+    b->next = a->child;
+    if (a->child) {
+        a->child->prev = b;
+    }
+    a->child = b;
+    return a;
+}
 
-    uint32_t best = 0;
-    uint64_t best_deadline = q->items[0].deadline;
-    for (uint32_t i = 1; i < q->count; i++) {
-        if (q->items[i].deadline < best_deadline) {
-            best = i;
-            best_deadline = q->items[i].deadline;
+/*
+ * Standard two-pass combine of a sibling list: meld pairs left to right, then
+ * fold the results right to left. This is what bounds pop to O(log n)
+ * amortized.
+ */
+static dlq_node_t *dlq_merge_pairs(dlq_node_t *first)
+{
+    dlq_node_t *pairs = NULL; /* melded pairs, in reverse order via next */
+
+    while (first) {
+        dlq_node_t *a = first;
+        dlq_node_t *b = first->next;
+        first = b ? b->next : NULL;
+
+        a->next = NULL;
+        a->prev = NULL;
+        if (b) {
+            b->next = NULL;
+            b->prev = NULL;
         }
+        dlq_node_t *m = dlq_meld(a, b);
+        m->next = pairs;
+        pairs = m;
+    }
+
+    dlq_node_t *root = NULL;
+    while (pairs) {
+        dlq_node_t *n = pairs->next;
+        pairs->next = NULL;
+        root = dlq_meld(root, pairs);
+        pairs = n;
     }
-    return (int32_t)best;
+    return root;
 }
 
 void dlq_init(deadline_queue_t *q)
@@ -22,52 +81,112 @@ void dlq_init(deadline_queue_t *q)
     if (!q) {
         return;
     }
+    q->root  = NULL;
     q->count = 0;
 }
 
-bool dlq_push(deadline_queue_t *q, uint64_t deadline, void *cookie)
+void dlq_push(deadline_queue_t *q, dlq_node_t *n, uint64_t deadline)
 {
-    if (!q) {
-        return false;
-    }
-    if (q->count >= DLQ_MAX_ITEMS) {
-        return false;
+    if (!q || !n) {
+        return;
     }
-    q->items[q->count].deadline = deadline;
-    q->items[q->count].cookie   = cookie;
+    dlq_node_reset(n);
+    n->deadline = deadline;
+    q->root = dlq_meld(q->root, n);
     q->count++;
-    return true;
 }
 
-bool dlq_peek_next(const deadline_queue_t *q, dlq_item_t *out)
+dlq_node_t *dlq_peek_next(const deadline_queue_t *q)
+{
+    return q ? q->root : NULL;
+}
+
+dlq_node_t *dlq_pop_next(deadline_queue_t *q)
 {
-    if (!q || !out) {
-        return false;
+    if (!q || !q->root) {
+        return NULL;
     }
-    int32_t idx = dlq_find_min_index(q);
-    if (idx < 0) {
-        return false;
+    dlq_node_t *top = q->root;
+    q->root = dlq_merge_pairs(top->child);
+    if (q->root) {
+        q->root->prev = NULL;
     }
-    *out = q->items[(uint32_t)idx];
-    return true;
+    q->count--;
+    dlq_node_reset(top);
+    return top;
 }
 
-bool dlq_pop_next(deadline_queue_t *q, dlq_item_t *out)
+void dlq_remove(deadline_queue_t *q, dlq_node_t *n)
 {
-    if (!q || !out) {
-        return false;
+    if (!q || !n) {
+        return;
+    }
+    if (n == q->root) {
+        (void)dlq_pop_next(q);
+        return;
     }
-    int32_t idx = dlq_find_min_index(q);
-    if (idx < 0) {
-        return false;
+
+    /* Unlink n (with its subtree) from its parent's child list. */
+    if (n->prev->child == n) {
+        n->prev->child = n->next;
+    } else {
+        n->prev->next = n->next;
+    }
+    if (n->next) {
+        n->next->prev = n->prev;
     }
-    uint32_t uidx = (uint32_t)idx;
-    *out = q->items[uidx];
 
-    /* Remove by swapping with last element (order not preserved). */
+    /* Its children go back into the heap as one subtree. */
+    dlq_node_t *sub = dlq_merge_pairs(n->child);
+    if (sub) {
+        sub->prev = NULL;
+    }
+    q->root = dlq_meld(q->root, sub);
     q->count--;
-    if (uidx != q->count) {
-        q->items[uidx] = q->items[q->count];
+    dlq_node_reset(n);
+}
+
+#ifdef DEBUG
+static void dlq_expect(int cond, const char *msg)
+{
+    if (!cond) {
+        panic_with_prefix("dlq_selftest: ", msg);
+    }
+}
+#endif
+
+void dlq_selftest(void)
+{
+#ifdef DEBUG
+    enum { N = 64 };
+    static dlq_node_t nodes[N];
+    deadline_queue_t q;
+    dlq_init(&q);
+
+    /* Pseudo-random deadlines with duplicates (LCG). */
+    uint32_t x = 12345u;
+    for (uint32_t i = 0; i < N; i++) {
+        x = x * 1103515245u + 12345u;
+        dlq_push(&q, &nodes[i], (uint64_t)((x >> 16) % 40u));
+    }
+    dlq_expect(q.count == N, "count after push");
+
+    /* Remove every third node: roots, inner nodes and leaves alike. */
+    uint32_t removed = 0;
+    for (uint32_t i = 0; i < N; i += 3) {
+        dlq_remove(&q, &nodes[i]);
+        removed++;
+    }
+    dlq_expect(q.count == N - removed, "count after remove");
+
+    uint64_t last = 0;
+    uint32_t popped = 0;
+    for (dlq_node_t *n = dlq_pop_next(&q); n; n = dlq_pop_next(&q)) {
+        dlq_expect(n->deadline >= last, "pop out of order");
+        dlq_expect((uint32_t)(n - nodes) % 3u != 0, "removed node popped");
+        last = n->deadline;
+        popped++;
     }
-    return true;
+    dlq_expect(popped == N - removed && q.count == 0 && dlq_empty(&q), "drained");
+#endif
 }
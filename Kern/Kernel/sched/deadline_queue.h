@@ -2,40 +2,54 @@
 #define CAPAZ_DEADLINE_QUEUE_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /*
- * Minimal deadline queue.
+ * Deadline queue: an intrusive min pairing heap keyed by absolute deadline.
  *
- * Groundwork for later timer-based scheduling. This is deliberately tiny:
- * - Fixed capacity (no allocation)
- * - O(n) insert and O(n) peek (acceptable for now)
- * - No coalescing, no "intent" metadata yet
+ * - No capacity limit and no allocation: callers embed a dlq_node_t in their
+ *   own objects and recover them with DLQ_CONTAINER().
+ * - O(1) push/peek, O(log n) amortized pop and remove.
+ * - Equal deadlines pop in no particular order.
+ * - Not internally locked.
  */
 
-#ifndef DLQ_MAX_ITEMS
-#define DLQ_MAX_ITEMS 64
-#endif
+typedef struct dlq_node {
+    uint64_t deadline;         /* absolute timestamp in clocksource ticks */
+    struct dlq_node *child;    /* leftmost child */
+    struct dlq_node *next;     /* right sibling */
+    struct dlq_node *prev;     /* left sibling, or the parent of a leftmost child */
+} dlq_node_t;
 
 typedef struct {
-    uint64_t deadline; /* absolute timestamp in clocksource ticks */
-    void    *cookie;   /* opaque; unused for now */
-} dlq_item_t;
-
-typedef struct {
-    dlq_item_t items[DLQ_MAX_ITEMS];
-    uint32_t   count;
+    dlq_node_t *root;
+    uint32_t    count;
 } deadline_queue_t;
 
+#define DLQ_CONTAINER(node, type, member) \
+    ((type *)(void *)((uint8_t *)(node) - offsetof(type, member)))
+
 void dlq_init(deadline_queue_t *q);
 
-/* Returns false if the queue is full. */
-bool dlq_push(deadline_queue_t *q, uint64_t deadline, void *cookie);
+static inline bool dlq_empty(const deadline_queue_t *q)
+{
+    return q->root == NULL;
+}
+
+/* Insert `n` (not currently queued) with the given deadline. */
+void dlq_push(deadline_queue_t *q, dlq_node_t *n, uint64_t deadline);
+
+/* Earliest node, or NULL if empty. */
+dlq_node_t *dlq_peek_next(const deadline_queue_t *q);
+
+/* Remove and return the earliest node, or NULL if empty. */
+dlq_node_t *dlq_pop_next(deadline_queue_t *q);
 
-/* Returns false if empty. */
-bool dlq_peek_next(const deadline_queue_t *q, dlq_item_t *out);
+/* Remove `n`, which must be queued on `q`. */
+void dlq_remove(deadline_queue_t *q, dlq_node_t *n);
 
-/* Returns false if empty. */
-bool dlq_pop_next(deadline_queue_t *q, dlq_item_t *out);
+/* Debug-only self test (DEBUG builds): push, remove and pop ordering. */
+void dlq_selftest(void);
 
 #endif /* CAPAZ_DEADLINE_QUEUE_H */
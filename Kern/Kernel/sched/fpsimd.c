@@ -0,0 +1,73 @@
+// OS/Kern/Kernel/sched/fpsimd.c
+//
+// Lazy FP/SIMD context switching (see fpsimd.h).
+//
+// A thread's registers are live on CPU c iff c's fp_last == t and
+// t->fp_cpu == c: the first says nobody loaded other state on c since, the
+// second that t has not run FP code on another CPU since. Both are checked so
+// neither side needs to reach into another CPU's bookkeeping when a thread
+// migrates or dies.
+
+#include "sched/fpsimd.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "sched.h"
+#include "smp/percpu.h"
+
+#define CPACR_FPEN_SHIFT 20u
+#define CPACR_FPEN_MASK  (3ull << CPACR_FPEN_SHIFT)
+
+static inline void cpacr_set_fpen(bool on) {
+    uint64_t v;
+    __asm__ volatile("mrs %0, cpacr_el1" : "=r"(v));
+    v &= ~CPACR_FPEN_MASK;
+    if (on) {
+        v |= CPACR_FPEN_MASK;
+    }
+    __asm__ volatile("msr cpacr_el1, %0\n\tisb" :: "r"(v) : "memory");
+}
+
+void fpsimd_init_cpu(void) {
+    percpu_t *pc = this_cpu_ptr();
+    pc->fp_last = NULL;
+    pc->fp_enabled = false;
+    cpacr_set_fpen(false);
+}
+
+void fpsimd_thread_switch(thread_t *prev, thread_t *next) {
+    if (prev == next) {
+        return;
+    }
+    percpu_t *pc = this_cpu_ptr();
+    if (!pc->fp_enabled) {
+        return;
+    }
+    // prev ran FP code: its registers are live here. They stay valid for a
+    // cheap return (last/fp_cpu unchanged), but memory must be current in
+    // case prev next runs elsewhere.
+    if (prev) {
+        fpsimd_save(&prev->fp);
+    }
+    pc->fp_enabled = false;
+    cpacr_set_fpen(false);
+}
+
+void fpsimd_access_trap(void) {
+    percpu_t *pc = this_cpu_ptr();
+    const uint32_t cpu = pc->cpu;
+    thread_t *t = sched_current();
+
+    cpacr_set_fpen(true);
+    pc->fp_enabled = true;
+    if (!t) {
+        // Before the scheduler is up: nothing to switch.
+        return;
+    }
+    if (pc->fp_last != t || t->fp_cpu != cpu) {
+        fpsimd_load(&t->fp);
+        pc->fp_last = t;
+        t->fp_cpu = cpu;
+    }
+}
@@ -0,0 +1,30 @@
+// OS/Kern/Kernel/sched/fpsimd.h
+//
+// Lazy FP/SIMD context switching.
+//
+// Kernel C is built with -mgeneral-regs-only, so only thread code that really
+// computes with FP/SIMD (Core/Swift, explicit NEON) touches the unit. Each CPU
+// runs with FP/SIMD access trapped (CPACR_EL1.FPEN) until its current thread
+// executes an FP instruction; the trap loads that thread's registers, unless
+// they are still live in this CPU from its previous run, and leaves the unit
+// enabled. At switch-out a thread that used the unit has its registers saved,
+// so integer-only threads never pay for FP state.
+
+#pragma once
+
+#include "thread.h"
+
+// Per-CPU init: trap FP/SIMD access from now on. Called with IRQs masked from
+// sched_init_bootstrap() on each CPU.
+void fpsimd_init_cpu(void);
+
+// Context-switch hook (IRQs masked): `prev` stops running on this CPU and
+// `next` starts.
+void fpsimd_thread_switch(thread_t *prev, thread_t *next);
+
+// FP/SIMD access trap (ESR EC 0x07) from the exception vectors, IRQs masked.
+void fpsimd_access_trap(void);
+
+// Assembly primitives (Arch/aarch64/fpsimd.S).
+void fpsimd_save(fpsimd_state_t *st);
+void fpsimd_load(const fpsimd_state_t *st);
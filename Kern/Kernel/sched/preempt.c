@@ -4,27 +4,45 @@
 
 #include "preempt.h"
 
+#include "config.h"
+#include "irq.h"
 #include "panic.h"
-
-// CPU0-only for now.
-static preempt_cpu_t s_cpu0 = {
-    .need_resched = 0,
-    .preempt_count = 0,
-};
+#include "sched.h"
+#include "smp/percpu.h"
 
 preempt_cpu_t *preempt_cpu(void) {
-    return &s_cpu0;
+    return &this_cpu_ptr()->preempt;
 }
 
 void preempt_disable(void) {
+    // Mask IRQs around the update: with preemption still enabled the thread
+    // could otherwise be switched out and migrated between reading the CPU
+    // and writing its counter. Once the count is raised it stays put.
+    uint64_t flags = irq_save();
     preempt_cpu()->preempt_count++;
+    irq_restore(flags);
 }
 
 void preempt_enable(void) {
-    if (preempt_cpu()->preempt_count == 0) {
+    uint64_t flags = irq_save();
+    preempt_cpu_t *pc = preempt_cpu();
+    if (pc->preempt_count == 0) {
         panic("preempt: enable with preempt_count == 0");
     }
-    preempt_cpu()->preempt_count--;
+    pc->preempt_count--;
+    const bool resched = pc->preempt_count == 0 && pc->need_resched;
+    irq_restore(flags);
+
+#if !CONFIG_SCHED_COOPERATIVE
+    // Preemption point: a reschedule requested while preemption was disabled
+    // is honoured as soon as it becomes legal. Sections that also mask IRQs
+    // (e.g. run-queue updates) leave it to the next IRQ exit or yield().
+    if (resched && !irq_irqs_disabled() && !in_irq()) {
+        yield();
+    }
+#else
+    (void)resched;
+#endif
 }
 
 bool preemptible(void) {
@@ -2,7 +2,7 @@
 //
 // Preemption bookkeeping: intent + preemption-disable depth.
 //
-// Single-CPU today, but shaped like per-CPU state so SMP can drop in later.
+// One instance per CPU, kept in the per-CPU block (smp/percpu.h).
 
 #pragma once
 
@@ -18,7 +18,7 @@ typedef struct preempt_cpu {
     uint32_t preempt_count;
 } preempt_cpu_t;
 
-// Returns CPU-local preemption state (CPU0 for now).
+// Returns the calling CPU's preemption state.
 preempt_cpu_t *preempt_cpu(void);
 
 // Preemption disable/enable depth.
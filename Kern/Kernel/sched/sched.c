@@ -3,15 +3,75 @@
 // Minimal round-robin scheduler.
 //
 // Design:
+//  - one sched_cpu_t per CPU: its own ready queue, current thread, bootstrap
+//    pseudo-thread and idle thread, guarded by a per-CPU lock. A thread is
+//    queued on the CPU named by thread_t.cpu; wakeups from other CPUs and the
+//    load balancer take that CPU's lock. At most one run-queue lock is held
+//    at a time.
 //  - current thread is NOT in the ready queue while running.
-//  - ready queue is a circular singly-linked list tracked by a tail pointer.
+//  - the idle thread is never queued: it runs only when the ready queue is
+//    empty and nothing can be stolen, so it takes no part in round-robin.
+//    It sleeps in WFI and accounts idle residency and wakeup reasons.
+//  - ready queue has one FIFO per priority level (SCHED_PRIO_LEVELS) plus a
+//    bitmap of non-empty levels; the highest ready priority always runs next and
+//    equal priorities round-robin.
 //  - in cooperative mode, threads switch only when they explicitly call yield().
-//    preemptive hooks exist but are disabled by default.
+//  - CPU bandwidth control (bandwidth.h): a thread is charged to its task
+//    at every switch-out and tick. Threads of a throttled task give way at
+//    the next tick and are parked, not run, when picked from a queue; the
+//    task's refill timer requeues them with sched_bw_unpark().
+//  - QoS classes (thread_qos_t) map to base priorities, so a class preempts
+//    the ones below it, and pick the time slice. The background band (levels
+//    up to SCHED_PRIO_QOS_BACKGROUND) may use only CONFIG_SCHED_BG_MAX_PCT of
+//    each CONFIG_SCHED_BG_WINDOW_TICKS window on a CPU; past that its levels
+//    are masked out of the pick, the steal and the wakeup preemption checks.
+//  - in preemptive mode (CONFIG_SCHED_COOPERATIVE=0) the timer tick charges the
+//    running thread's time slice and sched_irq_exit() switches threads by
+//    returning a different trap frame once the slice is used up.
+//
+// Load balancing:
+//  - every thread carries a runnable-time average (thread_t.load) updated
+//    from the counter when it is switched out, woken, or ticked while running.
+//  - new threads go to the online CPU with the fewest runnable threads that
+//    their affinity mask allows; the balancer never moves a thread outside it.
+//  - CPUs of unequal capacity (smp_asym_capacity()): a heavy thread goes
+//    where it gets the most capacity per thread, a background thread to the
+//    least loaded of the smallest CPUs. Loads are compared scaled by CPU
+//    capacity, and full-capacity CPUs do not pull background threads.
+//  - a CPU about to idle steals the first migratable thread from the busiest
+//    peer; every CONFIG_SCHED_BALANCE_TICKS ticks each CPU also pulls one
+//    thread from the busiest peer when that narrows the load gap.
+//  - a thread is only migrated while it is queued and its last switch-out
+//    has completed (on_cpu clear, see sched_finish_switch()).
+//
+// Deadline (EDF) class:
+//  - a deadline thread gets `budget` of CPU time per `period`, to be used
+//    within `deadline` of each period start. It stays on the CPU that
+//    admitted it (partitioned EDF; the balancer only moves priority-class
+//    threads), and each CPU admits densities budget/deadline up to
+//    CONFIG_SCHED_EDF_MAX_UTIL_PCT, which is what makes deadlines hold.
+//  - released threads wait in edf_ready ordered by absolute deadline and run
+//    ahead of every priority-class thread. A thread that used up its budget
+//    is throttled into edf_release until its next period starts.
+//  - each CPU arms its one-shot timer event for the next release or for the
+//    running thread's budget running out (sched_deadline_event()).
+//  - budgets are only enforced at IRQ exit, so guarantees need preemptive
+//    mode; in cooperative mode EDF only orders threads at yield().
+//
+// Resume flavours:
+//  A suspended thread is resumed either from its ctx_t (it called yield() or
+//  blocked) or from a trap frame pinned on its own stack (it was preempted at
+//  IRQ exit). Both switch paths can resume both flavours:
+//   - ctx_switch() into a preempted thread: its ctx is rewritten at preemption
+//     time so the ret lands in thread_irq_resume with SP at the pinned frame.
+//   - IRQ exit into a cooperatively suspended thread: a one-shot frame is
+//     built below its saved SP that erets into thread_ctx_resume(&ctx).
 
 #include "sched.h"
 
 #include <stddef.h>
 
+#include "mem.h"
 #include "panic.h"
 
 // For trap frame sizing checks (irq_sp range validation).
@@ -19,25 +79,162 @@
 #include "context.h"
 #include "preempt.h"
 #include "config.h"
+#include "sched/bandwidth.h"
+#include "smp/percpu.h"
+#include "smp/smp.h"
+#include "sync/spinlock.h"
+#include "task/task.h"
+#include "timer_generic.h"
+#include "gicv2.h"
+#include "deadline_queue.h"
+#include "fpsimd.h"
+#include "timer/timer_wheel.h"
 
 #define SCHED_ASSERT(cond, msg) do { if (!(cond)) panic(msg); } while (0)
 
 // Provided by Sources/Arch/aarch64/context_switch.S.
 extern void ctx_switch(ctx_t *old, ctx_t *new);
+extern void thread_ctx_resume(void);
+// Provided by Arch/aarch64/exception/kernel_vectors.S.
+extern void thread_irq_resume(void);
+
+// AArch64 SPSR for EL1h with D/A/I/F all masked (see thread.c for the layout).
+// A cooperatively suspended thread was switched out inside an irq_save()
+// section, so it must be resumed with IRQs still masked.
+#define SPSR_EL1H_IRQ_MASKED 0x000003C5u
+
+// Multi-level ready queue: one FIFO per priority plus a bitmap of non-empty
+// levels, so picking the next thread is a single CLZ.
+typedef struct run_queue {
+    uint32_t  ready_bitmap;              // bit p set <=> head[p] != NULL
+    uint32_t  nr_ready;
+    uint32_t  load_sum;                  // sum of queued threads' load
+    thread_t *head[SCHED_PRIO_LEVELS];
+    thread_t *tail[SCHED_PRIO_LEVELS];
+} run_queue_t;
+
+_Static_assert(SCHED_PRIO_LEVELS <= 32, "sched: ready bitmap is 32 bits");
+
+typedef struct sched_cpu {
+    spinlock_t  lock;     // protects rq
+    run_queue_t rq;
+    thread_t   *current;  // under lock; the local fast copy is percpu_t.current
+    // Bootstrap context of this CPU (kmain on CPU0, the secondary entry
+    // elsewhere). Stands in for the idle thread until it retires in
+    // sched_exit_bootstrap().
+    thread_t    boot;
+    // Dedicated idle thread (own stack, THREAD_F_IDLE, never queued).
+    thread_t   *idle;
+    // Idle accounting, written only by this CPU (sched_idle_wait()).
+    sched_idle_stats_t idle_stats;
+    uint64_t    idle_enter;  // counter value WFI was entered at, 0 if awake
+    // Thread switched away from by the switch in progress; its on_cpu is
+    // cleared once the next thread is running (sched_finish_switch()).
+    thread_t   *switch_prev;
+    uint32_t    balance_ticks;
+    uint64_t    nr_migrations; // threads pulled to this CPU
+    // Background throttling, written only by this CPU's tick: ticks charged
+    // to the background band and ticks elapsed in the current window.
+    uint32_t    bg_ticks;
+    uint32_t    bg_window;
+    // Deadline class (under lock): released threads by absolute deadline,
+    // throttled ones by next release, and the admitted density and count.
+    deadline_queue_t edf_ready;
+    deadline_queue_t edf_release;
+    uint32_t    edf_util;
+    uint32_t    edf_nr;
+} sched_cpu_t;
 
-// Bootstrap pseudo-thread (CPU0 initial context).
-static thread_t bootstrap_thread;
+static sched_cpu_t s_cpus[CONFIG_MAX_CPUS];
 
-static thread_t *s_current = NULL;
-// Tail pointer for circular list. Head is s_ready_tail->rq_next.
-static thread_t *s_ready_tail = NULL;
+// Load average time constant in counter ticks (set on first bootstrap).
+static uint64_t s_load_tau;
 
-// sched.c
-static thread_t bootstrap_thread;
+// A pull needs at least this load gap, so noise does not bounce threads.
+#define SCHED_BALANCE_MIN_GAP (SCHED_LOAD_SCALE / 4u)
+
+// Load from which a thread counts as heavy for capacity-aware placement.
+#define SCHED_HEAVY_LOAD ((SCHED_LOAD_SCALE * CONFIG_SCHED_HEAVY_LOAD_PCT) / 100u)
+
+// Background band: the ready levels up to SCHED_PRIO_QOS_BACKGROUND, and
+// the ticks of each window it may run for.
+#define SCHED_BG_BAND_MASK ((1u << (SCHED_PRIO_QOS_BACKGROUND + 1u)) - 1u)
+#define SCHED_BG_BUDGET_TICKS \
+    ((CONFIG_SCHED_BG_WINDOW_TICKS * CONFIG_SCHED_BG_MAX_PCT) / 100u)
+
+// Admission bound on the summed EDF density of one CPU.
+#define SCHED_EDF_UTIL_MAX \
+    ((uint32_t)(((uint64_t)SCHED_EDF_UTIL_SCALE * CONFIG_SCHED_EDF_MAX_UTIL_PCT) / 100u))
+
+#define EDF_THREAD(n) DLQ_CONTAINER((n), thread_t, edf.node)
+
+// IRQs must be masked (or preemption disabled) so the CPU cannot change
+// under the caller.
+static inline sched_cpu_t *this_cpu(void) {
+    return &s_cpus[this_cpu_read(cpu)];
+}
+
+static inline sched_cpu_t *cpu_of(const thread_t *t) {
+    return &s_cpus[__atomic_load_n(&t->cpu, __ATOMIC_RELAXED)];
+}
+
+static inline uint32_t cpu_index(const sched_cpu_t *c) {
+    return (uint32_t)(c - s_cpus);
+}
+
+static inline bool is_idle(const thread_t *t) {
+    return (t->flags & THREAD_F_IDLE) != 0;
+}
+
+// Background work: packed onto small CPUs when capacities differ.
+static inline bool is_background(const thread_t *t) {
+    return t->qos == THREAD_QOS_BACKGROUND || t->base_priority < SCHED_PRIO_DEFAULT;
+}
+
+static inline uint32_t cpu_capacity(const sched_cpu_t *c) {
+    return smp_cpu_capacity(cpu_index(c));
+}
+
+static inline bool is_edf(const thread_t *t) {
+    return t->sched_class == SCHED_CLASS_EDF;
+}
+
+// t's task has used up its CPU bandwidth for this period.
+static inline bool bw_held_back(const thread_t *t) {
+    return t->task && !is_idle(t) && !is_edf(t) && task_bw_throttled(&t->task->bw);
+}
+
+// Charge a running thread to its task's CPU bandwidth up to `now`.
+// Returns true if it is held back now.
+static inline bool bw_charge(thread_t *t, uint64_t now) {
+    if (!t->task || is_idle(t) || is_edf(t) || now <= t->bw_stamp) {
+        return false;
+    }
+    const uint64_t used = now - t->bw_stamp;
+    t->bw_stamp = now;
+    return task_bw_charge(&t->task->bw, used, now);
+}
+
+// The background band has used up its share of c's current window.
+static inline bool bg_throttled(const sched_cpu_t *c) {
+    return CONFIG_SCHED_BG_MAX_PCT < 100 && c->bg_ticks >= SCHED_BG_BUDGET_TICKS;
+}
+
+// `t` may not run on c right now because of background throttling. A
+// boosted (priority inheritance) thread is above the band and runs.
+static inline bool bg_held_back(const sched_cpu_t *c, const thread_t *t) {
+    return !is_idle(t) && !is_edf(t) && t->priority <= SCHED_PRIO_QOS_BACKGROUND &&
+           bg_throttled(c);
+}
+
+// A deadline thread that has used up this period's budget.
+static inline bool edf_throttled(const thread_t *t) {
+    return is_edf(t) && t->edf.runtime == 0;
+}
 
 static inline void sched_validate_irq_sp(thread_t *t) {
     if (!t) return;
-    if (t == &bootstrap_thread) return; // bootstrap has no per-thread stack
+    if (is_idle(t)) return; // bootstrap has no per-thread stack; idle never blocks
     SCHED_ASSERT(t->kstack_base != NULL, "sched: thread kstack_base is NULL");
     SCHED_ASSERT(t->kstack_top != NULL, "sched: thread kstack_top is NULL");
     SCHED_ASSERT(t->kstack_size != 0,   "sched: thread kstack_size is 0");
@@ -52,14 +249,19 @@ static inline void sched_validate_irq_sp(thread_t *t) {
     SCHED_ASSERT(sp >= base, "sched: thread irq_sp below stack base");
     SCHED_ASSERT((sp + sizeof(trap_frame_t)) <= top, "sched: thread irq_sp beyond stack top");
 }
-static inline void rq_validate(void);
+static inline void rq_validate(const run_queue_t *rq);
+
+static inline uint32_t prio_bit(uint32_t prio) {
+    return 1u << prio;
+}
 
-static inline void rq_insert_tail(thread_t *t) {
+static inline void rq_insert_tail(run_queue_t *rq, thread_t *t) {
     if (!t) return;
-    if (t->rq_next) {
+    if (t->on_rq) {
         panic("sched: enqueue of already-queued thread");
     }
     SCHED_ASSERT(t->state == THREAD_READY, "sched: enqueue requires THREAD_READY");
+    SCHED_ASSERT(t->priority < SCHED_PRIO_LEVELS, "sched: priority out of range");
 
     // Preemption path will require a valid irq_sp for any non-bootstrap runnable thread.
     sched_validate_irq_sp(t);
@@ -67,136 +269,1071 @@ static inline void rq_insert_tail(thread_t *t) {
         SCHED_ASSERT((t->ctx.sp & 0xF) == 0, "sched: thread ctx.sp not 16-byte aligned");
     }
 
-    if (!s_ready_tail) {
-        t->rq_next = t;
-        s_ready_tail = t;
+    const uint32_t p = t->priority;
+    t->rq_next = NULL;
+    if (rq->tail[p]) {
+        rq->tail[p]->rq_next = t;
+    } else {
+        rq->head[p] = t;
+        rq->ready_bitmap |= prio_bit(p);
+    }
+    rq->tail[p] = t;
+    rq->nr_ready++;
+    rq->load_sum += t->load;
+    t->on_rq = true;
+}
+
+// Unlink `t` from its priority FIFO. O(length of that level); used for
+// priority changes and migration of an already-queued thread.
+static inline void rq_remove(run_queue_t *rq, thread_t *t) {
+    const uint32_t p = t->priority;
+    thread_t *prev = NULL;
+    for (thread_t *it = rq->head[p]; it; prev = it, it = it->rq_next) {
+        if (it != t) continue;
+        if (prev) {
+            prev->rq_next = t->rq_next;
+        } else {
+            rq->head[p] = t->rq_next;
+        }
+        if (rq->tail[p] == t) {
+            rq->tail[p] = prev;
+        }
+        if (!rq->head[p]) {
+            rq->ready_bitmap &= ~prio_bit(p);
+        }
+        t->rq_next = NULL;
+        t->on_rq = false;
+        rq->nr_ready--;
+        rq->load_sum -= t->load;
         return;
     }
+    panic("sched: rq_remove of thread not on its priority list");
+}
 
-    t->rq_next = s_ready_tail->rq_next;
-    s_ready_tail->rq_next = t;
-    s_ready_tail = t;
+// Ready levels c may pick from: all non-empty ones, less the background
+// band while it is throttled.
+static inline uint32_t rq_eligible(const sched_cpu_t *c) {
+    const uint32_t levels = c->rq.ready_bitmap;
+    return bg_throttled(c) ? levels & ~SCHED_BG_BAND_MASK : levels;
 }
 
-static inline uint64_t rq_critical_enter(void) {
+// Highest eligible ready priority, or -1 if nothing is ready.
+// 31 - CLZ(bitmap) picks the most significant set bit in a single instruction.
+static inline int32_t rq_highest_prio(const sched_cpu_t *c) {
+    const uint32_t levels = rq_eligible(c);
+    if (levels == 0) {
+        return -1;
+    }
+    return (int32_t)(31u - (uint32_t)__builtin_clz(levels));
+}
+
+// Run-queue critical section: IRQs masked, preemption disabled and the
+// owning CPU's lock held (other CPUs may be enqueueing wakeups).
+static inline uint64_t rq_critical_enter(sched_cpu_t *c) {
     uint64_t flags = irq_save();
     preempt_disable();
+    spin_lock(&c->lock);
     return flags;
 }
 
-static inline void rq_critical_exit(uint64_t flags) {
+static inline void rq_critical_exit(sched_cpu_t *c, uint64_t flags) {
+    spin_unlock(&c->lock);
     preempt_enable();
     irq_restore(flags);
 }
 
-static inline thread_t *rq_pop_head(void) {
-    uint64_t flags = rq_critical_enter();
-    if (!s_ready_tail) {
-        rq_critical_exit(flags);
+// Caller holds c->lock.
+static inline thread_t *rq_take_highest(sched_cpu_t *c) {
+    const int32_t p = rq_highest_prio(c);
+    if (p < 0) {
         return NULL;
     }
 
-    thread_t *head = s_ready_tail->rq_next;
-    if (head == s_ready_tail) {
-        // Single element.
-        s_ready_tail = NULL;
-    } else {
-        s_ready_tail->rq_next = head->rq_next;
+    run_queue_t *rq = &c->rq;
+    thread_t *head = rq->head[p];
+    rq->head[p] = head->rq_next;
+    if (!rq->head[p]) {
+        rq->tail[p] = NULL;
+        rq->ready_bitmap &= ~prio_bit((uint32_t)p);
     }
     head->rq_next = NULL;
-    rq_validate();
+    head->on_rq = false;
+    rq->nr_ready--;
+    rq->load_sum -= head->load;
+    rq_validate(rq);
+    return head;
+}
 
-    rq_critical_exit(flags);
+// Start a new period at `start` with a full budget.
+static inline void edf_replenish(thread_t *t, uint64_t start) {
+    t->edf.period_start = start;
+    t->edf.abs_deadline = start + t->edf.deadline;
+    t->edf.runtime      = t->edf.budget;
+}
+
+// Give up the rest of this period: the next release is the next period
+// start, or now if the thread is already behind.
+static inline void edf_throttle(thread_t *t, uint64_t now) {
+    t->edf.runtime = 0;
+    t->edf.period_start += t->edf.period;
+    if (t->edf.period_start < now) {
+        t->edf.period_start = now;
+    }
+}
+
+// Charge a running deadline thread for the CPU time since its last charge.
+static void edf_charge(thread_t *t, uint64_t now) {
+    if (!is_edf(t) || now <= t->edf.exec_start) {
+        return;
+    }
+    const uint64_t used = now - t->edf.exec_start;
+    t->edf.exec_start = now;
+    if (t->edf.runtime == 0) {
+        return;
+    }
+    if (used < t->edf.runtime) {
+        t->edf.runtime -= used;
+    } else {
+        edf_throttle(t, now);
+    }
+}
+
+// Queue a READY deadline thread: throttled ones wait for their release.
+// Caller holds c->lock.
+static void edf_insert(sched_cpu_t *c, thread_t *t) {
+    SCHED_ASSERT(!t->on_rq, "sched: enqueue of already-queued thread");
+    if (t->edf.runtime == 0) {
+        dlq_push(&c->edf_release, &t->edf.node, t->edf.period_start);
+    } else {
+        dlq_push(&c->edf_ready, &t->edf.node, t->edf.abs_deadline);
+    }
+    t->on_rq = true;
+}
+
+static void edf_remove(sched_cpu_t *c, thread_t *t) {
+    dlq_remove(t->edf.runtime == 0 ? &c->edf_release : &c->edf_ready, &t->edf.node);
+    t->on_rq = false;
+}
+
+// Move every thread whose period has started to the ready queue with a fresh
+// budget. Caller holds c->lock.
+static void edf_release_due(sched_cpu_t *c, uint64_t now) {
+    dlq_node_t *n;
+    while ((n = dlq_peek_next(&c->edf_release)) != NULL && n->deadline <= now) {
+        (void)dlq_pop_next(&c->edf_release);
+        thread_t *t = EDF_THREAD(n);
+        edf_replenish(t, t->edf.period_start);
+        dlq_push(&c->edf_ready, n, t->edf.abs_deadline);
+    }
+}
+
+// Queue a READY thread in its class's queue on c. Caller holds c->lock.
+static inline void rq_insert(sched_cpu_t *c, thread_t *t) {
+    if (is_edf(t)) {
+        edf_insert(c, t);
+    } else {
+        rq_insert_tail(&c->rq, t);
+    }
+}
+
+// Next thread to run from c's queues: earliest deadline first, then the
+// highest priority. Threads of a throttled task met on the way are parked
+// with their task. Caller holds c->lock.
+static thread_t *rq_take_next(sched_cpu_t *c) {
+    dlq_node_t *n = dlq_pop_next(&c->edf_ready);
+    if (n) {
+        thread_t *t = EDF_THREAD(n);
+        t->on_rq = false;
+        return t;
+    }
+    for (;;) {
+        thread_t *t = rq_take_highest(c);
+        if (!t || !bw_held_back(t) || !task_bw_park(&t->task->bw, t)) {
+            return t;
+        }
+    }
+}
+
+// True if c's best queued thread should run instead of `cur`. With `ties`,
+// an equal priority or deadline also counts (round robin). Caller holds
+// c->lock.
+static bool rq_has_better(const sched_cpu_t *c, const thread_t *cur, bool ties) {
+    const dlq_node_t *e = dlq_peek_next(&c->edf_ready);
+    if (e) {
+        return !is_edf(cur) || edf_throttled(cur) ||
+               e->deadline < cur->edf.abs_deadline ||
+               (ties && e->deadline == cur->edf.abs_deadline);
+    }
+    if (is_edf(cur) && !edf_throttled(cur)) {
+        return false;
+    }
+    const int32_t top = rq_highest_prio(c);
+    if (top < 0) {
+        return false;
+    }
+    return is_idle(cur) || is_edf(cur) || top > (int32_t)cur->priority ||
+           (ties && top == (int32_t)cur->priority);
+}
+
+static inline thread_t *rq_pop_head(sched_cpu_t *c) {
+    uint64_t flags = rq_critical_enter(c);
+    if (c->edf_nr != 0) {
+        edf_release_due(c, time_now());
+    }
+    thread_t *head = rq_take_next(c);
+    rq_critical_exit(c, flags);
     return head;
 }
 
-static inline void rq_validate(void) {
+// rq_critical_enter() on the CPU that owns `t`, following the thread if the
+// balancer moves it while we wait for the lock.
+static sched_cpu_t *lock_thread_rq(const thread_t *t, uint64_t *flags) {
+    for (;;) {
+        sched_cpu_t *c = cpu_of(t);
+        *flags = rq_critical_enter(c);
+        if (cpu_of(t) == c) {
+            return c;
+        }
+        rq_critical_exit(c, *flags);
+    }
+}
+
+// Fold the time since the last update into t->load:
+//   load = (load * tau + runnable * period * SCALE) / (period + tau)
+// an exponential average over roughly CONFIG_SCHED_LOAD_TAU_MS. Queued
+// threads are skipped so a run queue's load_sum stays exact.
+static void load_update(thread_t *t, uint64_t now, bool runnable) {
+    if (is_idle(t) || t->on_rq || now <= t->load_stamp) {
+        return;
+    }
+    const uint64_t period = now - t->load_stamp;
+    const uint64_t busy = runnable ? period * SCHED_LOAD_SCALE : 0u;
+    t->load = (uint32_t)(((uint64_t)t->load * s_load_tau + busy) / (period + s_load_tau));
+    t->load_stamp = now;
+}
+
+// Accounting (sched_stats_t). A thread is charged run time from switch-in
+// to switch-out and wait time from being queued to its next switch-in; a
+// wait that started with sched_wake() is also a wake-to-run latency sample.
+
+static inline uint32_t lat_bucket(uint64_t ticks) {
+    const uint64_t freq = time_freq();
+    // A second is far past the last bucket and keeps the scaling in range.
+    if (ticks >= freq) {
+        return SCHED_LAT_BUCKETS - 1u;
+    }
+    const uint64_t us = (ticks * 1000000u) / freq;
+    if (us == 0) {
+        return 0;
+    }
+    const uint32_t b = 64u - (uint32_t)__builtin_clzll(us);
+    return b < SCHED_LAT_BUCKETS ? b : SCHED_LAT_BUCKETS - 1u;
+}
+
+// t was just queued. Caller holds its CPU's lock.
+static inline void stats_queued(thread_t *t, uint64_t now, bool wakeup) {
+    t->ready_stamp = now;
+    t->woken = wakeup;
+    if (wakeup) {
+        t->stats.nr_wakeups++;
+    }
+}
+
+// `next` starts running in place of `prev` (the same thread for a fresh
+// slice). IRQs masked.
+static inline void stats_switch(thread_t *prev, thread_t *next, uint64_t now,
+                                bool preempted) {
+    if (prev != next) {
+        if (now > prev->run_stamp) {
+            prev->stats.run_time += now - prev->run_stamp;
+        }
+        if (preempted) {
+            prev->stats.nr_involuntary++;
+        } else {
+            prev->stats.nr_voluntary++;
+        }
+        next->run_stamp = now;
+    }
+    if (next->ready_stamp != 0) {
+        const uint64_t wait = now > next->ready_stamp ? now - next->ready_stamp : 0u;
+        next->stats.wait_time += wait;
+        if (next->woken) {
+            next->stats.wake_lat_hist[lat_bucket(wait)]++;
+            if (wait > next->stats.wake_lat_max) {
+                next->stats.wake_lat_max = wait;
+            }
+            next->woken = false;
+        }
+        next->ready_stamp = 0;
+    }
+}
+
+// Balancer views of a CPU: queued threads plus the running one. These are
+// unlocked reads, so callers treat them as hints and recheck under the lock.
+static inline uint32_t cpu_nr_running(const sched_cpu_t *c) {
+    const thread_t *cur = c->current;
+    return __atomic_load_n(&c->rq.nr_ready, __ATOMIC_RELAXED) +
+           ((cur && !is_idle(cur)) ? 1u : 0u);
+}
+
+static inline uint32_t cpu_load(const sched_cpu_t *c) {
+    const thread_t *cur = c->current;
+    const uint32_t load = __atomic_load_n(&c->rq.load_sum, __ATOMIC_RELAXED) +
+                          ((cur && !is_idle(cur)) ? cur->load : 0u);
+    // Relative to the CPU's capacity: a half-speed core is full at half load.
+    return (uint32_t)(((uint64_t)load * CPU_CAPACITY_SCALE) / cpu_capacity(c));
+}
+
+// Busiest online peer of `self` that has at least one queued thread.
+static sched_cpu_t *find_busiest(const sched_cpu_t *self) {
+    sched_cpu_t *best = NULL;
+    uint32_t best_load = 0;
+    for (uint32_t i = 0; i < CONFIG_MAX_CPUS; i++) {
+        sched_cpu_t *c = &s_cpus[i];
+        if (c == self || !smp_cpu_online(i) ||
+            __atomic_load_n(&c->rq.nr_ready, __ATOMIC_RELAXED) == 0) {
+            continue;
+        }
+        const uint32_t load = cpu_load(c);
+        if (!best || load > best_load) {
+            best = c;
+            best_load = load;
+        }
+    }
+    return best;
+}
+
+// Remove the highest-priority queued thread that may move to CPU `dst` and
+// whose load is at most `max_load`, skipping background threads if
+// `no_background`. Caller holds the run queue's lock.
+static thread_t *rq_take_migratable(run_queue_t *rq, uint32_t levels, uint32_t max_load,
+                                    uint32_t dst, bool no_background) {
+    levels &= rq->ready_bitmap;
+    while (levels != 0) {
+        const uint32_t p = 31u - (uint32_t)__builtin_clz(levels);
+        levels &= ~prio_bit(p);
+        for (thread_t *t = rq->head[p]; t; t = t->rq_next) {
+            // Its old CPU may still be saving its registers.
+            if (__atomic_load_n(&t->on_cpu, __ATOMIC_ACQUIRE) || t->load > max_load ||
+                !(t->affinity & (1u << dst)) || (no_background && is_background(t))) {
+                continue;
+            }
+            rq_remove(rq, t);
+            return t;
+        }
+    }
+    return NULL;
+}
+
+// Take one migratable thread off `src` and hand it to `dst` (the calling
+// CPU). The thread is returned READY and unqueued. IRQs masked; no run-queue
+// lock held on entry.
+static thread_t *sched_pull_one(sched_cpu_t *dst, sched_cpu_t *src, uint32_t max_load) {
+    // Background threads stay packed on the small CPUs.
+    const bool big = smp_asym_capacity() && cpu_capacity(dst) == CPU_CAPACITY_SCALE;
+    // Nor does dst take on background work it is not allowed to run.
+    const uint32_t levels = bg_throttled(dst) ? ~SCHED_BG_BAND_MASK : ~0u;
+    spin_lock(&src->lock);
+    thread_t *t = rq_take_migratable(&src->rq, levels, max_load, cpu_index(dst), big);
+    if (t) {
+        __atomic_store_n(&t->cpu, (uint8_t)cpu_index(dst), __ATOMIC_RELAXED);
+    }
+    rq_validate(&src->rq);
+    spin_unlock(&src->lock);
+    if (t) {
+        dst->nr_migrations++;
+    }
+    return t;
+}
+
+static inline void rq_validate(const run_queue_t *rq) {
 #if SCHED_DEBUG
-    if (!s_ready_tail) return;
-    thread_t *head = s_ready_tail->rq_next;
-    SCHED_ASSERT(head != NULL, "sched: ready head is NULL");
-    // Walk at most 1024 nodes to catch corruption without hanging.
-    thread_t *t = head;
-    for (unsigned i = 0; i < 1024; i++) {
-        SCHED_ASSERT(t != NULL, "sched: ready node is NULL");
-        SCHED_ASSERT(t->rq_next != NULL, "sched: ready node rq_next NULL");
-        if (t->rq_next == head) return; // closed circle
-        t = t->rq_next;
-    }
-    panic("sched: ready queue corrupted (no cycle closure)");
+    uint32_t total = 0;
+    for (uint32_t p = 0; p < SCHED_PRIO_LEVELS; p++) {
+        const bool bit = (rq->ready_bitmap & prio_bit(p)) != 0;
+        SCHED_ASSERT(bit == (rq->head[p] != NULL), "sched: ready bitmap out of sync");
+        SCHED_ASSERT((rq->head[p] == NULL) == (rq->tail[p] == NULL), "sched: ready head/tail mismatch");
+        // Walk at most 1024 nodes per level to catch corruption without hanging.
+        thread_t *t = rq->head[p];
+        for (unsigned i = 0; t; i++) {
+            SCHED_ASSERT(i < 1024, "sched: ready queue corrupted (no list end)");
+            SCHED_ASSERT(t->on_rq && t->priority == p, "sched: ready node on wrong level");
+            if (!t->rq_next) {
+                SCHED_ASSERT(t == rq->tail[p], "sched: ready tail is not last node");
+            }
+            t = t->rq_next;
+            total++;
+        }
+    }
+    SCHED_ASSERT(total == rq->nr_ready, "sched: ready count out of sync");
+#else
+    (void)rq;
 #endif
 }
 
 thread_t *sched_current(void) {
-    return s_current;
+#if CONFIG_SCHED_COOPERATIVE
+    // The caller cannot be switched out (let alone migrated) between the
+    // TPIDR_EL1 read and the load, so the pair needs no protection.
+    return this_cpu_read(current);
+#else
+    // A preemption between the two could migrate the caller and return
+    // another CPU's thread; mask IRQs so they are read together.
+    uint64_t flags = irq_save();
+    thread_t *cur = this_cpu_read(current);
+    irq_restore(flags);
+    return cur;
+#endif
 }
 
 void sched_init_bootstrap(void) {
-    bootstrap_thread.ctx = (ctx_t){0};
-    bootstrap_thread.kstack_base = NULL;
-    bootstrap_thread.kstack_size = 0;
-    bootstrap_thread.kstack_top  = NULL;
-    bootstrap_thread.rq_next     = NULL;
-    bootstrap_thread.last_trap   = NULL;
-    bootstrap_thread.saved_daif  = 0;
-    bootstrap_thread.state       = THREAD_RUNNING;
+    sched_cpu_t *c = this_cpu();
+    thread_t *boot = &c->boot;
+
+    spin_init(&c->lock);
+    memset(&c->rq, 0, sizeof(c->rq));
+    dlq_init(&c->edf_ready);
+    dlq_init(&c->edf_release);
+    c->edf_util = 0;
+    c->edf_nr = 0;
+
+    boot->ctx = (ctx_t){0};
+    boot->tid         = 0;
+    boot->name        = "boot";
+    boot->kstack_base = NULL;
+    boot->kstack_size = 0;
+    boot->kstack_top  = NULL;
+    boot->rq_next     = NULL;
+    boot->on_rq       = false;
+    boot->last_trap   = NULL;
+    boot->saved_daif  = 0;
+    boot->state       = THREAD_RUNNING;
+    boot->priority    = SCHED_PRIO_IDLE;
+    boot->base_priority = SCHED_PRIO_IDLE;
+    boot->pi_priority = 0;
+    boot->cpu         = (uint8_t)cpu_index(c);
+    boot->flags       = THREAD_F_IDLE;
+    boot->sched_class = SCHED_CLASS_PRIO;
+    boot->qos         = THREAD_QOS_DEFAULT;
+    boot->affinity    = 1u << cpu_index(c);
+    boot->on_cpu      = true;
+    boot->load        = 0;
+    boot->fp_cpu      = THREAD_FP_CPU_NONE;
+    boot->stats       = (sched_stats_t){0};
+    boot->run_stamp   = time_now();
+    boot->ready_stamp = 0;
+    boot->woken       = false;
 
-    s_current = &bootstrap_thread;
+    c->current = boot;
+    this_cpu_write(current, boot);
+    c->idle = NULL;
+    c->idle_stats = (sched_idle_stats_t){0};
+    c->idle_stats.since = boot->run_stamp;
+    c->idle_enter = 0;
+    c->switch_prev = NULL;
+    c->balance_ticks = 0;
+    c->bg_ticks = 0;
+    c->bg_window = 0;
+    // FP/SIMD is switched lazily from here on (see fpsimd.h).
+    fpsimd_init_cpu();
+
+    if (s_load_tau == 0) {
+        s_load_tau = (time_freq() * CONFIG_SCHED_LOAD_TAU_MS) / 1000u;
+        if (s_load_tau == 0) {
+            s_load_tau = 1;
+        }
+    }
 }
 
-void sched_enqueue(thread_t *t) {
-    if (!t) return;
+void sched_finish_switch(void) {
+    sched_cpu_t *c = this_cpu();
+    thread_t *prev = c->switch_prev;
+    if (!prev) {
+        return;
+    }
+    c->switch_prev = NULL;
+    // Publishes prev's saved context to whichever CPU picks it up next.
+    __atomic_store_n(&prev->on_cpu, false, __ATOMIC_RELEASE);
+}
+
+uint64_t sched_migrations(void) {
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < CONFIG_MAX_CPUS; i++) {
+        total += __atomic_load_n(&s_cpus[i].nr_migrations, __ATOMIC_RELAXED);
+    }
+    return total;
+}
+
+// Ask CPU `c` to reschedule: locally via need_resched, remotely via IPI.
+static inline void sched_resched_cpu(sched_cpu_t *c) {
+    if (c == this_cpu()) {
+        preempt_set_need_resched();
+    } else {
+        smp_send_resched(cpu_index(c));
+    }
+}
+
+// Ask for a reschedule if `t` should run ahead of its CPU's current thread.
+// Caller holds c->lock. Returns true if a reschedule was requested.
+static inline bool sched_check_preempt(sched_cpu_t *c, const thread_t *t) {
+    const thread_t *cur = c->current;
+    if (!cur || bg_held_back(c, t) || bw_held_back(t)) {
+        return false;
+    }
+    bool better;
+    if (is_idle(cur)) {
+        better = true;
+    } else if (is_edf(t)) {
+        better = t->edf.runtime > 0 &&
+                 (!is_edf(cur) || edf_throttled(cur) ||
+                  t->edf.abs_deadline < cur->edf.abs_deadline);
+    } else {
+        better = is_edf(cur) ? edf_throttled(cur) : t->priority > cur->priority;
+    }
+    if (better) {
+        sched_resched_cpu(c);
+    }
+    return better;
+}
+
+// This CPU's next deadline-class event: the earliest release, or the running
+// thread's budget running out. UINT64_MAX if none. IRQs masked; c->lock not
+// held.
+static uint64_t edf_next_event(sched_cpu_t *c) {
+    uint64_t next = UINT64_MAX;
+    if (c->edf_nr == 0) {
+        return next;
+    }
+    spin_lock(&c->lock);
+    const dlq_node_t *r = dlq_peek_next(&c->edf_release);
+    if (r) {
+        next = r->deadline;
+    }
+    spin_unlock(&c->lock);
+
+    const thread_t *cur = c->current;
+    if (is_edf(cur) && cur->edf.runtime > 0 &&
+        cur->edf.exec_start + cur->edf.runtime < next) {
+        next = cur->edf.exec_start + cur->edf.runtime;
+    }
+    return next;
+}
+
+// Program this CPU's one-shot timer event for the earlier of its next
+// deadline-class event and its next kernel timer. IRQs masked; c->lock not
+// held.
+static void sched_arm_event(sched_cpu_t *c) {
+    uint64_t next = edf_next_event(c);
+    const uint64_t timer = ktimer_next_event();
+    if (timer < next) {
+        next = timer;
+    }
+    if (next != UINT64_MAX) {
+        event_arm_oneshot(next);
+    }
+}
+
+// c's deadline-class state changed: get its timer event re-armed, locally or
+// through a reschedule IPI (see sched_deadline_event()).
+static void edf_kick(sched_cpu_t *c) {
+    uint64_t flags = irq_save();
+    if (c == this_cpu()) {
+        sched_arm_event(c);
+    } else {
+        smp_send_resched(cpu_index(c));
+    }
+    irq_restore(flags);
+}
+
+// Drop a deadline thread's admission on c and return it to the priority
+// class. The thread must not be queued. Caller holds c->lock.
+static void edf_detach(sched_cpu_t *c, thread_t *t) {
+    c->edf_util -= t->edf.density;
+    c->edf_nr--;
+    t->sched_class = SCHED_CLASS_PRIO;
+}
+
+// `c` just gained a thread it cannot run yet: wake one idle peer so it
+// steals it instead of waiting for the next balance tick.
+static void sched_kick_idle(const sched_cpu_t *c) {
+    for (uint32_t i = 0; i < CONFIG_MAX_CPUS; i++) {
+        sched_cpu_t *s = &s_cpus[i];
+        if (s == c || !smp_cpu_online(i)) continue;
+        const thread_t *cur = s->current;
+        if (cur && is_idle(cur)) {
+            sched_resched_cpu(s);
+            return;
+        }
+    }
+}
+
+// Placement helpers for sched_select_cpu(), IRQs masked. They only consider
+// online CPUs in t's affinity, visiting the caller's CPU first so it wins
+// ties, and return NULL if there is none.
 
-    uint64_t flags = rq_critical_enter();
+static inline bool cpu_allowed(const thread_t *t, uint32_t cpu) {
+    return (t->affinity & (1u << cpu)) != 0 && smp_cpu_online(cpu);
+}
+
+#define for_each_allowed_cpu(t, self, i)                                   \
+    for (uint32_t _k = 0, i = (self); _k < CONFIG_MAX_CPUS;                \
+         _k++, i = ((self) + _k) % CONFIG_MAX_CPUS)                        \
+        if (cpu_allowed((t), i))
+
+// CPU with the fewest runnable threads.
+static sched_cpu_t *select_least_running(const thread_t *t, uint32_t self) {
+    sched_cpu_t *best = NULL;
+    uint32_t best_nr = 0;
+    for_each_allowed_cpu(t, self, i) {
+        sched_cpu_t *c = &s_cpus[i];
+        const uint32_t nr = cpu_nr_running(c);
+        if (!best || nr < best_nr) {
+            best = c;
+            best_nr = nr;
+            if (nr == 0) break;
+        }
+    }
+    return best;
+}
+
+// CPU giving one more thread the largest capacity share (capacity over
+// runnable threads including it), larger CPUs first on ties.
+static sched_cpu_t *select_most_capacity(const thread_t *t, uint32_t self) {
+    sched_cpu_t *best = NULL;
+    uint32_t best_cap = 0;
+    uint32_t best_share = 0;
+    for_each_allowed_cpu(t, self, i) {
+        sched_cpu_t *c = &s_cpus[i];
+        const uint32_t cap = cpu_capacity(c);
+        const uint32_t share = cap / (cpu_nr_running(c) + 1u);
+        if (!best || share > best_share || (share == best_share && cap > best_cap)) {
+            best = c;
+            best_cap = cap;
+            best_share = share;
+        }
+    }
+    return best;
+}
+
+// Least loaded of the lowest-capacity CPUs.
+static sched_cpu_t *select_packed(const thread_t *t, uint32_t self) {
+    sched_cpu_t *best = NULL;
+    uint32_t best_cap = 0;
+    uint32_t best_nr = 0;
+    for_each_allowed_cpu(t, self, i) {
+        sched_cpu_t *c = &s_cpus[i];
+        const uint32_t cap = cpu_capacity(c);
+        const uint32_t nr = cpu_nr_running(c);
+        if (!best || cap < best_cap || (cap == best_cap && nr < best_nr)) {
+            best = c;
+            best_cap = cap;
+            best_nr = nr;
+        }
+    }
+    return best;
+}
+
+// Placement for a thread without a CPU yet. With equal CPU capacities every
+// thread goes to the CPU with the fewest runnable threads. Falls back to the
+// calling CPU while no allowed CPU is online (before smp_init()).
+static sched_cpu_t *sched_select_cpu(const thread_t *t) {
+    uint64_t flags = irq_save();
+    const uint32_t self = cpu_index(this_cpu());
+    const bool asym = smp_asym_capacity();
+    sched_cpu_t *best;
+    if (asym && is_background(t)) {
+        best = select_packed(t, self);
+    } else if (asym && t->load >= SCHED_HEAVY_LOAD) {
+        best = select_most_capacity(t, self);
+    } else {
+        best = select_least_running(t, self);
+    }
+    if (!best) {
+        best = this_cpu();
+    }
+    irq_restore(flags);
+    return best;
+}
+
+// Queue a thread at its current priority on its CPU. Returns true if that
+// CPU was asked to reschedule for it.
+static bool rq_enqueue(thread_t *t) {
+    uint64_t flags;
+    sched_cpu_t *c = lock_thread_rq(t, &flags);
 
     // If a thread is DEAD, it must not be re-enqueued.
     if (t->state == THREAD_DEAD) {
-        rq_critical_exit(flags);
-        return;
+        rq_critical_exit(c, flags);
+        return false;
     }
 
     // Only READY threads belong on the ready queue.
     t->state = THREAD_READY;
-    rq_insert_tail(t);
-    rq_validate();
+    rq_insert(c, t);
+    stats_queued(t, time_now(), false);
+    rq_validate(&c->rq);
+    const bool resched = sched_check_preempt(c, t);
 
-    rq_critical_exit(flags);
+    rq_critical_exit(c, flags);
+    return resched;
 }
 
-static thread_t *sched_pick_next(void) {
-    thread_t *next = rq_pop_head();
-    if (!next) {
-        return s_current;
+void sched_enqueue(thread_t *t, uint32_t priority) {
+    if (!t) return;
+    SCHED_ASSERT(priority <= SCHED_PRIO_MAX, "sched: enqueue priority out of range");
+    SCHED_ASSERT(!t->on_rq, "sched: enqueue of already-queued thread");
+    t->base_priority = (uint8_t)priority;
+    t->priority = (uint8_t)(priority > t->pi_priority ? priority : t->pi_priority);
+    // A thread that is not running anywhere can start on any CPU. Deadline
+    // threads stay where they were admitted.
+    if (!t->on_cpu && !is_edf(t)) {
+        __atomic_store_n(&t->cpu, (uint8_t)cpu_index(sched_select_cpu(t)), __ATOMIC_RELAXED);
+    }
+    if (!rq_enqueue(t)) {
+        sched_kick_idle(cpu_of(t));
+    }
+}
+
+static inline uint32_t effective_priority(const thread_t *t) {
+    return t->base_priority > t->pi_priority ? t->base_priority : t->pi_priority;
+}
+
+// Recompute t's effective priority from its base and inherited ones and
+// requeue it accordingly. Caller holds c->lock (c owns t).
+static void sched_update_priority(sched_cpu_t *c, thread_t *t) {
+    const uint32_t priority = effective_priority(t);
+    if (is_edf(t)) {
+        // Takes effect if the thread returns to the priority class.
+        t->priority = (uint8_t)priority;
+    } else if (t->on_rq) {
+        // Requeue at the tail of the new level.
+        rq_remove(&c->rq, t);
+        t->priority = (uint8_t)priority;
+        rq_insert_tail(&c->rq, t);
+        (void)sched_check_preempt(c, t);
+    } else {
+        t->priority = (uint8_t)priority;
+        // Lowering the running thread may leave a higher-priority one waiting.
+        if (t == c->current && rq_highest_prio(c) > (int32_t)priority) {
+            sched_resched_cpu(c);
+        }
+    }
+    rq_validate(&c->rq);
+}
+
+bool sched_set_priority(thread_t *t, uint32_t priority) {
+    if (!t || is_idle(t) || priority > SCHED_PRIO_MAX) {
+        return false;
+    }
+
+    uint64_t flags;
+    sched_cpu_t *c = lock_thread_rq(t, &flags);
+    t->base_priority = (uint8_t)priority;
+    sched_update_priority(c, t);
+    rq_critical_exit(c, flags);
+    return true;
+}
+
+void sched_set_inherited_priority(thread_t *t, uint32_t priority) {
+    SCHED_ASSERT(t != NULL && !is_idle(t), "sched: priority inheritance on idle thread");
+    SCHED_ASSERT(priority <= SCHED_PRIO_MAX, "sched: inherited priority out of range");
+
+    uint64_t flags;
+    sched_cpu_t *c = lock_thread_rq(t, &flags);
+    t->pi_priority = (uint8_t)priority;
+    if (effective_priority(t) != t->priority) {
+        sched_update_priority(c, t);
+    }
+    rq_critical_exit(c, flags);
+}
+
+uint32_t sched_get_priority(const thread_t *t) {
+    return t ? (uint32_t)t->base_priority : 0u;
+}
+
+uint32_t sched_qos_priority(thread_qos_t qos) {
+    switch (qos) {
+    case THREAD_QOS_USER_INTERACTIVE: return SCHED_PRIO_QOS_USER_INTERACTIVE;
+    case THREAD_QOS_USER_INITIATED:   return SCHED_PRIO_QOS_USER_INITIATED;
+    case THREAD_QOS_UTILITY:          return SCHED_PRIO_QOS_UTILITY;
+    case THREAD_QOS_BACKGROUND:       return SCHED_PRIO_QOS_BACKGROUND;
+    default:                          return SCHED_PRIO_DEFAULT;
+    }
+}
+
+bool sched_set_qos(thread_t *t, thread_qos_t qos) {
+    if (!t || is_idle(t) || (uint32_t)qos >= THREAD_QOS_COUNT) {
+        return false;
+    }
+
+    uint64_t flags;
+    sched_cpu_t *c = lock_thread_rq(t, &flags);
+    t->qos = (uint8_t)qos;
+    if (qos != THREAD_QOS_DEFAULT) {
+        t->base_priority = (uint8_t)sched_qos_priority(qos);
+        sched_update_priority(c, t);
+    }
+    rq_critical_exit(c, flags);
+    return true;
+}
+
+thread_qos_t sched_get_qos(const thread_t *t) {
+    return t ? (thread_qos_t)t->qos : THREAD_QOS_DEFAULT;
+}
+
+bool sched_get_stats(const thread_t *t, sched_stats_t *out) {
+    if (!t || !out) {
+        return false;
+    }
+    // Not synchronized with the CPU running `t`: each field is read whole,
+    // but a switch in between can leave one interval counted in neither.
+    *out = t->stats;
+    const uint64_t now = time_now();
+    const uint64_t ready = __atomic_load_n(&t->ready_stamp, __ATOMIC_RELAXED);
+    const uint64_t run = __atomic_load_n(&t->run_stamp, __ATOMIC_RELAXED);
+    if (ready != 0) {
+        if (now > ready) {
+            out->wait_time += now - ready;
+        }
+    } else if (__atomic_load_n(&t->state, __ATOMIC_RELAXED) == THREAD_RUNNING && now > run) {
+        out->run_time += now - run;
+    }
+    return true;
+}
+
+static inline uint64_t us_to_ticks(uint32_t us) {
+    return ((uint64_t)us * time_freq()) / 1000000u;
+}
+
+// Leave the deadline class (period_us == 0 in sched_set_deadline()).
+static void sched_clear_deadline(thread_t *t) {
+    uint64_t flags;
+    sched_cpu_t *c = lock_thread_rq(t, &flags);
+    if (is_edf(t)) {
+        const bool queued = t->on_rq;
+        if (queued) {
+            edf_remove(c, t);
+        }
+        edf_detach(c, t);
+        if (queued) {
+            rq_insert_tail(&c->rq, t);
+            (void)sched_check_preempt(c, t);
+        } else if (t == c->current && rq_has_better(c, t, false)) {
+            sched_resched_cpu(c);
+        }
+        rq_validate(&c->rq);
+    }
+    rq_critical_exit(c, flags);
+}
+
+bool sched_set_deadline(thread_t *t, uint32_t period_us, uint32_t budget_us,
+                        uint32_t deadline_us) {
+    ASSERT_THREAD_CONTEXT();
+    if (!t || is_idle(t)) {
+        return false;
+    }
+    if (period_us == 0) {
+        sched_clear_deadline(t);
+        return true;
+    }
+    if (deadline_us == 0) {
+        deadline_us = period_us;
+    }
+    if (budget_us == 0 || budget_us > deadline_us || deadline_us > period_us ||
+        period_us > SCHED_EDF_PERIOD_MAX_US) {
+        return false;
+    }
+    const uint32_t density =
+        (uint32_t)(((uint64_t)budget_us * SCHED_EDF_UTIL_SCALE) / deadline_us);
+
+    // A thread that has never been queued or run can be admitted on the CPU
+    // (within its affinity) with the most deadline capacity left; others
+    // stay where they are.
+    if (!is_edf(t) && !t->on_rq && !t->on_cpu && t->state == THREAD_READY) {
+        uint32_t best = t->cpu;
+        bool found = cpu_allowed(t, best);
+        for (uint32_t i = 0; i < CONFIG_MAX_CPUS; i++) {
+            if (cpu_allowed(t, i) &&
+                (!found || __atomic_load_n(&s_cpus[i].edf_util, __ATOMIC_RELAXED) <
+                           __atomic_load_n(&s_cpus[best].edf_util, __ATOMIC_RELAXED))) {
+                best = i;
+                found = true;
+            }
+        }
+        __atomic_store_n(&t->cpu, (uint8_t)best, __ATOMIC_RELAXED);
+    }
+
+    uint64_t flags;
+    sched_cpu_t *c = lock_thread_rq(t, &flags);
+    const uint32_t old = is_edf(t) ? t->edf.density : 0u;
+    if (c->edf_util - old + density > SCHED_EDF_UTIL_MAX) {
+        rq_critical_exit(c, flags);
+        return false;
+    }
+
+    const bool queued = t->on_rq;
+    if (queued) {
+        if (is_edf(t)) {
+            edf_remove(c, t);
+        } else {
+            rq_remove(&c->rq, t);
+        }
+    }
+    if (!is_edf(t)) {
+        c->edf_nr++;
+    }
+    c->edf_util = c->edf_util - old + density;
+
+    t->sched_class  = SCHED_CLASS_EDF;
+    t->edf.period   = us_to_ticks(period_us);
+    t->edf.budget   = us_to_ticks(budget_us);
+    t->edf.deadline = us_to_ticks(deadline_us);
+    t->edf.density  = density;
+    const uint64_t now = time_now();
+    edf_replenish(t, now);
+    t->edf.exec_start = now;
+
+    if (queued) {
+        edf_insert(c, t);
+        (void)sched_check_preempt(c, t);
+    }
+    rq_validate(&c->rq);
+    rq_critical_exit(c, flags);
+
+    // Arm budget enforcement if it is running right now.
+    edf_kick(c);
+    return true;
+}
+
+void sched_deadline_yield(void) {
+    ASSERT_THREAD_CONTEXT();
+    uint64_t flags = irq_save();
+    thread_t *cur = this_cpu()->current;
+    if (is_edf(cur)) {
+        const uint64_t now = time_now();
+        edf_charge(cur, now);
+        if (cur->edf.runtime > 0) {
+            edf_throttle(cur, now);
+        }
+    }
+    // Queues us on the release queue until the next period starts.
+    yield();
+    irq_restore(flags);
+}
+
+// What this CPU runs when nothing else can: the bootstrap context until it
+// retires (it stays RUNNING while switched out), then the idle thread.
+static inline thread_t *idle_thread(sched_cpu_t *c) {
+    return c->boot.state == THREAD_RUNNING ? &c->boot : c->idle;
+}
+
+static thread_t *sched_pick_next(sched_cpu_t *c, thread_t *prev) {
+    thread_t *next = rq_pop_head(c);
+    if (next) {
+        return next;
+    }
+    // Nothing ready here. Before idling, steal from the busiest peer.
+    if (is_idle(prev) || prev->state != THREAD_RUNNING) {
+        sched_cpu_t *busiest = find_busiest(c);
+        if (busiest) {
+            next = sched_pull_one(c, busiest, UINT32_MAX);
+            if (next && !(bw_held_back(next) && task_bw_park(&next->task->bw, next))) {
+                return next;
+            }
+        }
+    }
+    // Keep running prev if it can still run; otherwise idle.
+    if (prev->state == THREAD_RUNNING) {
+        return prev;
+    }
+    return idle_thread(c);
+}
+
+// Time slice of each QoS class, in ticks: interactive threads rotate
+// quickly among themselves, batch work switches less often.
+static const uint32_t s_qos_slice[THREAD_QOS_COUNT] = {
+    [THREAD_QOS_DEFAULT]          = CONFIG_SCHED_TIMESLICE_TICKS,
+    [THREAD_QOS_USER_INTERACTIVE] = (CONFIG_SCHED_TIMESLICE_TICKS + 1) / 2,
+    [THREAD_QOS_USER_INITIATED]   = CONFIG_SCHED_TIMESLICE_TICKS,
+    [THREAD_QOS_UTILITY]          = CONFIG_SCHED_TIMESLICE_TICKS * 2,
+    [THREAD_QOS_BACKGROUND]       = CONFIG_SCHED_TIMESLICE_TICKS * 4,
+};
+
+static inline uint32_t qos_slice(const thread_t *t) {
+    return t->qos < THREAD_QOS_COUNT ? s_qos_slice[t->qos] : CONFIG_SCHED_TIMESLICE_TICKS;
+}
+
+// Bookkeeping shared by every switch path once `next` has been chosen.
+// `preempted`: the current thread is being switched away at IRQ exit.
+static inline void sched_switch_in(sched_cpu_t *c, thread_t *next, bool preempted) {
+    const uint64_t now = time_now();
+    stats_switch(c->current, next, now, preempted);
+    // The previous thread was charged by the switch path.
+    next->bw_stamp = now;
+    next->on_cpu = true;
+    next->state = THREAD_RUNNING;
+    // Whatever resume state it had is consumed by this switch.
+    next->resume = THREAD_RESUME_CTX;
+    next->slice_ticks = qos_slice(next);
+    preempt_clear_need_resched();
+    fpsimd_thread_switch(c->current, next);
+    c->current = next;
+    this_cpu_write(current, next);
+#if CONFIG_TICKLESS
+    // Leaving the idle loop: the tick is needed again (slices, balancing).
+    if (!is_idle(next)) {
+        event_tick_restart();
+    }
+#endif
+    if (c->edf_nr != 0) {
+        if (is_edf(next)) {
+            next->edf.exec_start = now;
+        }
+        sched_arm_event(c);
     }
-    return next;
 }
 
 void yield(void) {
     ASSERT_THREAD_CONTEXT();
     uint64_t flags = irq_save();
-    thread_t *prev = s_current;
+    sched_cpu_t *c = this_cpu();
+    thread_t *prev = c->current;
     SCHED_ASSERT(prev != NULL, "sched: current is NULL");
-    SCHED_ASSERT(prev->rq_next == NULL, "sched: current unexpectedly enqueued");
+    SCHED_ASSERT(!prev->on_rq, "sched: current unexpectedly enqueued");
+
+    const uint64_t now = time_now();
+    load_update(prev, now, true);
+    edf_charge(prev, now);
+    (void)bw_charge(prev, now);
+    if (prev->state == THREAD_DEAD && is_edf(prev)) {
+        spin_lock(&c->lock);
+        edf_detach(c, prev);
+        spin_unlock(&c->lock);
+    }
 
-    // Only enqueue non-bootstrap runnable threads.
+    // Only enqueue runnable threads other than the bootstrap and idle ones.
     // Blocked threads must not be re-enqueued.
-    if (prev != &bootstrap_thread && prev->state == THREAD_RUNNING) {
+    if (!is_idle(prev) && prev->state == THREAD_RUNNING) {
         prev->state = THREAD_READY;
-        sched_enqueue(prev);
+        (void)rq_enqueue(prev);
     }
     // THREAD_DEAD and THREAD_BLOCKED are intentionally not enqueued.
-thread_t *next = sched_pick_next();
-    if (!next) {
+    thread_t *next = sched_pick_next(c, prev);
+    if (next == prev) {
+        // Only ourselves to run: treat this as a fresh slice.
+        sched_switch_in(c, prev, false);
         irq_restore(flags);
         return;
     }
 
-    next->state = THREAD_RUNNING;
-    if (next != &bootstrap_thread) {
+    if (!is_idle(next)) {
         SCHED_ASSERT(next->ctx.sp != 0, "sched: next thread has NULL ctx.sp");
     }
-    s_current = next;
+    c->switch_prev = prev;
+    sched_switch_in(c, next, false);
     ctx_switch(&prev->ctx, &next->ctx);
+    // Possibly on another CPU now; `c` is stale.
+    sched_finish_switch();
 
     irq_restore(flags);
 }
@@ -205,45 +1342,393 @@ void sched_block_current(void) {
     ASSERT_THREAD_CONTEXT();
     uint64_t flags = irq_save();
 
-    thread_t *prev = s_current;
+    sched_cpu_t *c = this_cpu();
+    thread_t *prev = c->current;
     SCHED_ASSERT(prev != NULL, "sched: current is NULL");
-    SCHED_ASSERT(prev->rq_next == NULL, "sched: current unexpectedly enqueued");
-    SCHED_ASSERT(prev != &bootstrap_thread, "sched: bootstrap thread must not block");
+    SCHED_ASSERT(!is_idle(prev), "sched: bootstrap/idle thread must not block");
+    // After sched_prepare_block() a wakeup may already have queued us.
+    SCHED_ASSERT(!prev->on_rq || prev->state == THREAD_READY,
+                 "sched: current unexpectedly enqueued");
 
-    prev->state = THREAD_BLOCKED;
+    const uint64_t now = time_now();
+    load_update(prev, now, true);
+    edf_charge(prev, now);
+    (void)bw_charge(prev, now);
 
-    thread_t *next = sched_pick_next();
-    if (!next) {
-        // No other runnable thread; keep running (can't block).
-        prev->state = THREAD_RUNNING;
+    // Under the lock so a wakeup from another CPU sees either RUNNING (and
+    // leaves us alone) or BLOCKED (and queues us).
+    spin_lock(&c->lock);
+    if (prev->state == THREAD_RUNNING) {
+        prev->state = THREAD_BLOCKED;
+    }
+    spin_unlock(&c->lock);
+
+    // With nothing ready we switch to the idle context. prev only comes back
+    // if another CPU already woke it.
+    thread_t *next = sched_pick_next(c, prev);
+    if (next == prev) {
+        sched_switch_in(c, prev, false);
         irq_restore(flags);
         return;
     }
 
-    next->state = THREAD_RUNNING;
-    if (next != &bootstrap_thread) {
+    if (!is_idle(next)) {
         SCHED_ASSERT(next->ctx.sp != 0, "sched: next thread has NULL ctx.sp");
     }
-    s_current = next;
+    c->switch_prev = prev;
+    sched_switch_in(c, next, false);
     ctx_switch(&prev->ctx, &next->ctx);
+    // Possibly on another CPU now; `c` is stale.
+    sched_finish_switch();
 
     irq_restore(flags);
 }
 
-void sched_wake(thread_t *t) {
+// Timeout of sched_block_current_until(), run from the timer interrupt.
+typedef struct block_timeout {
+    ktimer_t  timer;
+    thread_t *thread;
+    volatile bool fired;
+} block_timeout_t;
+
+static void block_timeout_fn(void *arg) {
+    block_timeout_t *bt = (block_timeout_t *)arg;
+    bt->fired = true;
+    sched_wake(bt->thread);
+}
+
+bool sched_block_current_until(uint64_t deadline) {
+    ASSERT_THREAD_CONTEXT();
+    uint64_t flags = irq_save();
+
+    block_timeout_t bt;
+    bt.thread = this_cpu()->current;
+    bt.fired = false;
+    ktimer_init(&bt.timer, block_timeout_fn, &bt);
+    ktimer_arm(&bt.timer, deadline);
+
+    sched_block_current();
+
+    // Once cancel returns the callback is done or will never run, so it can
+    // neither touch `bt` nor wake a later, unrelated block.
+    (void)ktimer_cancel(&bt.timer);
+    irq_restore(flags);
+    return !bt.fired;
+}
+
+void sched_prepare_block(void) {
     ASSERT_THREAD_CONTEXT();
+    SCHED_ASSERT(irq_irqs_disabled(), "sched: prepare_block needs IRQs masked");
+    sched_cpu_t *c = this_cpu();
+    thread_t *cur = c->current;
+    SCHED_ASSERT(cur != NULL && !is_idle(cur), "sched: bootstrap/idle thread must not block");
+
+    spin_lock(&c->lock);
+    cur->state = THREAD_BLOCKED;
+    spin_unlock(&c->lock);
+}
+
+void sched_wake(thread_t *t) {
     if (!t) return;
 
-    uint64_t flags = irq_save();
+    uint64_t flags;
+    sched_cpu_t *c = lock_thread_rq(t, &flags);
 
-    // Only wake genuinely blocked threads.
+    // Only wake genuinely blocked threads. The check is made under the
+    // owning CPU's lock so concurrent wakers cannot both queue the thread.
+    bool kick = false;
+    bool edf_wait = false;
     if (t->state == THREAD_BLOCKED) {
+        const uint64_t now = time_now();
+        load_update(t, now, false);
+        if (is_edf(t)) {
+            // Start a new period unless the rest of the current one still
+            // fits its reserved density: runtime / (deadline - now) must not
+            // exceed budget / relative deadline.
+            if (t->edf.runtime == 0) {
+                if (now >= t->edf.period_start) {
+                    edf_replenish(t, now);
+                }
+            } else if (now >= t->edf.abs_deadline ||
+                       t->edf.runtime * t->edf.deadline >
+                       (t->edf.abs_deadline - now) * t->edf.budget) {
+                edf_replenish(t, now);
+            }
+            edf_wait = t->edf.runtime == 0;
+        }
         t->state = THREAD_READY;
-        sched_enqueue(t);
+        rq_insert(c, t);
+        stats_queued(t, now, true);
+        rq_validate(&c->rq);
+        kick = !sched_check_preempt(c, t) && !is_edf(t);
+    }
+
+    rq_critical_exit(c, flags);
+    if (kick) {
+        sched_kick_idle(c);
+    }
+    if (edf_wait) {
+        edf_kick(c);
+    }
+}
+
+void sched_bw_unpark(thread_t *t) {
+    if (!t) return;
+
+    uint64_t flags;
+    sched_cpu_t *c = lock_thread_rq(t, &flags);
+    SCHED_ASSERT(t->state == THREAD_READY && !t->on_rq, "sched: unpark of a queued thread");
+    // ready_stamp still holds the original queueing: the parked time counts
+    // as waiting.
+    rq_insert(c, t);
+    rq_validate(&c->rq);
+    const bool kick = !sched_check_preempt(c, t);
+    rq_critical_exit(c, flags);
+    if (kick) {
+        sched_kick_idle(c);
+    }
+}
+
+// Pull one thread from the busiest peer when that narrows the load gap.
+// Moving load L changes a gap G to |G - 2L|, so only L < G helps.
+static void sched_rebalance(sched_cpu_t *c) {
+    sched_cpu_t *busiest = find_busiest(c);
+    if (!busiest) {
+        return;
+    }
+    const uint32_t src = cpu_load(busiest);
+    const uint32_t dst = cpu_load(c);
+    if (src <= dst || src - dst < SCHED_BALANCE_MIN_GAP) {
+        return;
+    }
+
+    // Moving load L raises c's scaled load by L * SCALE / capacity.
+    const uint32_t max_load =
+        (uint32_t)(((uint64_t)(src - dst - 1u) * cpu_capacity(c)) / CPU_CAPACITY_SCALE);
+    thread_t *t = sched_pull_one(c, busiest, max_load);
+    if (!t) {
+        return;
+    }
+    spin_lock(&c->lock);
+    rq_insert_tail(&c->rq, t);
+    rq_validate(&c->rq);
+    (void)sched_check_preempt(c, t);
+    spin_unlock(&c->lock);
+}
+
+// Charge the tick to the background band if it ran, and start a new
+// throttling window when this one is over.
+static inline void bg_tick(sched_cpu_t *c, const thread_t *cur) {
+    if (!is_idle(cur) && !is_edf(cur) && cur->priority <= SCHED_PRIO_QOS_BACKGROUND) {
+        c->bg_ticks++;
+    }
+    if (++c->bg_window >= CONFIG_SCHED_BG_WINDOW_TICKS) {
+        c->bg_window = 0;
+        c->bg_ticks = 0;
+    }
+}
+
+void sched_tick(void) {
+    ASSERT_IRQ_CONTEXT();
+    sched_cpu_t *c = this_cpu();
+    thread_t *cur = c->current;
+    if (!cur) {
+        return;
+    }
+
+    // Keep the running thread's load current for the balancer.
+    const uint64_t now = time_now();
+    load_update(cur, now, true);
+    const bool bw_out = bw_charge(cur, now);
+    bg_tick(c, cur);
+    if (++c->balance_ticks >= CONFIG_SCHED_BALANCE_TICKS) {
+        c->balance_ticks = 0;
+        sched_rebalance(c);
+#if CONFIG_TICKLESS
+        // Idle peers have stopped their tick and never balance on their own:
+        // hand them our backlog.
+        if (c->rq.nr_ready > 0) {
+            sched_kick_idle(c);
+        }
+#endif
+    }
+
+#if CONFIG_SCHED_COOPERATIVE
+    // Cooperative IRQ exit never switches: only idle is subject to tick
+    // resched, and it hands off from its own loop (yield() once WFI returns).
+    if (!is_idle(cur)) {
+        return;
+    }
+#else
+    // Deadline threads are limited by their budget, not a slice.
+    if (!is_idle(cur) && !is_edf(cur) && cur->slice_ticks > 0) {
+        cur->slice_ticks--;
+    }
+#endif
+
+    spin_lock(&c->lock);
+    // An expired slice also rotates among equal priorities; a throttled
+    // background thread gives way even if nothing else is ready.
+    const bool resched = bw_out || bg_held_back(c, cur) ||
+                         rq_has_better(c, cur, !is_edf(cur) && cur->slice_ticks == 0);
+    spin_unlock(&c->lock);
+    if (resched) {
+        preempt_set_need_resched();
+    }
+}
+
+void sched_deadline_event(void) {
+    ASSERT_IRQ_CONTEXT();
+    sched_cpu_t *c = this_cpu();
+    thread_t *cur = c->current;
+    if (!cur || c->edf_nr == 0) {
+        // The one-shot may still be needed by the kernel timers.
+        sched_arm_event(c);
+        return;
+    }
+
+    const uint64_t now = time_now();
+    edf_charge(cur, now);
+    spin_lock(&c->lock);
+    edf_release_due(c, now);
+    const bool resched = edf_throttled(cur) || rq_has_better(c, cur, false);
+    spin_unlock(&c->lock);
+    if (resched) {
+        preempt_set_need_resched();
+    }
+    sched_arm_event(c);
+}
+
+// Which interrupt ended a WFI: IRQs are still masked, so it is still
+// pending at the GIC.
+static sched_idle_wake_t idle_wake_reason(void) {
+    const uint32_t irq = gicv2_highest_pending();
+    if (irq == TIMER_PPI_IRQ) {
+        return SCHED_IDLE_WAKE_TIMER;
+    }
+    if (irq < 16u) {
+        return SCHED_IDLE_WAKE_IPI;
+    }
+    if (irq < 1020u) {
+        return SCHED_IDLE_WAKE_DEVICE;
     }
+    return SCHED_IDLE_WAKE_OTHER;
+}
 
+// Sleep until the next interrupt unless there is something to run.
+static void sched_idle_wait(sched_cpu_t *c) {
+    uint64_t flags = irq_save();
+    spin_lock(&c->lock);
+    const bool has_work = rq_eligible(c) != 0 || !dlq_empty(&c->edf_ready);
+    // Throttled background work only needs the tick to end the window.
+    const bool bg_waiting = c->rq.nr_ready != 0;
+    spin_unlock(&c->lock);
+    if (has_work || preempt_need_resched()) {
+        irq_restore(flags);
+        return;
+    }
+#if CONFIG_TICKLESS
+    if (!bg_waiting) {
+        // Nothing to do until an interrupt: stop the tick and let the timer
+        // fire only for the next pending deadline (if any). The band has
+        // nothing to catch up on once the CPU has gone idle.
+        event_tick_stop();
+        sched_arm_event(c);
+        c->bg_ticks = 0;
+        c->bg_window = 0;
+    }
+#else
+    (void)bg_waiting;
+#endif
+    const uint64_t start = time_now();
+    __atomic_store_n(&c->idle_enter, start, __ATOMIC_RELAXED);
+    // WFI wakes on a pending interrupt even while it is masked; it is taken
+    // once irq_restore() unmasks, so no wakeup is lost in between.
+    __asm__ volatile("wfi");
+    const uint64_t now = time_now();
+    __atomic_store_n(&c->idle_enter, 0, __ATOMIC_RELAXED);
+    sched_idle_stats_t *st = &c->idle_stats;
+    st->idle_time += now - start;
+    st->nr_idle++;
+    st->wakeups[idle_wake_reason()]++;
     irq_restore(flags);
 }
+
+static void idle_entry(void *arg) {
+    sched_cpu_t *c = (sched_cpu_t *)arg;
+    for (;;) {
+        sched_idle_wait(c);
+        yield();
+    }
+}
+
+void sched_exit_bootstrap(void) {
+    ASSERT_THREAD_CONTEXT();
+    sched_cpu_t *c = this_cpu();
+    SCHED_ASSERT(c->current == &c->boot, "sched: exit_bootstrap off the bootstrap context");
+
+    thread_attr_t attr = THREAD_ATTR_INIT;
+    attr.name = "idle";
+    attr.priority = SCHED_PRIO_IDLE;
+    attr.affinity = 1u << cpu_index(c);
+    thread_t *idle = thread_create_ex(&attr, idle_entry, c);
+    if (!idle) {
+        panic("sched: cannot create idle thread");
+    }
+    idle->flags |= THREAD_F_IDLE;
+
+    (void)irq_save();
+    c->idle = idle;
+    // Never resumed: from now on sched_pick_next() falls back to the idle
+    // thread. The bootstrap stack stays in place (it is the boot stack).
+    c->boot.state = THREAD_DEAD;
+    yield();
+    panic("sched: retired bootstrap context resumed");
+}
+
+bool sched_get_idle_stats(uint32_t cpu, sched_idle_stats_t *out) {
+    if (cpu >= CONFIG_MAX_CPUS || !out) {
+        return false;
+    }
+    // Not synchronized with `cpu`: like sched_get_stats(), a wakeup racing
+    // with the copy may leave one interval counted in neither.
+    const sched_cpu_t *c = &s_cpus[cpu];
+    *out = c->idle_stats;
+    const uint64_t enter = __atomic_load_n(&c->idle_enter, __ATOMIC_RELAXED);
+    const uint64_t now = time_now();
+    if (enter != 0 && now > enter) {
+        out->idle_time += now - enter;
+    }
+    return true;
+}
+
+#if !CONFIG_SCHED_COOPERATIVE
+// Return the frame the IRQ exit path should restore to run `t`.
+static trap_frame_t *sched_resume_frame(thread_t *t) {
+    if (t->resume == THREAD_RESUME_IRQ) {
+        sched_validate_irq_sp(t);
+        return (trap_frame_t *)(uintptr_t)t->irq_sp;
+    }
+
+    // Cooperatively suspended: build a one-shot frame below its saved SP.
+    // eret lands in thread_ctx_resume(&t->ctx), which reloads the callee-saved
+    // context and returns into yield()/sched_block_current() as ctx_switch()
+    // would have.
+    SCHED_ASSERT(t->ctx.sp != 0, "sched: resume of thread with NULL ctx.sp");
+    uintptr_t sp = (uintptr_t)t->ctx.sp & ~(uintptr_t)0xF;
+    trap_frame_t *f = (trap_frame_t *)(sp - sizeof(trap_frame_t));
+    if (!is_idle(t)) {
+        SCHED_ASSERT((uintptr_t)f >= (uintptr_t)t->kstack_base, "sched: no room for resume frame");
+    }
+    memset(f, 0, sizeof(*f));
+    f->x[0]        = (uint64_t)(uintptr_t)&t->ctx;
+    f->elr_el1     = (uint64_t)(uintptr_t)&thread_ctx_resume;
+    f->spsr_el1    = (uint64_t)SPSR_EL1H_IRQ_MASKED;
+    f->sp_at_fault = (uint64_t)sp;
+    return f;
+}
+#endif
+
 trap_frame_t *sched_irq_exit(trap_frame_t *tf) {
     /*
      * Preemption-readiness audit.
@@ -251,20 +1736,21 @@ trap_frame_t *sched_irq_exit(trap_frame_t *tf) {
      * Contract:
      *  - IRQs remain masked across irq_dispatch() and this hook.
      *  - The IRQ exit path restores register state from whatever SP points at
-     *    and then executes an ERET. A future preemptive scheduler may switch threads
+     *    and then executes an ERET. The preemptive scheduler switches threads
      *    by returning a different trap frame pointer here.
      */
     SCHED_ASSERT(irq_irqs_disabled(), "sched: IRQs must be masked in sched_irq_exit");
     SCHED_ASSERT(tf != NULL, "sched: NULL trap frame");
 
-    thread_t *cur = s_current;
+    sched_cpu_t *c = this_cpu();
+    thread_t *cur = c->current;
     // The timer/IRQ subsystem can be brought up before cooperative threads.
     // In that early-boot window there is no "current" thread to tag; just
     // preserve the IRQ return frame unchanged.
     if (cur == NULL) {
         return tf;
     }
-    SCHED_ASSERT(cur->rq_next == NULL, "sched: current unexpectedly enqueued in irq exit");
+    SCHED_ASSERT(!cur->on_rq, "sched: current unexpectedly enqueued in irq exit");
 
     /*
      * Always keep a pointer to the most recent trap for debugging/introspection.
@@ -278,7 +1764,11 @@ trap_frame_t *sched_irq_exit(trap_frame_t *tf) {
     cur->last_trap = tf;
 
     /* Queue integrity checks are safe here because IRQs are still masked. */
-    rq_validate();
+#if SCHED_DEBUG
+    spin_lock(&c->lock);
+    rq_validate(&c->rq);
+    spin_unlock(&c->lock);
+#endif
 
 #if CONFIG_SCHED_COOPERATIVE
     /*
@@ -288,8 +1778,62 @@ trap_frame_t *sched_irq_exit(trap_frame_t *tf) {
      */
     return tf;
 #else
-    /* When preemptive scheduling is enabled this hook may return a different trap frame. */
-    return tf;
+    /*
+     * Preemptive scheduling: switch only when a reschedule was requested (time
+     * slice expired) and the interrupted code did not disable preemption.
+     * irq_dispatch() already dropped the IRQ depth, so nesting is not a concern.
+     */
+    if (!preempt_need_resched() || !preemptible()) {
+        return tf;
+    }
+
+    const uint64_t now = time_now();
+    edf_charge(cur, now);
+    (void)bw_charge(cur, now);
+
+    // Never hand the CPU to a lower priority (or later deadline) than the
+    // interrupted thread; equals rotate.
+    spin_lock(&c->lock);
+    if (c->edf_nr != 0) {
+        edf_release_due(c, now);
+    }
+    thread_t *next = NULL;
+    const bool held = edf_throttled(cur) || bg_held_back(c, cur) || bw_held_back(cur);
+    if (held || rq_has_better(c, cur, true)) {
+        next = rq_take_next(c);
+    }
+    spin_unlock(&c->lock);
+    if (!next) {
+        if (!held) {
+            // Nothing eligible is ready; give the current thread a fresh slice.
+            sched_switch_in(c, cur, true);
+            return tf;
+        }
+        // Out of budget (or throttled) and nothing else ready: idle until
+        // its release (or the next throttling window).
+        next = idle_thread(c);
+    }
+
+    // Pin the interrupted thread's frame. It resumes by restoring it, either
+    // from a later IRQ exit (irq_sp) or from ctx_switch() via thread_irq_resume.
+    cur->irq_sp  = (uint64_t)(uintptr_t)tf;
+    cur->resume  = THREAD_RESUME_IRQ;
+    cur->ctx.sp  = cur->irq_sp;
+    cur->ctx.x30 = (uint64_t)(uintptr_t)&thread_irq_resume;
+    sched_validate_irq_sp(cur);
+
+    load_update(cur, now, true);
+    if (!is_idle(cur) && cur->state == THREAD_RUNNING) {
+        cur->state = THREAD_READY;
+        (void)rq_enqueue(cur);
+    }
+
+    // The exception return path calls sched_finish_switch() once SP is on
+    // next's frame.
+    trap_frame_t *next_tf = sched_resume_frame(next);
+    c->switch_prev = cur;
+    sched_switch_in(c, next, true);
+    return next_tf;
 #endif
 }
 
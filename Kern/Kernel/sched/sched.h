@@ -7,13 +7,87 @@
 #endif
 
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #include "thread.h"
 
-// Initialize scheduler state for the currently running context (kmain/bootstrap thread).
+// Initialize the calling CPU's scheduler state; the running context (kmain on
+// CPU0, smp_secondary_main elsewhere) becomes that CPU's bootstrap thread,
+// which runs whenever nothing else is ready until it retires.
 void sched_init_bootstrap(void);
 
-// Add a thread to the ready queue.
-void sched_enqueue(thread_t *t);
+// Retire the bootstrap context at the end of CPU bring-up: create this CPU's
+// idle thread and switch away for good. From then on the idle thread runs
+// whenever the ready queue is empty; it is never queued itself.
+__attribute__((noreturn)) void sched_exit_bootstrap(void);
+
+// Why a CPU left WFI: the interrupt pending when it woke.
+typedef enum sched_idle_wake {
+    SCHED_IDLE_WAKE_TIMER = 0, // tick or one-shot timer event
+    SCHED_IDLE_WAKE_IPI,       // SGI (reschedule request from a peer)
+    SCHED_IDLE_WAKE_DEVICE,    // PPI/SPI other than the timer
+    SCHED_IDLE_WAKE_OTHER,     // nothing pending any more (spurious)
+    SCHED_IDLE_WAKE_COUNT,
+} sched_idle_wake_t;
+
+// Per-CPU idle accounting, in counter ticks. Utilisation over the window is
+// 1 - idle_time / (time_now() - since).
+typedef struct sched_idle_stats {
+    uint64_t idle_time;                        // time spent in WFI
+    uint64_t nr_idle;                          // WFI entries
+    uint64_t wakeups[SCHED_IDLE_WAKE_COUNT];   // WFI exits by reason
+    uint64_t since;                            // counter value accounting started
+} sched_idle_stats_t;
+
+// Snapshot CPU `cpu`'s idle accounting, including a WFI in progress. Any
+// context; approximate for a CPU other than the caller's. Returns false for
+// an out-of-range CPU or a NULL argument.
+bool sched_get_idle_stats(uint32_t cpu, sched_idle_stats_t *out);
+
+// Add a thread to the ready queue at `priority` (SCHED_PRIO_MIN..SCHED_PRIO_MAX).
+void sched_enqueue(thread_t *t, uint32_t priority);
+
+// Change a thread's (base) priority; a queued thread moves to the tail of its
+// new level. Returns false for an invalid thread or priority.
+// sched_get_priority() returns the base priority, without inheritance.
+bool sched_set_priority(thread_t *t, uint32_t priority);
+uint32_t sched_get_priority(const thread_t *t);
+
+// Put `t` in a QoS class. Any class but THREAD_QOS_DEFAULT replaces its base
+// priority with the class's (SCHED_PRIO_QOS_*); DEFAULT keeps the current
+// one. The new time slice applies from the thread's next switch-in. Returns
+// false for an invalid thread or class.
+bool sched_set_qos(thread_t *t, thread_qos_t qos);
+thread_qos_t sched_get_qos(const thread_t *t);
+
+// Base priority of QoS class `qos` (SCHED_PRIO_DEFAULT for DEFAULT).
+uint32_t sched_qos_priority(thread_qos_t qos);
+
+// Priority inheritance (sync/mutex.c): `t` runs at no less than `priority`
+// until this is called again with a lower value (SCHED_PRIO_MIN drops the
+// boost). Thread or IRQ context; not the idle thread.
+void sched_set_inherited_priority(thread_t *t, uint32_t priority);
+
+// Snapshot `t`'s scheduler accounting (run/wait time, switch counts and the
+// wake-to-run latency histogram), including the interval in progress. Any
+// context; the counters of a thread running elsewhere are approximate.
+// Returns false for a NULL argument.
+bool sched_get_stats(const thread_t *t, sched_stats_t *out);
+
+// Move a thread into the deadline (EDF) class: it is guaranteed `budget_us`
+// of CPU time in every `period_us`, finished within `deadline_us` of each
+// period start (0: same as the period). Deadline threads run ahead of all
+// priority-class threads and stay on the CPU that admitted them.
+// period_us == 0 returns the thread to the priority class. Returns false for
+// invalid parameters (budget <= deadline <= period <= SCHED_EDF_PERIOD_MAX_US)
+// or if the CPU's deadline capacity (CONFIG_SCHED_EDF_MAX_UTIL_PCT) is taken.
+bool sched_set_deadline(thread_t *t, uint32_t period_us, uint32_t budget_us,
+                        uint32_t deadline_us);
+
+// End the current period's job: a deadline thread gives up its remaining
+// budget and sleeps until its next period starts. Plain yield() otherwise.
+void sched_deadline_yield(void);
 
 // Cooperative yield: switch to the next runnable thread (if any).
 void yield(void);
@@ -22,19 +96,53 @@ void yield(void);
 // Thread context only. The thread remains blocked until woken via sched_wake().
 void sched_block_current(void);
 
-// Wake a blocked thread (moves it to ready queue).
+// sched_block_current() with a timeout: also woken when the counter reaches
+// `deadline` (time_now() units). Returns false if the timeout fired. May be
+// preceded by sched_prepare_block() like sched_block_current().
+bool sched_block_current_until(uint64_t deadline);
+
+// Mark the current thread BLOCKED ahead of sched_block_current(), with IRQs
+// masked. Lets a caller publish itself as a waiter and drop its own lock
+// before blocking: a wakeup in between makes the block return at once.
+void sched_prepare_block(void);
+
+// Wake a blocked thread (moves it to ready queue). Thread or IRQ context.
 void sched_wake(thread_t *t);
 
+// Timer-tick hook (IRQ context). Updates the running thread's load, runs the
+// periodic load balancer and, in preemptive mode, charges the time slice and
+// requests a reschedule once it is used up and another thread is ready.
+void sched_tick(void);
+
+// Deadline-class timer hook (IRQ context: timer interrupt and reschedule
+// IPI). Charges the running thread's budget, releases threads whose period
+// started and re-arms the CPU's one-shot timer event (shared with the kernel
+// timers, so it runs after ktimer_run()).
+void sched_deadline_event(void);
+
+// Completes a thread switch on the calling CPU: the thread switched away from
+// may now be migrated. Called with IRQs masked from every path that starts
+// running a thread (after ctx_switch(), thread_start, the IRQ return path).
+void sched_finish_switch(void);
+
+// Requeue a thread parked by CPU bandwidth control (sched/bandwidth.c) once
+// its task's quota is refilled. Any context.
+void sched_bw_unpark(thread_t *t);
+
+// Total number of threads moved between CPUs by the load balancer.
+uint64_t sched_migrations(void);
+
 /*
  * Called from the IRQ exception path just before restoring the trap frame.
  *
- * Today this hook records the current thread's most recent trap frame pointer
- * and re-validates scheduler invariants while IRQs are masked.
+ * Records the current thread's most recent trap frame pointer and re-validates
+ * scheduler invariants while IRQs are masked.
  *
- * A future preemptive scheduler may use this hook to return a different trap
- * frame pointer in order to resume a different thread on IRQ return.
+ * With CONFIG_SCHED_COOPERATIVE=0, a pending reschedule is honoured here when
+ * preempt_count is zero: the interrupted thread's frame is pinned (irq_sp)
+ * and the frame of the next thread is returned instead.
  */
 trap_frame_t *sched_irq_exit(trap_frame_t *tf);
 
-// Return the currently running thread (bootstrap thread included).
+// Return the thread running on the calling CPU (bootstrap thread included).
 thread_t *sched_current(void);
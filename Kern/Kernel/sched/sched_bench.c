@@ -0,0 +1,122 @@
+// OS/Kern/Kernel/sched/sched_bench.c
+//
+// Scheduler scaling benchmark (see sched_bench.h).
+//
+// Each batch runs `n` workers with a fixed amount of work for n = 1, 2, 4, ...
+// up to twice the online CPU count. With perfect balancing a batch of n <=
+// CPUs workers takes as long as a single one, so the reported speedup
+// n * T(1) / T(n) should approach min(n, CPUs).
+
+#include "sched/sched_bench.h"
+
+#include <stdint.h>
+
+#include "config.h"
+#include "panic.h"
+#include "sched.h"
+#include "smp/smp.h"
+#include "timer_generic.h"
+#include "uart_pl011.h"
+
+#define BENCH_ITERS       (4u << 20)   // work per worker
+#define BENCH_YIELD_MASK  0xFFFu       // cooperative mode: yield every 4096 iterations
+#define BENCH_MAX_WORKERS (2u * CONFIG_MAX_CPUS)
+
+static volatile uint32_t s_done;
+static volatile uint64_t s_sink;
+
+static void bench_worker(void *arg)
+{
+    (void)arg;
+    uint64_t x = 0x9E3779B97F4A7C15ull;
+    for (uint32_t i = 0; i < BENCH_ITERS; i++) {
+        // xorshift64: cheap, register-only work the compiler cannot fold.
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+#if CONFIG_SCHED_COOPERATIVE
+        if ((i & BENCH_YIELD_MASK) == 0) {
+            yield();
+        }
+#endif
+    }
+    s_sink = x;
+    __atomic_fetch_add(&s_done, 1u, __ATOMIC_RELEASE);
+}
+
+// Wall time in counter ticks for `n` workers to finish.
+static uint64_t bench_run(uint32_t n)
+{
+    thread_t *w[BENCH_MAX_WORKERS];
+    __atomic_store_n(&s_done, 0u, __ATOMIC_RELAXED);
+
+    const uint64_t start = time_now();
+    for (uint32_t i = 0; i < n; i++) {
+        w[i] = thread_create_named("bench", bench_worker, NULL, SCHED_PRIO_DEFAULT);
+        thread_set_joinable(w[i]);
+        sched_enqueue(w[i], w[i]->priority);
+    }
+    while (__atomic_load_n(&s_done, __ATOMIC_ACQUIRE) < n) {
+        yield();
+    }
+    const uint64_t elapsed = time_now() - start;
+
+    for (uint32_t i = 0; i < n; i++) {
+        thread_join(w[i]);
+    }
+    return elapsed;
+}
+
+static void bench_put_fixed2(uint64_t v100)
+{
+    uart_putu64_dec(v100 / 100u);
+    uart_putc('.');
+    if (v100 % 100u < 10u) {
+        uart_putc('0');
+    }
+    uart_putu64_dec(v100 % 100u);
+}
+
+static void bench_thread_entry(void *arg)
+{
+    (void)arg;
+    const uint32_t cpus = smp_num_cpus();
+    const uint64_t freq = time_freq();
+
+    uart_puts("SCHED bench: ");
+    uart_putu64_dec(cpus);
+    uart_puts(" CPU(s), ");
+    uart_putu64_dec(BENCH_ITERS);
+    uart_puts(" iterations/worker\n");
+
+    uint64_t t1 = 0;
+    for (uint32_t n = 1; n <= 2u * cpus && n <= BENCH_MAX_WORKERS; n *= 2u) {
+        const uint64_t migr0 = sched_migrations();
+        const uint64_t t = bench_run(n);
+        if (n == 1) {
+            t1 = t;
+        }
+
+        uart_puts("  workers=");
+        uart_putu64_dec(n);
+        uart_puts(" time_us=");
+        uart_putu64_dec(freq ? (t * 1000000u) / freq : 0u);
+        uart_puts(" speedup=");
+        bench_put_fixed2(t ? ((uint64_t)n * t1 * 100u) / t : 0u);
+        uart_puts(" migrations=");
+        uart_putu64_dec(sched_migrations() - migr0);
+        uart_putnl();
+    }
+}
+
+void sched_bench_start(void)
+{
+    // Below the workers: in cooperative mode the polling loop must not win
+    // every yield() on its own CPU.
+    thread_t *t = thread_create_named("sched/bench", bench_thread_entry, NULL,
+                                      SCHED_PRIO_DEFAULT - 1u);
+    if (!t) {
+        panic("sched_bench: failed to create thread");
+    }
+    sched_enqueue(t, t->priority);
+}
@@ -0,0 +1,12 @@
+// OS/Kern/Kernel/sched/sched_bench.h
+//
+// Scheduler scaling benchmark (CONFIG_SCHED_BENCH=1).
+//
+// Runs batches of identical CPU-bound workers and prints how the wall time of
+// each batch compares with a single worker, to show how well the load
+// balancer spreads work over the online CPUs (QEMU: -smp 4 / -smp 8).
+
+#pragma once
+
+// Spawn the benchmark thread. It reports over the UART and exits.
+void sched_bench_start(void);
@@ -13,8 +13,11 @@
 
 // Preemption-ready threads can resume via an IRQ-return trap frame.
 #include "irq.h"
+#include "alloc/kstack_cache.h"
 #include "alloc/slab_cache.h"
-#include "mm/pmm.h"
+#include "smp/smp.h"
+#include "sync/spinlock.h"
+#include "timer_generic.h"
 
 // AArch64 SPSR value for returning to EL1h with IRQs enabled.
 //
@@ -35,9 +38,11 @@ extern void thread_start(void);
 
 static uint32_t s_next_tid = 1;
 
-
-
-
+// Reaper: exited threads that nobody joins wait on s_zombies until the reaper
+// thread frees them. The lock also orders thread_exit() against thread_join().
+static spinlock_t g_reap_lock = SPINLOCK_INIT;
+static thread_t *s_zombies;
+static thread_t *s_reaper;
 
 // Slab cache for thread_t objects (kernel objects).
 static slab_cache_t g_thread_cache;
@@ -83,7 +88,7 @@ static uintptr_t thread_build_initial_irq_frame(thread_t *t, void (*entry)(void
     // Make ELR point at the C trampoline so it can call entry(arg) then exit.
     tf->x[0] = (uint64_t)(uintptr_t)entry;
     tf->x[1] = (uint64_t)(uintptr_t)arg;
-    // Future: first-run/resume can use the IRQ-return (eret-based) frame.
+    // First run from a preempting IRQ exit uses this eret-based frame.
     // Seed ELR/SPSR so the thread starts at thread_trampoline(entry, arg) with
     // IRQs enabled in the restored PSTATE.
     tf->elr_el1  = (uint64_t)(uintptr_t)thread_trampoline;
@@ -103,40 +108,94 @@ static uintptr_t thread_build_initial_irq_frame(thread_t *t, void (*entry)(void
 }
 
 thread_t *thread_create(void (*entry)(void *), void *arg) {
-    return thread_create_named(NULL, entry, arg);
+    return thread_create_named(NULL, entry, arg, SCHED_PRIO_DEFAULT);
 }
 
-thread_t *thread_create_named(const char *name, void (*entry)(void *), void *arg) {
-    
-    ASSERT_THREAD_CONTEXT();
-if (!entry) {
+thread_t *thread_create_named(const char *name, void (*entry)(void *), void *arg,
+                              uint32_t priority) {
+    if (!entry) {
         panic("thread_create: entry is NULL");
     }
+    if (priority > SCHED_PRIO_MAX) {
+        panic("thread_create: priority out of range");
+    }
+    thread_attr_t attr = THREAD_ATTR_INIT;
+    attr.name = name;
+    attr.priority = priority;
+    thread_t *t = thread_create_ex(&attr, entry, arg);
+    if (!t) {
+        panic("thread_create: out of memory");
+    }
+    return t;
+}
+
+void thread_attr_init(thread_attr_t *attr) {
+    if (!attr) return;
+    *attr = (thread_attr_t)THREAD_ATTR_INIT;
+}
+
+bool thread_attr_valid(const thread_attr_t *a) {
+    if (!a) return false;
+    if (a->stack_pages < KSTACK_PAGES_MIN || a->stack_pages > KSTACK_PAGES_MAX ||
+        a->priority > SCHED_PRIO_MAX || a->qos >= THREAD_QOS_COUNT) {
+        return false;
+    }
+    // The affinity must name a CPU that can run the thread (before
+    // smp_init(), only the boot CPU can).
+    if (smp_num_cpus() == 0) {
+        return (a->affinity & (1u << cpu_id())) != 0;
+    }
+    for (uint32_t cpu = 0; cpu < CONFIG_MAX_CPUS; cpu++) {
+        if ((a->affinity & (1u << cpu)) && smp_cpu_online(cpu)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+thread_t *thread_create_ex(const thread_attr_t *attr, void (*entry)(void *), void *arg) {
+    ASSERT_THREAD_CONTEXT();
+    const thread_attr_t defaults = THREAD_ATTR_INIT;
+    if (!attr) {
+        attr = &defaults;
+    }
+    if (!entry || !thread_attr_valid(attr)) {
+        return NULL;
+    }
 
     // Allocate the thread object.
     thread_t *t = (thread_t *)slab_alloc(&g_thread_cache);
     if (!t) {
-        panic("thread_create: OOM thread_t");
+        return NULL;
     }
     memset(t, 0, sizeof(*t));
 
-    t->tid = s_next_tid++;
-    t->name = name;
-    t->task = NULL;
-
-    // Allocate a per-thread kernel stack from PMM pages.
-    // Default: 16 KiB (4 pages). This remains a per-thread contract.
-    const uint32_t pages = (uint32_t)KSTACK_PAGES_DEFAULT;
-    uint64_t stack_pa = 0;
-    if (!pmm_alloc_pages(pages, &stack_pa)) {
+    // Take a per-thread kernel stack: the default size from the stack cache
+    // (PMM-backed), anything else straight from the PMM.
+    void *stack_va = kstack_alloc_pages(attr->stack_pages);
+    if (!stack_va) {
         slab_free(&g_thread_cache, t);
-        panic("thread_create: OOM stack pages");
+        return NULL;
     }
-
-    void *stack_va = (void *)pmm_phys_to_virt(stack_pa);
-    const size_t stack_size = (size_t)pages * (size_t)KSTACK_PAGE_SIZE;
+    const size_t stack_size = (size_t)attr->stack_pages * KSTACK_PAGE_SIZE;
     void *stack_top = (void *)((uintptr_t)stack_va + stack_size);
 
+    t->tid = __atomic_fetch_add(&s_next_tid, 1u, __ATOMIC_RELAXED);
+    t->name = attr->name;
+    t->task = NULL;
+    // A QoS class brings its own priority.
+    const uint32_t priority = attr->qos == THREAD_QOS_DEFAULT ?
+                              attr->priority : sched_qos_priority(attr->qos);
+    t->priority = (uint8_t)priority;
+    t->base_priority = (uint8_t)priority;
+    t->qos = (uint8_t)attr->qos;
+    t->affinity = attr->affinity;
+    t->cpu = (uint8_t)cpu_id();
+    // New threads count as fully busy until they have a history.
+    t->load = SCHED_LOAD_SCALE;
+    t->load_stamp = time_now();
+    t->fp_cpu = THREAD_FP_CPU_NONE;
+
     // 16-byte align the initial SP (AAPCS64).
     uint64_t sp = align_down_u64((uint64_t)(uintptr_t)stack_top, 16u);
 
@@ -160,35 +219,159 @@ if (!entry) {
 
     t->state = THREAD_READY;
     t->saved_daif = 0; // default: IRQs unmasked
+    // Both ctx and the initial frame are valid; a first run from IRQ exit
+    // consumes the frame, a first run from ctx_switch() goes via thread_start.
+    t->resume = THREAD_RESUME_IRQ;
     return t;
 }
 
 __attribute__((noreturn)) void thread_exit(void) {
-    // Cooperative exit: mark dead and yield to another runnable thread.
     thread_t *t = sched_current();
-    if (t) {
-        t->state = THREAD_DEAD;
+    if (!t || (t->flags & THREAD_F_IDLE)) {
+        panic("thread_exit: no thread to exit");
     }
 
+    // IRQs stay masked until we are switched away for good, so nobody can
+    // preempt a thread that is already queued for freeing.
+    (void)irq_save();
+    spin_lock(&g_reap_lock);
+    t->exited = true;
+    thread_t *joiner = t->joiner;
+    t->joiner = NULL;
+    const bool reap = (t->flags & THREAD_F_JOINABLE) == 0;
+    if (reap) {
+        t->zombie_next = s_zombies;
+        s_zombies = t;
+    }
+    spin_unlock(&g_reap_lock);
+
+    // Whoever frees us waits for on_cpu to clear, i.e. for this switch away.
+    t->state = THREAD_DEAD;
+    if (joiner) {
+        sched_wake(joiner);
+    }
+    if (reap) {
+        sched_wake(s_reaper);
+    }
+
+    // A dead thread is never picked again.
     for (;;) {
         yield();
-        // If nothing else is runnable, yield() returns immediately.
-        __asm__ volatile("wfi");
     }
 }
 
-// Explicit teardown path for thread objects (for future use).
+// Free `t` once the switch away from it has completed on its CPU.
+static void thread_reap(thread_t *t) {
+    while (__atomic_load_n(&t->on_cpu, __ATOMIC_ACQUIRE)) {
+        yield();
+    }
+    thread_destroy(t);
+}
+
+static void reaper_entry(void *arg) {
+    (void)arg;
+    for (;;) {
+        uint64_t flags = spin_lock_irqsave(&g_reap_lock);
+        thread_t *list = s_zombies;
+        s_zombies = NULL;
+        if (!list) {
+            // Blocked before the lock drops: an exit in between wakes us.
+            sched_prepare_block();
+            spin_unlock(&g_reap_lock);
+            sched_block_current();
+            irq_restore(flags);
+            continue;
+        }
+        spin_unlock_irqrestore(&g_reap_lock, flags);
+
+        while (list) {
+            thread_t *t = list;
+            list = t->zombie_next;
+            thread_reap(t);
+        }
+    }
+}
+
+void thread_reaper_start(void) {
+    thread_t *t = thread_create_named("sched/reaper", reaper_entry, NULL,
+                                      SCHED_PRIO_DEFAULT);
+    s_reaper = t;
+    sched_enqueue(t, t->priority);
+}
+
+void thread_set_joinable(thread_t *t) {
+    if (!t) return;
+    t->flags |= THREAD_F_JOINABLE;
+}
+
+void thread_detach(thread_t *t) {
+    if (!t) return;
+    uint64_t flags = spin_lock_irqsave(&g_reap_lock);
+    if (!(t->flags & THREAD_F_JOINABLE)) {
+        spin_unlock_irqrestore(&g_reap_lock, flags);
+        return;
+    }
+    t->flags &= ~THREAD_F_JOINABLE;
+    // Already exited: thread_exit() left it for a joiner, so queue it now.
+    const bool reap = t->exited;
+    if (reap) {
+        t->zombie_next = s_zombies;
+        s_zombies = t;
+    }
+    spin_unlock_irqrestore(&g_reap_lock, flags);
+    if (reap) {
+        sched_wake(s_reaper);
+    }
+}
+
+void thread_join(thread_t *t) {
+    ASSERT_THREAD_CONTEXT();
+    thread_t *cur = sched_current();
+    if (!t || t == cur || !(t->flags & THREAD_F_JOINABLE)) {
+        panic("thread_join: thread is not joinable");
+    }
+
+    for (;;) {
+        uint64_t flags = spin_lock_irqsave(&g_reap_lock);
+        if (t->exited) {
+            spin_unlock_irqrestore(&g_reap_lock, flags);
+            break;
+        }
+        t->joiner = cur;
+        sched_prepare_block();
+        spin_unlock(&g_reap_lock);
+        sched_block_current();
+        irq_restore(flags);
+    }
+    thread_reap(t);
+}
+
+void thread_sleep_until(uint64_t deadline) {
+    ASSERT_THREAD_CONTEXT();
+    // A stray sched_wake() only costs another round.
+    while (time_now() < deadline) {
+        (void)sched_block_current_until(deadline);
+    }
+}
+
+void thread_sleep_ns(uint64_t ns) {
+    const uint64_t freq = time_freq();
+    // Split to keep ns * freq from overflowing for long sleeps.
+    const uint64_t ticks = (ns / 1000000000u) * freq +
+                           ((ns % 1000000000u) * freq) / 1000000000u;
+    thread_sleep_until(time_now() + ticks);
+}
+
 void thread_destroy(thread_t *t) {
     if (!t) return;
     ASSERT_THREAD_CONTEXT();
+    if (t->state != THREAD_DEAD || t->on_cpu) {
+        panic("thread_destroy: thread still live");
+    }
 
-    // Free stack pages if present.
+    // Return the stack to the cache.
     if (t->kstack_base && t->kstack_size) {
-        const uint64_t pa_base = pmm_virt_to_phys((uint64_t)t->kstack_base);
-        const uint32_t pages = (uint32_t)(t->kstack_size / (size_t)KSTACK_PAGE_SIZE);
-        for (uint32_t i = 0; i < pages; i++) {
-            pmm_free_page(pa_base + (uint64_t)i * (uint64_t)KSTACK_PAGE_SIZE);
-        }
+        kstack_free_pages(t->kstack_base, (uint32_t)(t->kstack_size / KSTACK_PAGE_SIZE));
     }
 
     slab_free(&g_thread_cache, t);
@@ -1,10 +1,13 @@
 // OS/Kern/Kernel/thread.h
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
 #include "alloc/slab_cache.h"
+#include "config.h"
+#include "sched/deadline_queue.h"
 
 // Forward declaration (defined in irq.h).
 typedef struct trap_frame trap_frame_t;
@@ -20,10 +23,31 @@ typedef struct task task_t;
 #define KSTACK_PAGES_MAX 16u
 #endif
 
+// Smallest stack thread_create_ex() accepts: the initial trap frame and a
+// shallow call chain fit in one page.
+#define KSTACK_PAGES_MIN 1u
+
 #define KSTACK_PAGE_SIZE 4096u
 #define KSTACK_SIZE_DEFAULT (KSTACK_PAGES_DEFAULT * KSTACK_PAGE_SIZE)
 #define KSTACK_SIZE_MAX     (KSTACK_PAGES_MAX * KSTACK_PAGE_SIZE)
 
+// Scheduling priorities: higher value runs first. Equal priorities round-robin.
+#define SCHED_PRIO_LEVELS  32u
+#define SCHED_PRIO_MIN     0u
+#define SCHED_PRIO_MAX     (SCHED_PRIO_LEVELS - 1u)
+#define SCHED_PRIO_DEFAULT 16u
+// The bootstrap context and the idle threads sit at the bottom level.
+#define SCHED_PRIO_IDLE    SCHED_PRIO_MIN
+
+// Fixed-point scale of thread_t.load: a thread that was runnable the whole
+// time has load SCHED_LOAD_SCALE.
+#define SCHED_LOAD_SCALE   1024u
+
+// Deadline class: fixed-point scale of budget/deadline densities, and the
+// longest accepted period.
+#define SCHED_EDF_UTIL_SCALE    (1u << 20)
+#define SCHED_EDF_PERIOD_MAX_US 1000000u
+
 // Callee-saved context for cooperative switching.
 // Layout is an ABI contract with Arch/aarch64/context_switch.S.
 typedef struct ctx {
@@ -72,6 +96,23 @@ _Static_assert(CTX_OFF_X30 == 88,  "ctx_t ABI: x30 offset");
 _Static_assert(CTX_OFF_SP  == 96,  "ctx_t ABI: sp offset");
 _Static_assert(sizeof(ctx_t) == 104, "ctx_t ABI: size");
 
+// FP/SIMD register file, switched lazily (see sched/fpsimd.h). Layout is
+// shared with Arch/aarch64/fpsimd.S.
+typedef struct fpsimd_state {
+    uint64_t vregs[64];  // q0..q31, low doubleword first
+    uint32_t fpsr;
+    uint32_t fpcr;
+} __attribute__((aligned(16))) fpsimd_state_t;
+
+#define FPSIMD_OFF_FPSR ((size_t)offsetof(fpsimd_state_t, fpsr))
+#define FPSIMD_OFF_FPCR ((size_t)offsetof(fpsimd_state_t, fpcr))
+
+_Static_assert(FPSIMD_OFF_FPSR == 512, "fpsimd_state_t ABI: fpsr offset");
+_Static_assert(FPSIMD_OFF_FPCR == 516, "fpsimd_state_t ABI: fpcr offset");
+
+// thread_t.fp_cpu: the thread's FP state is only in memory.
+#define THREAD_FP_CPU_NONE 0xFFFFFFFFu
+
 typedef enum thread_state {
     THREAD_READY = 0,
     THREAD_RUNNING,
@@ -79,12 +120,83 @@ typedef enum thread_state {
     THREAD_DEAD,
 } thread_state_t;
 
+// How a suspended thread must be resumed (see sched.c).
+typedef enum thread_resume {
+    THREAD_RESUME_CTX = 0, // yielded/blocked: ctx holds the callee-saved state
+    THREAD_RESUME_IRQ,     // preempted at IRQ exit (or new): frame at irq_sp
+} thread_resume_t;
+
+// Scheduling classes. Deadline (EDF) threads run ahead of every
+// priority-class thread.
+typedef enum sched_class {
+    SCHED_CLASS_PRIO = 0,
+    SCHED_CLASS_EDF,
+} sched_class_t;
+
+// Deadline-class parameters and per-period state, in counter ticks (see the
+// EDF notes in sched.c).
+typedef struct sched_edf {
+    uint64_t period;
+    uint64_t budget;        // CPU time per period
+    uint64_t deadline;      // relative to the period start, <= period
+    uint32_t density;       // budget/deadline in SCHED_EDF_UTIL_SCALE units
+    uint64_t period_start;  // current period; the next release while throttled
+    uint64_t abs_deadline;  // period_start + deadline
+    uint64_t runtime;       // budget left in this period
+    uint64_t exec_start;    // counter value the running thread was last charged at
+    dlq_node_t node;        // ready queue (by abs_deadline) or release queue
+} sched_edf_t;
+
+// Wake-to-run latency histogram: bucket 0 counts latencies under 1 us and
+// bucket i >= 1 those in [2^(i-1), 2^i) us; the last bucket is open-ended.
+#define SCHED_LAT_BUCKETS 20u
+
+// Scheduler accounting, in counter ticks (see sched_get_stats()).
+typedef struct sched_stats {
+    uint64_t run_time;        // time spent running
+    uint64_t wait_time;       // time spent queued: ready but not running
+    uint64_t nr_voluntary;    // switched away in yield()/sched_block_current()
+    uint64_t nr_involuntary;  // preempted at IRQ exit
+    uint64_t nr_wakeups;      // sched_wake() calls that made it runnable
+    uint64_t wake_lat_max;    // worst sched_wake()-to-running latency
+    uint32_t wake_lat_hist[SCHED_LAT_BUCKETS];
+} sched_stats_t;
+
+// Quality-of-service classes, most latency-sensitive first. DEFAULT means
+// unspecified: the thread is scheduled by its priority alone. Any other
+// class sets the thread's base priority (SCHED_PRIO_QOS_*), which decides
+// what it preempts, and its time slice; BACKGROUND threads are also
+// throttled (CONFIG_SCHED_BG_MAX_PCT).
+typedef enum thread_qos {
+    THREAD_QOS_DEFAULT = 0,
+    THREAD_QOS_USER_INTERACTIVE,
+    THREAD_QOS_USER_INITIATED,
+    THREAD_QOS_UTILITY,
+    THREAD_QOS_BACKGROUND,
+    THREAD_QOS_COUNT,
+} thread_qos_t;
+
+// Base priority of each QoS class. Priorities at or below
+// SCHED_PRIO_QOS_BACKGROUND form the throttled background band.
+#define SCHED_PRIO_QOS_USER_INTERACTIVE 24u
+#define SCHED_PRIO_QOS_USER_INITIATED   20u
+#define SCHED_PRIO_QOS_UTILITY          12u
+#define SCHED_PRIO_QOS_BACKGROUND       4u
+
+// CPU affinity masks: bit n allows CPU n.
+#define THREAD_AFFINITY_ANY 0xFFFFFFFFu
+_Static_assert(CONFIG_MAX_CPUS <= 32, "thread: affinity mask is 32 bits");
+
+// thread_t.flags
+#define THREAD_F_IDLE     (1u << 0) // per-CPU bootstrap or idle thread, never queued
+#define THREAD_F_JOINABLE (1u << 1) // freed by thread_join(), not the reaper
+
 typedef struct thread {
     ctx_t ctx;
 
 
     // Debug identity (stable across the lifetime of the thread).
-    // tid==0 is reserved for the bootstrap (kmain) pseudo-thread.
+    // tid==0 is reserved for the per-CPU bootstrap pseudo-threads.
     uint32_t tid;
     const char *name;
 
@@ -96,8 +208,39 @@ typedef struct thread {
     size_t  kstack_size;
     void   *kstack_top;
 
-    // Minimal run-queue linkage (circular singly-linked list).
+    // Run-queue linkage (per-priority FIFO, NULL-terminated). on_rq is also
+    // set while a deadline-class thread sits in its CPU's EDF queues.
     struct thread *rq_next;
+    bool on_rq;
+
+    // Scheduling priority (SCHED_PRIO_MIN..SCHED_PRIO_MAX). `priority` is the
+    // effective one the run queues use: the higher of the base priority set
+    // through sched_enqueue()/sched_set_priority() and the one inherited from
+    // mutex waiters.
+    uint8_t priority;
+    uint8_t base_priority;
+    uint8_t pi_priority;
+
+    // CPU whose run queue owns this thread. Changed only by the load
+    // balancer, under the old CPU's run-queue lock (see sched.c).
+    uint8_t cpu;
+
+    // thread_qos_t (sched_set_qos()), and the CPUs the thread may run on
+    // (fixed at creation).
+    uint8_t qos;
+    uint32_t affinity;
+
+    // True from switch-in until the switch away from this thread has fully
+    // completed (its registers are saved). The balancer never moves a thread
+    // while it is set, so no two CPUs ever run on the same stack.
+    volatile bool on_cpu;
+
+    // THREAD_F_* flags.
+    uint8_t flags;
+
+    // sched_class_t; `edf` is only meaningful for SCHED_CLASS_EDF.
+    uint8_t sched_class;
+    sched_edf_t edf;
 
     // Reserved for preemption integration on IRQ return.
     trap_frame_t *last_trap;
@@ -119,21 +262,123 @@ typedef struct thread {
     uint64_t saved_daif;
 
     thread_state_t state;
+
+    // Which of ctx / irq_sp is authoritative while the thread is switched out.
+    thread_resume_t resume;
+
+    // Timer ticks left in the current time slice (preemptive mode; the
+    // slice length depends on the QoS class).
+    uint32_t slice_ticks;
+
+    // Runnable-time average (0..SCHED_LOAD_SCALE), sampled from the counter
+    // at switch-out and wakeup. Only changes while the thread is off the run
+    // queue, so a queue's load sum stays exact.
+    uint32_t load;
+    uint64_t load_stamp; // counter value of the last load update
+
+    // Scheduler accounting, updated with IRQs masked by the CPU switching
+    // the thread in or out (and by its waker for ready_stamp): the counter
+    // value it last started running at, the one it was queued at (0 while
+    // not queued), and whether that queueing was a wakeup.
+    sched_stats_t stats;
+    uint64_t run_stamp;
+    uint64_t ready_stamp;
+    bool woken;
+
+    // Counter value the running thread was last charged to its task's CPU
+    // bandwidth at (sched/bandwidth.h).
+    uint64_t bw_stamp;
+
+    // Priority inheritance, under the mutex PI lock (see sync/mutex.c): the
+    // mutex this thread sleeps on, and the contended mutexes it holds
+    // (linked through mutex_t.pi_next).
+    struct mutex *pi_blocked_on;
+    struct mutex *pi_held;
+
+    // FP/SIMD state as of the thread's last switch-out (or untouched zeros),
+    // and the CPU whose registers still hold exactly that state, if any.
+    fpsimd_state_t fp;
+    uint32_t fp_cpu;
+
+    // Exit bookkeeping, under the reaper lock (see thread.c): set once the
+    // thread has exited, the thread blocked in thread_join() on it, and the
+    // reaper's zombie list linkage.
+    bool exited;
+    struct thread *joiner;
+    struct thread *zombie_next;
 } thread_t;
 
 // Assembly primitive.
 void ctx_switch(ctx_t *old, ctx_t *new);
 
-// Thread API.
+// Thread API. thread_create() uses SCHED_PRIO_DEFAULT.
 thread_t *thread_create(void (*entry)(void *), void *arg);
 
 // Slab-backed allocation for thread objects
 void thread_alloc_init(void);
+
+// Free a dead thread's stack and object. Only once it is off every CPU; the
+// reaper and thread_join() take care of that, so other callers should not
+// need this.
 void thread_destroy(thread_t *t);
 
+// Start the reaper thread, which frees exited (non-joinable) threads. Until
+// it runs, exited threads just wait on its list.
+void thread_reaper_start(void);
+
+// Make `t` joinable: instead of being reaped on exit it stays around until
+// thread_join(). Call before the thread is first enqueued.
+void thread_set_joinable(thread_t *t);
+
+// Wait for joinable thread `t` to exit, then free it. One joiner per thread;
+// thread context only.
+void thread_join(thread_t *t);
+
+// Give up on joining `t`: it is freed by the reaper once it has exited (at
+// once if it already has). No-op for a thread that is not joinable; must
+// not race a thread_join() on the same thread.
+void thread_detach(thread_t *t);
+
 /* Returns false if cache not initialized. */
 bool thread_cache_get_stats(slab_cache_stats_t *out);
 
-thread_t *thread_create_named(const char *name, void (*entry)(void *), void *arg);
+// Create a READY (not yet enqueued) thread; sched_enqueue() uses `priority`
+// unless the caller passes a different one.
+thread_t *thread_create_named(const char *name, void (*entry)(void *), void *arg,
+                              uint32_t priority);
+
+// thread_create_ex() attributes; THREAD_ATTR_INIT / thread_attr_init() give
+// the thread_create() defaults.
+typedef struct thread_attr {
+    const char *name;
+    uint32_t stack_pages;  // KSTACK_PAGES_MIN..KSTACK_PAGES_MAX
+    uint32_t priority;     // SCHED_PRIO_MIN..SCHED_PRIO_MAX; THREAD_QOS_DEFAULT only
+    uint32_t affinity;     // allowed CPUs (THREAD_AFFINITY_ANY)
+    uint32_t qos;          // thread_qos_t
+} thread_attr_t;
+
+#define THREAD_ATTR_INIT                                                   \
+    { .name = NULL, .stack_pages = KSTACK_PAGES_DEFAULT,                   \
+      .priority = SCHED_PRIO_DEFAULT, .affinity = THREAD_AFFINITY_ANY,     \
+      .qos = THREAD_QOS_DEFAULT }
+
+void thread_attr_init(thread_attr_t *attr);
+
+// True if thread_create_ex() accepts `attr` (ranges above; the affinity must
+// include an online CPU, or the boot CPU before smp_init()).
+bool thread_attr_valid(const thread_attr_t *attr);
+
+// thread_create_named() with explicit attributes (NULL: defaults). Stacks of
+// the default size come from the stack cache, other sizes from the PMM.
+// Returns NULL, rather than panicking, for invalid attributes or when out of
+// memory.
+thread_t *thread_create_ex(const thread_attr_t *attr, void (*entry)(void *), void *arg);
 __attribute__((noreturn)) void thread_trampoline(void (*entry)(void *), void *arg);
+// Exit the current thread. It is freed by the reaper, or by its joiner.
 __attribute__((noreturn)) void thread_exit(void);
+
+// Sleep the current thread until the counter reaches `deadline` (time_now()
+// units), or for at least `ns` nanoseconds. Thread context only; not the
+// bootstrap/idle thread. Resolution is CONFIG_KTIMER_GRANULE_US.
+void thread_sleep_until(uint64_t deadline);
+void thread_sleep_ns(uint64_t ns);
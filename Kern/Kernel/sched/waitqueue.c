@@ -0,0 +1,115 @@
+// OS/Kern/Kernel/sched/waitqueue.c
+//
+// Wait queues (see waitqueue.h).
+//
+// A waker dequeues an entry, marks it woken and calls sched_wake() all under
+// the queue's lock. The waiter only returns after re-taking that lock, so a
+// wake can never reach the thread after waitq_wait() returned and land on
+// an unrelated later block. A wakeup between sched_prepare_block() and the
+// switch leaves the waiter READY, so the block returns at once.
+
+#include "sched/waitqueue.h"
+
+#include "contracts.h"
+#include "irq.h"
+#include "panic.h"
+#include "sched/sched.h"
+#include "sched/thread.h"
+#include "timer_generic.h"
+
+static void wq_append(wait_queue_t *wq, wait_entry_t *e)
+{
+    e->next = NULL;
+    e->prev = wq->tail;
+    if (wq->tail) {
+        wq->tail->next = e;
+    } else {
+        wq->head = e;
+    }
+    wq->tail = e;
+    wq->nr_waiters++;
+}
+
+static void wq_remove(wait_queue_t *wq, wait_entry_t *e)
+{
+    if (e->prev) {
+        e->prev->next = e->next;
+    } else {
+        wq->head = e->next;
+    }
+    if (e->next) {
+        e->next->prev = e->prev;
+    } else {
+        wq->tail = e->prev;
+    }
+    e->next = NULL;
+    e->prev = NULL;
+    wq->nr_waiters--;
+}
+
+void waitq_init(wait_queue_t *wq)
+{
+    wq->head = NULL;
+    wq->tail = NULL;
+    wq->nr_waiters = 0;
+}
+
+bool waitq_wait(wait_queue_t *wq, spinlock_t *lock, uint64_t deadline)
+{
+    ASSERT_THREAD_CONTEXT();
+    if (!irq_irqs_disabled()) {
+        panic("waitq_wait: lock must be taken with IRQs masked");
+    }
+
+    wait_entry_t e;
+    e.thread = sched_current();
+    e.woken = false;
+    wq_append(wq, &e);
+
+    for (;;) {
+        sched_prepare_block();
+        spin_unlock(lock);
+        if (deadline == UINT64_MAX) {
+            sched_block_current();
+        } else {
+            (void)sched_block_current_until(deadline);
+        }
+        spin_lock(lock);
+
+        if (e.woken) {
+            return true;
+        }
+        if (deadline != UINT64_MAX && time_now() >= deadline) {
+            wq_remove(wq, &e);
+            return false;
+        }
+        // Woken by something else (e.g. a stale wake from an earlier
+        // block): still queued, keep waiting.
+    }
+}
+
+void waitq_wake_entry(wait_queue_t *wq, wait_entry_t *e)
+{
+    wq_remove(wq, e);
+    e->woken = true;
+    sched_wake(e->thread);
+}
+
+bool waitq_wake_one(wait_queue_t *wq)
+{
+    wait_entry_t *e = wq->head;
+    if (!e) {
+        return false;
+    }
+    waitq_wake_entry(wq, e);
+    return true;
+}
+
+uint32_t waitq_wake_all(wait_queue_t *wq)
+{
+    uint32_t n = 0;
+    while (waitq_wake_one(wq)) {
+        n++;
+    }
+    return n;
+}
@@ -0,0 +1,78 @@
+// OS/Kern/Kernel/sched/waitqueue.h
+//
+// Wait queues: threads sleeping until some condition becomes true.
+//
+// - Intrusive and allocation-free: each waiter's entry lives on its own stack
+//   for the duration of waitq_wait().
+// - FIFO: waitq_wake_one() wakes the longest-waiting thread.
+// - Not internally locked. A queue is protected by the lock that guards the
+//   condition it waits for (an endpoint's lock, say), so testing the
+//   condition and queueing are one critical section and no wakeup is lost.
+//   That lock must be taken with spin_lock_irqsave() so the waiter can block
+//   with IRQs still masked (see sched_prepare_block()).
+//
+// Typical use:
+//
+//     uint64_t flags = spin_lock_irqsave(&obj->lock);
+//     while (!condition(obj)) {
+//         waitq_wait(&obj->wq, &obj->lock, UINT64_MAX);
+//     }
+//     ...
+//     spin_unlock_irqrestore(&obj->lock, flags);
+//
+// and on the other side, with obj->lock held: make the condition true, then
+// waitq_wake_one(&obj->wq).
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sync/spinlock.h"
+
+// Forward declaration (defined in sched/thread.h).
+typedef struct thread thread_t;
+
+typedef struct wait_entry {
+    struct wait_entry *next;
+    struct wait_entry *prev;
+    thread_t          *thread;
+    bool               woken;   // dequeued by a wake, under the queue's lock
+} wait_entry_t;
+
+typedef struct wait_queue {
+    wait_entry_t *head;
+    wait_entry_t *tail;
+    uint32_t      nr_waiters;
+} wait_queue_t;
+
+#define WAIT_QUEUE_INIT { .head = NULL, .tail = NULL, .nr_waiters = 0 }
+
+void waitq_init(wait_queue_t *wq);
+
+static inline bool waitq_empty(const wait_queue_t *wq)
+{
+    return wq->head == NULL;
+}
+
+// Sleep on `wq` until a waitq_wake_*() picks this thread, or the counter
+// reaches `deadline` (time_now() units; UINT64_MAX waits forever). The caller
+// holds `lock`, taken with spin_lock_irqsave(); it is dropped while asleep
+// and held again on return. Returns true if woken, false on timeout (a wake
+// that races with the timeout wins). Thread context only; not the idle
+// thread. Callers recheck their condition: another thread may have consumed
+// it before this one ran.
+bool waitq_wait(wait_queue_t *wq, spinlock_t *lock, uint64_t deadline);
+
+// Wake the longest-waiting thread. Caller holds the queue's lock. Any
+// context. Returns false if nobody was waiting.
+bool waitq_wake_one(wait_queue_t *wq);
+
+// Wake the waiter queued as `e` (one of wq's entries, for callers that pick
+// their own order by walking wq->head). Caller holds the queue's lock.
+void waitq_wake_entry(wait_queue_t *wq, wait_entry_t *e);
+
+// Wake every waiting thread. Caller holds the queue's lock. Any context.
+// Returns the number woken.
+uint32_t waitq_wake_all(wait_queue_t *wq);
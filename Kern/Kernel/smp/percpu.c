@@ -0,0 +1,18 @@
+// OS/Kern/Kernel/smp/percpu.c
+//
+// Per-CPU data area (see percpu.h).
+
+#include "smp/percpu.h"
+
+#include "panic.h"
+
+percpu_t g_percpu[CONFIG_MAX_CPUS];
+
+void percpu_init_cpu(uint32_t cpu) {
+    if (cpu >= CONFIG_MAX_CPUS) {
+        panic("percpu: cpu id out of range");
+    }
+    percpu_t *pc = &g_percpu[cpu];
+    pc->cpu = cpu;
+    __asm__ volatile("msr tpidr_el1, %0" :: "r"((uintptr_t)pc) : "memory");
+}
@@ -0,0 +1,62 @@
+// OS/Kern/Kernel/smp/percpu.h
+//
+// Per-CPU data area.
+//
+// Every CPU owns one cache-line-aligned percpu_t, and TPIDR_EL1 holds its
+// address from the first statement of kmain()/smp_secondary_main() on. The
+// calling CPU's block is therefore one MRS away and a field one load
+// relative to it, and since no two blocks share a line, a CPU updating its
+// own state never invalidates a peer's cache.
+//
+// this_cpu_ptr() names the CPU the caller is running on *now*. The answer
+// only stays true while the caller cannot migrate: IRQs masked, in IRQ
+// context, or (cooperative scheduling) anywhere outside yield() and
+// sched_block_current(). Other CPUs' blocks are reached with per_cpu_ptr().
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "mm/pmm.h"
+#include "preempt.h"
+#include "smp/smp.h"
+#include "timer/timer_wheel.h"
+#include "timer_generic.h"
+
+struct thread;
+
+typedef struct percpu {
+    uint32_t          cpu;         // logical id, == cpu_id()
+    uint32_t          irq_depth;   // IRQ handler nesting (irq_enter/irq_exit)
+    preempt_cpu_t     preempt;     // need_resched, preempt_count
+    struct thread    *current;     // running thread (mirrors sched.c's copy)
+    struct thread    *fp_last;     // FP/SIMD state owner (fpsimd.c)
+    bool              fp_enabled;  // FP unit open for the current thread
+    event_cpu_t       event;       // clockevent: tick + one-shot (timer_generic.c)
+    pmm_pcp_t         pmm_pcp;     // single-page hot list (pmm.c)
+    ktimer_wheel_t    timer_wheel; // this CPU's timers (timer_wheel.c)
+} __attribute__((aligned(CACHE_LINE))) percpu_t;
+
+_Static_assert(sizeof(percpu_t) % CACHE_LINE == 0, "percpu_t: whole cache lines");
+
+extern percpu_t g_percpu[CONFIG_MAX_CPUS];
+
+// Point TPIDR_EL1 at the calling CPU's block. First thing on every CPU,
+// before anything that may look at per-CPU state (in_irq() included).
+void percpu_init_cpu(uint32_t cpu);
+
+static inline percpu_t *this_cpu_ptr(void) {
+    uintptr_t p;
+    __asm__ volatile("mrs %0, tpidr_el1" : "=r"(p));
+    return (percpu_t *)p;
+}
+
+static inline percpu_t *per_cpu_ptr(uint32_t cpu) {
+    return &g_percpu[cpu];
+}
+
+// Field of the calling CPU's block (see the migration note above).
+#define this_cpu_read(field)       (this_cpu_ptr()->field)
+#define this_cpu_write(field, val) (this_cpu_ptr()->field = (val))
@@ -0,0 +1,277 @@
+// OS/Kern/Kernel/smp/smp.c
+//
+// Secondary CPU bring-up.
+//
+// The boot CPU reads the CPU list from the DTB and starts each secondary with
+// PSCI CPU_ON at Arch/aarch64/secondary_entry.S. That stub turns the MMU on
+// with the kernel's tables and jumps to smp_secondary_main(), which finishes
+// per-CPU setup (vectors, GIC CPU interface, timer, scheduler) and hands the
+// CPU over to its idle thread.
+
+#include "smp/smp.h"
+
+#include <stddef.h>
+
+#include "dtb.h"
+#include "gicv2.h"
+#include "irq.h"
+#include "mmu.h"
+#include "panic.h"
+#include "pmm.h"
+#include "preempt.h"
+#include "smp/percpu.h"
+#include "psci.h"
+#include "sched.h"
+#include "thread.h"
+#include "timer_generic.h"
+#include "uart_pl011.h"
+
+// Layout is an ABI contract with Arch/aarch64/secondary_entry.S.
+typedef struct smp_boot_args {
+    uint64_t mair;
+    uint64_t tcr;
+    uint64_t ttbr0;
+    uint64_t ttbr1;
+    uint64_t sp;
+    uint64_t entry;
+    uint64_t cpu;
+} smp_boot_args_t;
+
+_Static_assert(offsetof(smp_boot_args_t, mair)  == 0,  "smp_boot_args: mair offset");
+_Static_assert(offsetof(smp_boot_args_t, tcr)   == 8,  "smp_boot_args: tcr offset");
+_Static_assert(offsetof(smp_boot_args_t, ttbr0) == 16, "smp_boot_args: ttbr0 offset");
+_Static_assert(offsetof(smp_boot_args_t, ttbr1) == 24, "smp_boot_args: ttbr1 offset");
+_Static_assert(offsetof(smp_boot_args_t, sp)    == 32, "smp_boot_args: sp offset");
+_Static_assert(offsetof(smp_boot_args_t, entry) == 40, "smp_boot_args: entry offset");
+_Static_assert(offsetof(smp_boot_args_t, cpu)   == 48, "smp_boot_args: cpu offset");
+
+// Provided by Arch/aarch64/secondary_entry.S.
+extern void secondary_entry(void);
+
+// How long the boot CPU waits for a started CPU to report in.
+#define SMP_BOOT_TIMEOUT_MS 1000u
+
+// One cache line each: the secondary reads its args with caches off.
+static smp_boot_args_t s_boot_args[CONFIG_MAX_CPUS] __attribute__((aligned(CACHE_LINE)));
+
+// Bit n set once CPU n has finished its per-CPU setup.
+static volatile uint32_t s_online_mask;
+
+// Topology (smp_init_topology()); 0 reads as CPU_CAPACITY_SCALE.
+static uint16_t s_capacity[CONFIG_MAX_CPUS];
+static uint8_t  s_cluster[CONFIG_MAX_CPUS];
+static bool     s_asym;
+
+static void ipi_resched_handler(uint32_t irq, void *ctx, trap_frame_t *tf)
+{
+    (void)irq; (void)ctx; (void)tf;
+    // IRQ exit (preemptive) or the idle loop (cooperative) acts on it.
+    preempt_set_need_resched();
+    // The sender may have changed our deadline-class timing.
+    sched_deadline_event();
+}
+
+// Push `size` bytes at `va` out to the point of coherency.
+static void dcache_clean_range(uint64_t va, uint64_t size)
+{
+    uint64_t p = va & ~(uint64_t)(CACHE_LINE - 1u);
+    for (; p < va + size; p += CACHE_LINE) {
+        __asm__ volatile("dc cvac, %0" :: "r"(p) : "memory");
+    }
+    __asm__ volatile("dsb sy" ::: "memory");
+}
+
+static void smp_mark_online(uint32_t cpu)
+{
+    __atomic_or_fetch(&s_online_mask, 1u << cpu, __ATOMIC_RELEASE);
+}
+
+uint32_t smp_num_cpus(void)
+{
+    return (uint32_t)__builtin_popcount(__atomic_load_n(&s_online_mask, __ATOMIC_ACQUIRE));
+}
+
+bool smp_cpu_online(uint32_t cpu)
+{
+    if (cpu >= CONFIG_MAX_CPUS) return false;
+    return (__atomic_load_n(&s_online_mask, __ATOMIC_ACQUIRE) & (1u << cpu)) != 0;
+}
+
+void smp_send_resched(uint32_t cpu)
+{
+    if (cpu == cpu_id() || !smp_cpu_online(cpu)) {
+        return;
+    }
+    gicv2_send_sgi(1u << cpu, IPI_RESCHED);
+}
+
+__attribute__((noreturn)) void smp_secondary_main(uint64_t cpu);
+
+__attribute__((noreturn)) void smp_secondary_main(uint64_t cpu)
+{
+    percpu_init_cpu((uint32_t)cpu);
+    mmu_secondary_finish();
+    if (cpu != cpu_id()) {
+        panic("smp: secondary started with the wrong cpu id");
+    }
+
+    // This context is the CPU's bootstrap thread until sched_exit_bootstrap().
+    sched_init_bootstrap();
+
+    // PPI/SGI enables are banked: every CPU enables its own.
+    gicv2_init_cpu();
+    gicv2_enable_irq(IPI_RESCHED);
+    gicv2_config_irq(TIMER_PPI_IRQ, false);
+    gicv2_enable_irq(TIMER_PPI_IRQ);
+    timer_init_hz(CONFIG_TICK_HZ);
+
+    smp_mark_online((uint32_t)cpu);
+    irq_global_enable();
+
+    sched_exit_bootstrap();
+}
+
+uint32_t smp_cpu_capacity(uint32_t cpu)
+{
+    if (cpu >= CONFIG_MAX_CPUS || s_capacity[cpu] == 0) return CPU_CAPACITY_SCALE;
+    return s_capacity[cpu];
+}
+
+uint32_t smp_cpu_cluster(uint32_t cpu)
+{
+    return cpu < CONFIG_MAX_CPUS ? s_cluster[cpu] : 0;
+}
+
+bool smp_asym_capacity(void)
+{
+    return s_asym;
+}
+
+// Logical id of a DTB CPU (see smp.h); false if it cannot be expressed.
+static bool smp_logical_id(uint64_t mpidr, uint32_t *out)
+{
+    mpidr &= MPIDR_AFF_MASK;
+    if ((mpidr & ~MPIDR_AFF0_MASK) != 0) return false;
+    const uint32_t cpu = (uint32_t)(mpidr & MPIDR_AFF0_MASK);
+    if (cpu >= CONFIG_MAX_CPUS) return false;
+    *out = cpu;
+    return true;
+}
+
+static void smp_init_topology(const dtb_cpu_t *cpus, uint32_t count)
+{
+    // The DTB capacity is per MHz; QEMU gives no per-CPU clock, so the
+    // cores are taken to run at the same frequency.
+    uint32_t max = 0;
+    bool all = count != 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (cpus[i].capacity == 0) all = false;
+        if (cpus[i].capacity > max) max = cpus[i].capacity;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t cpu;
+        if (!smp_logical_id(cpus[i].mpidr, &cpu)) continue;
+        uint32_t cap = CPU_CAPACITY_SCALE;
+        if (all) {
+            cap = (uint32_t)(((uint64_t)cpus[i].capacity * CPU_CAPACITY_SCALE) / max);
+            if (cap == 0) cap = 1;
+        }
+        s_capacity[cpu] = (uint16_t)cap;
+        s_cluster[cpu] = cpus[i].cluster == DTB_CLUSTER_NONE ? 0u : (uint8_t)cpus[i].cluster;
+        if (cap != CPU_CAPACITY_SCALE) s_asym = true;
+    }
+
+    if (!s_asym) return;
+    for (uint32_t cpu = 0; cpu < CONFIG_MAX_CPUS; cpu++) {
+        if (s_capacity[cpu] == 0) continue;
+        uart_puts("SMP: cpu");
+        uart_putu64_dec(cpu);
+        uart_puts(" capacity ");
+        uart_putu64_dec(s_capacity[cpu]);
+        uart_puts(" cluster ");
+        uart_putu64_dec(s_cluster[cpu]);
+        uart_putnl();
+    }
+}
+
+static bool smp_boot_cpu(uint32_t cpu, uint64_t mpidr, const mmu_cpu_regs_t *regs)
+{
+    const uint32_t pages = (uint32_t)KSTACK_PAGES_DEFAULT;
+    uint64_t stack_pa = 0;
+    if (!pmm_alloc_pages(pages, &stack_pa)) {
+        uart_puts("SMP: no memory for CPU stack\n");
+        return false;
+    }
+    const uint64_t stack_top = pmm_phys_to_virt(stack_pa) +
+                               (uint64_t)pages * (uint64_t)KSTACK_PAGE_SIZE;
+
+    smp_boot_args_t *args = &s_boot_args[cpu];
+    args->mair  = regs->mair;
+    args->tcr   = regs->tcr;
+    args->ttbr0 = regs->ttbr0;
+    args->ttbr1 = regs->ttbr1;
+    args->sp    = stack_top & ~0xFull;
+    args->entry = (uint64_t)(uintptr_t)&smp_secondary_main;
+    args->cpu   = cpu;
+    dcache_clean_range((uint64_t)(uintptr_t)args, sizeof(*args));
+
+    const uint64_t entry_pa = pmm_virt_to_phys((uint64_t)(uintptr_t)&secondary_entry);
+    const uint64_t args_pa  = pmm_virt_to_phys((uint64_t)(uintptr_t)args);
+    const int32_t rc = psci_cpu_on(mpidr, entry_pa, args_pa);
+    if (rc != PSCI_SUCCESS) {
+        pmm_free_pages(stack_pa, pages);
+        uart_puts("SMP: CPU_ON failed for mpidr ");
+        uart_puthex64(mpidr);
+        uart_putnl();
+        return false;
+    }
+
+    // The stack stays allocated even on timeout: the CPU may still arrive.
+    const uint64_t deadline = time_now() + (time_freq() * SMP_BOOT_TIMEOUT_MS) / 1000u;
+    while (!smp_cpu_online(cpu)) {
+        if (time_now() > deadline) {
+            uart_puts("SMP: timeout waiting for mpidr ");
+            uart_puthex64(mpidr);
+            uart_putnl();
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t smp_init(void)
+{
+    const uint32_t boot_cpu = cpu_id();
+    smp_mark_online(boot_cpu);
+
+    (void)irq_register(IPI_RESCHED, ipi_resched_handler, NULL);
+    gicv2_enable_irq(IPI_RESCHED);
+
+    dtb_cpu_t cpus[DTB_MAX_CPUS];
+    uint32_t count = DTB_MAX_CPUS;
+    if (!dtb_get_cpus(cpus, &count)) {
+        return smp_num_cpus();
+    }
+    smp_init_topology(cpus, count);
+
+    if (!psci_init()) {
+        uart_puts("SMP: no PSCI node, boot CPU only\n");
+        return smp_num_cpus();
+    }
+
+    mmu_cpu_regs_t regs;
+    mmu_get_secondary_regs(&regs);
+
+    for (uint32_t i = 0; i < count; i++) {
+        // Logical ids are Aff0 (see smp.h); skip what that cannot express.
+        uint32_t cpu;
+        if (!smp_logical_id(cpus[i].mpidr, &cpu) || cpu == boot_cpu) continue;
+        (void)smp_boot_cpu(cpu, cpus[i].mpidr & MPIDR_AFF_MASK, &regs);
+    }
+
+    uart_puts("SMP: ");
+    uart_putu64_dec(smp_num_cpus());
+    uart_puts(" CPU(s) online\n");
+    return smp_num_cpus();
+}
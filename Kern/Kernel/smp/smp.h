@@ -0,0 +1,55 @@
+// OS/Kern/Kernel/smp/smp.h
+//
+// Secondary CPU bring-up (PSCI CPU_ON) and inter-processor interrupts.
+//
+// Logical CPU ids are MPIDR_EL1.Aff0. That is exact on QEMU virt with GICv2
+// (at most 8 CPUs, one cluster); CPUs with a non-zero Aff1..Aff3 or an Aff0
+// at or above CONFIG_MAX_CPUS are not brought online.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "config.h"
+
+// Cache line (and CWG) size of the cores QEMU virt models.
+#define CACHE_LINE 64u
+
+#define MPIDR_AFF0_MASK 0xFFull
+#define MPIDR_AFF_MASK  0xFF00FFFFFFull
+
+// SGI used to poke another CPU's scheduler (sets need_resched there).
+enum { IPI_RESCHED = 0 };
+
+// Logical id of the executing CPU. Callers that must not observe a stale value
+// across a migration read it with IRQs masked or preemption disabled.
+static inline uint32_t cpu_id(void) {
+    uint64_t mpidr;
+    __asm__ volatile("mrs %0, mpidr_el1" : "=r"(mpidr));
+    return (uint32_t)(mpidr & MPIDR_AFF0_MASK);
+}
+
+// Boot every CPU listed in the DTB (boot CPU only). Returns the number of
+// CPUs online afterwards, including the boot CPU.
+uint32_t smp_init(void);
+
+// Number of CPUs currently online.
+uint32_t smp_num_cpus(void);
+
+bool smp_cpu_online(uint32_t cpu);
+
+// Ask `cpu` to reschedule. A no-op for the calling CPU or an offline CPU.
+void smp_send_resched(uint32_t cpu);
+
+// CPU topology from the DTB (read by smp_init()). Capacity is relative
+// compute throughput from capacity-dmips-mhz, scaled so the largest CPU is
+// CPU_CAPACITY_SCALE; every CPU is CPU_CAPACITY_SCALE unless all of them
+// list a capacity. Clusters come from /cpus/cpu-map (0 without one).
+#define CPU_CAPACITY_SCALE 1024u
+
+uint32_t smp_cpu_capacity(uint32_t cpu);
+uint32_t smp_cpu_cluster(uint32_t cpu);
+
+// True if the CPUs differ in capacity (big.LITTLE, P and E cores).
+bool smp_asym_capacity(void);
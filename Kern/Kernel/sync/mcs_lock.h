@@ -0,0 +1,87 @@
+// OS/Kern/Kernel/sync/mcs_lock.h
+//
+// MCS queue spinlock.
+//
+// Each locker brings its own queue node (normally on its stack) and spins
+// only on that node; the holder hands over by writing its successor's node.
+// A contended acquire therefore touches the shared lock word once, and
+// every waiter spins on a cache line nobody else is polling, so handover
+// cost stays flat as CPUs are added. Use it for hot global locks (the
+// allocators); spinlock_t is smaller and as good when contention is rare.
+//
+// Same rules as spinlock_t: never held across a context switch or a sleep;
+// irqsave variants for locks an IRQ handler may take. The node must stay
+// valid until mcs_unlock() returns and must not be reused in between.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "irq.h"
+#include "sync/spinlock.h"
+
+typedef struct mcs_node {
+    struct mcs_node *next;    // successor, linked in once it has queued
+    uint32_t         locked;  // set by the predecessor on handover
+} mcs_node_t;
+
+typedef struct mcs_lock {
+    mcs_node_t *tail;         // last queued node, NULL when free
+} mcs_lock_t;
+
+#define MCS_LOCK_INIT { .tail = NULL }
+
+static inline void mcs_init(mcs_lock_t *l) {
+    l->tail = NULL;
+}
+
+static inline void mcs_lock(mcs_lock_t *l, mcs_node_t *n) {
+    n->next = NULL;
+    n->locked = 0;
+    mcs_node_t *prev = __atomic_exchange_n(&l->tail, n, __ATOMIC_ACQ_REL);
+    if (!prev) {
+        return;
+    }
+    __atomic_store_n(&prev->next, n, __ATOMIC_RELEASE);
+    spin_wait_eq32(&n->locked, 1u);
+}
+
+static inline bool mcs_trylock(mcs_lock_t *l, mcs_node_t *n) {
+    n->next = NULL;
+    n->locked = 0;
+    mcs_node_t *expected = NULL;
+    return __atomic_compare_exchange_n(&l->tail, &expected, n, false,
+                                       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+static inline void mcs_unlock(mcs_lock_t *l, mcs_node_t *n) {
+    mcs_node_t *next = __atomic_load_n(&n->next, __ATOMIC_ACQUIRE);
+    if (!next) {
+        mcs_node_t *expected = n;
+        if (__atomic_compare_exchange_n(&l->tail, &expected, NULL, false,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            return;
+        }
+        // A successor swapped itself in but has not linked to us yet.
+        next = (mcs_node_t *)(uintptr_t)
+            spin_wait_nonzero64((const volatile uint64_t *)(void *)&n->next);
+    }
+    __atomic_store_n(&next->locked, 1u, __ATOMIC_RELEASE);
+}
+
+static inline bool mcs_is_locked(const mcs_lock_t *l) {
+    return __atomic_load_n(&l->tail, __ATOMIC_RELAXED) != NULL;
+}
+
+static inline uint64_t mcs_lock_irqsave(mcs_lock_t *l, mcs_node_t *n) {
+    uint64_t flags = irq_save();
+    mcs_lock(l, n);
+    return flags;
+}
+
+static inline void mcs_unlock_irqrestore(mcs_lock_t *l, mcs_node_t *n, uint64_t flags) {
+    mcs_unlock(l, n);
+    irq_restore(flags);
+}
@@ -0,0 +1,208 @@
+// OS/Kern/Kernel/sync/mutex.c
+//
+// Sleeping mutex with priority inheritance (see mutex.h).
+//
+// The fast paths only touch `owner`. Everything a contended mutex needs (its
+// wait queue, MUTEX_F_WAITERS, the owner's pi_held list and every thread's
+// pi_blocked_on) is guarded by one PI lock, so following a chain of owners
+// never nests mutex locks. Once MUTEX_F_WAITERS is set the owner field only
+// changes under the PI lock: the fast unlock fails and hands over to the
+// slow path.
+//
+// A thread's inherited priority is the best priority among the waiters of
+// the contended mutexes it holds (sched_set_inherited_priority()). Waiters
+// lend their effective priority, so boosts propagate down chains of owners.
+
+#include "sync/mutex.h"
+
+#include "contracts.h"
+#include "panic.h"
+#include "sched/sched.h"
+#include "sched/thread.h"
+#include "sync/spinlock.h"
+
+// Bound on the owner chain followed when boosting; a longer chain (or a
+// deadlock cycle) just stops propagating.
+#define MUTEX_PI_MAX_DEPTH 8u
+
+static spinlock_t s_pi_lock = SPINLOCK_INIT;
+
+static inline thread_t *owner_of(uintptr_t owner)
+{
+    return (thread_t *)(owner & ~MUTEX_F_WAITERS);
+}
+
+// Highest-priority waiter of m, the longest-waiting among equals. Caller
+// holds s_pi_lock.
+static wait_entry_t *top_waiter(const mutex_t *m)
+{
+    wait_entry_t *best = NULL;
+    for (wait_entry_t *e = m->waiters.head; e; e = e->next) {
+        if (!best || e->thread->priority > best->thread->priority) {
+            best = e;
+        }
+    }
+    return best;
+}
+
+// Re-derive t's inherited priority from the mutexes it holds. Caller holds
+// s_pi_lock.
+static void pi_update(thread_t *t)
+{
+    uint32_t prio = SCHED_PRIO_MIN;
+    for (mutex_t *m = t->pi_held; m; m = m->pi_next) {
+        const wait_entry_t *e = top_waiter(m);
+        if (e && e->thread->priority > prio) {
+            prio = e->thread->priority;
+        }
+    }
+    sched_set_inherited_priority(t, prio);
+}
+
+// Lend `prio` to `owner` and on down the chain of mutexes it waits for.
+// Caller holds s_pi_lock.
+static void pi_boost(thread_t *owner, uint32_t prio)
+{
+    for (uint32_t depth = 0; owner && depth < MUTEX_PI_MAX_DEPTH; depth++) {
+        if (owner->priority >= prio) {
+            return;
+        }
+        sched_set_inherited_priority(owner, prio);
+        const mutex_t *next = owner->pi_blocked_on;
+        if (!next) {
+            return;
+        }
+        owner = owner_of(__atomic_load_n(&next->owner, __ATOMIC_RELAXED));
+    }
+}
+
+static void pi_held_add(thread_t *t, mutex_t *m)
+{
+    m->pi_next = t->pi_held;
+    t->pi_held = m;
+}
+
+static void pi_held_remove(thread_t *t, mutex_t *m)
+{
+    for (mutex_t **pp = &t->pi_held; *pp; pp = &(*pp)->pi_next) {
+        if (*pp == m) {
+            *pp = m->pi_next;
+            m->pi_next = NULL;
+            return;
+        }
+    }
+}
+
+void mutex_init(mutex_t *m, const char *name)
+{
+    m->owner = 0;
+    waitq_init(&m->waiters);
+    m->pi_next = NULL;
+    m->name = name;
+}
+
+static void mutex_lock_slow(mutex_t *m, thread_t *cur)
+{
+    uint64_t flags = spin_lock_irqsave(&s_pi_lock);
+    for (;;) {
+        uintptr_t o = __atomic_load_n(&m->owner, __ATOMIC_RELAXED);
+        if (o == 0) {
+            // Released before we got here; nobody is queued.
+            if (__atomic_compare_exchange_n(&m->owner, &o, (uintptr_t)cur, false,
+                                            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+                break;
+            }
+            continue;
+        }
+        if (!(o & MUTEX_F_WAITERS)) {
+            // First waiter: route the owner's unlock to the slow path and let
+            // m count towards its inherited priority.
+            if (!__atomic_compare_exchange_n(&m->owner, &o, o | MUTEX_F_WAITERS, false,
+                                             __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                continue;
+            }
+            pi_held_add(owner_of(o), m);
+        }
+
+        cur->pi_blocked_on = m;
+        pi_boost(owner_of(o), cur->priority);
+        (void)waitq_wait(&m->waiters, &s_pi_lock, UINT64_MAX);
+        // The unlocker made us the owner before waking us.
+        if (owner_of(__atomic_load_n(&m->owner, __ATOMIC_RELAXED)) == cur) {
+            break;
+        }
+    }
+    spin_unlock_irqrestore(&s_pi_lock, flags);
+}
+
+void mutex_lock(mutex_t *m)
+{
+    ASSERT_THREAD_CONTEXT();
+    thread_t *cur = sched_current();
+
+    uintptr_t o = 0;
+    if (__atomic_compare_exchange_n(&m->owner, &o, (uintptr_t)cur, false,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return;
+    }
+    if (owner_of(o) == cur) {
+        panic("mutex_lock: recursive lock");
+    }
+    mutex_lock_slow(m, cur);
+}
+
+bool mutex_trylock(mutex_t *m)
+{
+    ASSERT_THREAD_CONTEXT();
+    uintptr_t o = 0;
+    return __atomic_compare_exchange_n(&m->owner, &o, (uintptr_t)sched_current(), false,
+                                       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+static void mutex_unlock_slow(mutex_t *m, thread_t *cur)
+{
+    uint64_t flags = spin_lock_irqsave(&s_pi_lock);
+    pi_held_remove(cur, m);
+
+    wait_entry_t *e = top_waiter(m);
+    if (!e) {
+        __atomic_store_n(&m->owner, 0, __ATOMIC_RELEASE);
+    } else {
+        // Hand over directly, so the waiter cannot be overtaken and the
+        // remaining waiters start boosting their new owner at once.
+        thread_t *next = e->thread;
+        const bool more = m->waiters.nr_waiters > 1u;
+        __atomic_store_n(&m->owner, (uintptr_t)next | (more ? MUTEX_F_WAITERS : 0u),
+                         __ATOMIC_RELEASE);
+        next->pi_blocked_on = NULL;
+        waitq_wake_entry(&m->waiters, e);
+        if (more) {
+            pi_held_add(next, m);
+            pi_update(next);
+        }
+    }
+    // Give back what m's waiters lent us.
+    pi_update(cur);
+    spin_unlock_irqrestore(&s_pi_lock, flags);
+}
+
+void mutex_unlock(mutex_t *m)
+{
+    ASSERT_THREAD_CONTEXT();
+    thread_t *cur = sched_current();
+
+    uintptr_t o = (uintptr_t)cur;
+    if (__atomic_compare_exchange_n(&m->owner, &o, 0, false,
+                                    __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        return;
+    }
+    if (owner_of(o) != cur) {
+        panic("mutex_unlock: not the owner");
+    }
+    mutex_unlock_slow(m, cur);
+}
+
+bool mutex_is_held(const mutex_t *m)
+{
+    return owner_of(__atomic_load_n(&m->owner, __ATOMIC_RELAXED)) == sched_current();
+}
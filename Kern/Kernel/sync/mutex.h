@@ -0,0 +1,49 @@
+// OS/Kern/Kernel/sync/mutex.h
+//
+// Sleeping mutex with priority inheritance.
+//
+// - Uncontended lock/unlock is a single compare-and-swap on `owner`.
+// - A contended locker sleeps and lends its priority to the owner, and on to
+//   the owner of whatever mutex that owner is itself waiting for, so a
+//   low-priority holder cannot stall a high-priority waiter behind
+//   medium-priority work.
+// - Unlock hands the mutex directly to the highest-priority waiter (FIFO
+//   among equals), which then runs with the priority of the remaining
+//   waiters.
+// - Not recursive; only the owner may unlock.
+//
+// Thread context only (not the idle thread). A mutex may be held across a
+// sleep, unlike a spinlock, but not taken inside a spinlock section.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sched/waitqueue.h"
+
+typedef struct mutex {
+    uintptr_t     owner;    // owning thread_t | MUTEX_F_WAITERS, 0 if free
+    wait_queue_t  waiters;  // under the PI lock (mutex.c)
+    struct mutex *pi_next;  // owner's thread_t.pi_held, while contended
+    const char   *name;
+} mutex_t;
+
+// owner bit: threads are queued, so unlock must take the slow path.
+#define MUTEX_F_WAITERS ((uintptr_t)1u)
+
+#define MUTEX_INIT(n) \
+    { .owner = 0, .waiters = WAIT_QUEUE_INIT, .pi_next = NULL, .name = (n) }
+
+void mutex_init(mutex_t *m, const char *name);
+
+void mutex_lock(mutex_t *m);
+
+// Take `m` only if it is free. Returns true on success.
+bool mutex_trylock(mutex_t *m);
+
+void mutex_unlock(mutex_t *m);
+
+// True if the calling thread owns `m`.
+bool mutex_is_held(const mutex_t *m);
@@ -0,0 +1,66 @@
+// OS/Kern/Kernel/sync/rwlock.c
+
+#include "sync/rwlock.h"
+
+#include "contracts.h"
+#include "panic.h"
+
+void rwlock_init(rwlock_t *rw)
+{
+    spin_init(&rw->lock);
+    rw->readers = 0;
+    rw->writers_waiting = 0;
+    rw->writer = false;
+    waitq_init(&rw->read_wait);
+    waitq_init(&rw->write_wait);
+}
+
+void rwlock_read_lock(rwlock_t *rw)
+{
+    ASSERT_THREAD_CONTEXT();
+    uint64_t flags = spin_lock_irqsave(&rw->lock);
+    while (rw->writer || rw->writers_waiting != 0) {
+        (void)waitq_wait(&rw->read_wait, &rw->lock, UINT64_MAX);
+    }
+    rw->readers++;
+    spin_unlock_irqrestore(&rw->lock, flags);
+}
+
+void rwlock_read_unlock(rwlock_t *rw)
+{
+    uint64_t flags = spin_lock_irqsave(&rw->lock);
+    if (rw->readers == 0) {
+        panic("rwlock_read_unlock: not read-locked");
+    }
+    if (--rw->readers == 0) {
+        (void)waitq_wake_one(&rw->write_wait);
+    }
+    spin_unlock_irqrestore(&rw->lock, flags);
+}
+
+void rwlock_write_lock(rwlock_t *rw)
+{
+    ASSERT_THREAD_CONTEXT();
+    uint64_t flags = spin_lock_irqsave(&rw->lock);
+    rw->writers_waiting++;
+    while (rw->writer || rw->readers != 0) {
+        (void)waitq_wait(&rw->write_wait, &rw->lock, UINT64_MAX);
+    }
+    rw->writers_waiting--;
+    rw->writer = true;
+    spin_unlock_irqrestore(&rw->lock, flags);
+}
+
+void rwlock_write_unlock(rwlock_t *rw)
+{
+    uint64_t flags = spin_lock_irqsave(&rw->lock);
+    if (!rw->writer) {
+        panic("rwlock_write_unlock: not write-locked");
+    }
+    rw->writer = false;
+    // Queued writers go first; readers only once none is left.
+    if (!waitq_wake_one(&rw->write_wait)) {
+        (void)waitq_wake_all(&rw->read_wait);
+    }
+    spin_unlock_irqrestore(&rw->lock, flags);
+}
@@ -0,0 +1,40 @@
+// OS/Kern/Kernel/sync/rwlock.h
+//
+// Sleeping reader/writer lock.
+//
+// Any number of readers or one writer. Writer-preferring: once a writer
+// waits, new readers queue behind it, so a stream of readers cannot starve
+// writers. Readers are not tracked individually, so there is no priority
+// inheritance; use a mutex_t where a high-priority thread must not wait on
+// a low-priority one.
+//
+// Thread context only (not the idle thread).
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sched/waitqueue.h"
+#include "sync/spinlock.h"
+
+typedef struct rwlock {
+    spinlock_t   lock;            // guards everything below
+    uint32_t     readers;         // readers inside
+    uint32_t     writers_waiting; // writers queued or about to be
+    bool         writer;          // a writer is inside
+    wait_queue_t read_wait;
+    wait_queue_t write_wait;
+} rwlock_t;
+
+#define RWLOCK_INIT                                                        \
+    { .lock = SPINLOCK_INIT, .readers = 0, .writers_waiting = 0,           \
+      .writer = false, .read_wait = WAIT_QUEUE_INIT, .write_wait = WAIT_QUEUE_INIT }
+
+void rwlock_init(rwlock_t *rw);
+
+void rwlock_read_lock(rwlock_t *rw);
+void rwlock_read_unlock(rwlock_t *rw);
+
+void rwlock_write_lock(rwlock_t *rw);
+void rwlock_write_unlock(rwlock_t *rw);
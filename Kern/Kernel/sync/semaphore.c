@@ -0,0 +1,54 @@
+// OS/Kern/Kernel/sync/semaphore.c
+
+#include "sync/semaphore.h"
+
+#include "contracts.h"
+#include "timer_generic.h"
+
+void sem_init(semaphore_t *s, uint32_t count)
+{
+    spin_init(&s->lock);
+    s->count = count;
+    waitq_init(&s->waiters);
+}
+
+bool sem_down_until(semaphore_t *s, uint64_t deadline)
+{
+    ASSERT_THREAD_CONTEXT();
+    uint64_t flags = spin_lock_irqsave(&s->lock);
+    // A woken waiter can still be overtaken by sem_trydown(); look again.
+    while (s->count == 0) {
+        if (deadline != UINT64_MAX && time_now() >= deadline) {
+            spin_unlock_irqrestore(&s->lock, flags);
+            return false;
+        }
+        (void)waitq_wait(&s->waiters, &s->lock, deadline);
+    }
+    s->count--;
+    spin_unlock_irqrestore(&s->lock, flags);
+    return true;
+}
+
+void sem_down(semaphore_t *s)
+{
+    (void)sem_down_until(s, UINT64_MAX);
+}
+
+bool sem_trydown(semaphore_t *s)
+{
+    uint64_t flags = spin_lock_irqsave(&s->lock);
+    const bool ok = s->count != 0;
+    if (ok) {
+        s->count--;
+    }
+    spin_unlock_irqrestore(&s->lock, flags);
+    return ok;
+}
+
+void sem_up(semaphore_t *s)
+{
+    uint64_t flags = spin_lock_irqsave(&s->lock);
+    s->count++;
+    (void)waitq_wake_one(&s->waiters);
+    spin_unlock_irqrestore(&s->lock, flags);
+}
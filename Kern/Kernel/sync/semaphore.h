@@ -0,0 +1,39 @@
+// OS/Kern/Kernel/sync/semaphore.h
+//
+// Counting semaphore on a wait queue.
+//
+// sem_down() sleeps while the count is zero; waiters are woken in FIFO
+// order, one per sem_up(). There is no owner, hence no priority
+// inheritance: use a mutex_t for mutual exclusion.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sched/waitqueue.h"
+#include "sync/spinlock.h"
+
+typedef struct semaphore {
+    spinlock_t   lock;     // guards count and waiters
+    uint32_t     count;
+    wait_queue_t waiters;
+} semaphore_t;
+
+#define SEMAPHORE_INIT(n) \
+    { .lock = SPINLOCK_INIT, .count = (n), .waiters = WAIT_QUEUE_INIT }
+
+void sem_init(semaphore_t *s, uint32_t count);
+
+// Take one unit, sleeping until one is available. Thread context only.
+void sem_down(semaphore_t *s);
+
+// sem_down() that gives up once the counter reaches `deadline` (time_now()
+// units). Returns false on timeout. Thread context only.
+bool sem_down_until(semaphore_t *s, uint64_t deadline);
+
+// Take one unit if available. Any context.
+bool sem_trydown(semaphore_t *s);
+
+// Release one unit, waking the longest waiter. Any context.
+void sem_up(semaphore_t *s);
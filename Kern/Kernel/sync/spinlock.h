@@ -0,0 +1,123 @@
+// OS/Kern/Kernel/sync/spinlock.h
+//
+// Ticket spinlock for SMP critical sections.
+//
+// A locker takes the next ticket and waits until `owner` reaches it, so the
+// lock is granted in FIFO order and no CPU starves. Waiters sleep in WFE
+// with the exclusive monitor armed on the word they wait for: the releasing
+// store clears the monitor, which generates the wakeup event, so no SEV is
+// needed and waiting CPUs do not hammer the line. For hot global locks at
+// higher core counts see mcs_lock.h.
+//
+// Locks are never held across a context switch or a sleep. Callers that can
+// race with an IRQ handler on the same CPU must use the irqsave variants.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "irq.h"
+
+typedef struct spinlock {
+    union {
+        uint32_t val;
+        struct {
+            uint16_t owner;  // ticket being served
+            uint16_t next;   // next ticket handed out; free when == owner
+        } t;
+    };
+} spinlock_t;
+
+_Static_assert(sizeof(spinlock_t) == 4, "spinlock_t: one 32-bit word");
+
+#define SPINLOCK_INIT { .val = 0 }
+
+// Wait primitives: return once the (acquire) load of `*p` satisfies the
+// condition, sleeping in WFE between checks. `sevl` makes the first WFE fall
+// through, so the value is always re-read after the monitor is armed.
+static inline void spin_wait_eq16(const volatile uint16_t *p, uint16_t val) {
+    uint32_t tmp;
+    __asm__ volatile(
+        "   sevl\n"
+        "1: wfe\n"
+        "   ldaxrh  %w0, %1\n"
+        "   cmp     %w0, %w2\n"
+        "   b.ne    1b\n"
+        : "=&r"(tmp)
+        : "Q"(*p), "r"((uint32_t)val)
+        : "memory", "cc");
+}
+
+static inline void spin_wait_eq32(const volatile uint32_t *p, uint32_t val) {
+    uint32_t tmp;
+    __asm__ volatile(
+        "   sevl\n"
+        "1: wfe\n"
+        "   ldaxr   %w0, %1\n"
+        "   cmp     %w0, %w2\n"
+        "   b.ne    1b\n"
+        : "=&r"(tmp)
+        : "Q"(*p), "r"(val)
+        : "memory", "cc");
+}
+
+static inline uint64_t spin_wait_nonzero64(const volatile uint64_t *p) {
+    uint64_t v;
+    __asm__ volatile(
+        "   sevl\n"
+        "1: wfe\n"
+        "   ldaxr   %0, %1\n"
+        "   cbz     %0, 1b\n"
+        : "=&r"(v)
+        : "Q"(*p)
+        : "memory");
+    return v;
+}
+
+static inline void spin_init(spinlock_t *l) {
+    l->val = 0;
+}
+
+static inline bool spin_trylock(spinlock_t *l) {
+    uint32_t v = __atomic_load_n(&l->val, __ATOMIC_RELAXED);
+    const uint16_t owner = (uint16_t)v;
+    const uint16_t next = (uint16_t)(v >> 16);
+    if (owner != next) {
+        return false;
+    }
+    const uint32_t taken = v + (1u << 16);
+    return __atomic_compare_exchange_n(&l->val, &v, taken, false,
+                                       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+static inline void spin_lock(spinlock_t *l) {
+    const uint16_t ticket = __atomic_fetch_add(&l->t.next, 1u, __ATOMIC_RELAXED);
+    if (__atomic_load_n(&l->t.owner, __ATOMIC_ACQUIRE) == ticket) {
+        return;
+    }
+    spin_wait_eq16(&l->t.owner, ticket);
+}
+
+static inline void spin_unlock(spinlock_t *l) {
+    // Only the holder writes `owner`.
+    const uint16_t owner = l->t.owner;
+    __atomic_store_n(&l->t.owner, (uint16_t)(owner + 1u), __ATOMIC_RELEASE);
+}
+
+static inline bool spin_is_locked(const spinlock_t *l) {
+    const uint32_t v = __atomic_load_n(&l->val, __ATOMIC_RELAXED);
+    return (uint16_t)v != (uint16_t)(v >> 16);
+}
+
+// Mask IRQs on this CPU, then take the lock. Returns the previous DAIF.
+static inline uint64_t spin_lock_irqsave(spinlock_t *l) {
+    uint64_t flags = irq_save();
+    spin_lock(l);
+    return flags;
+}
+
+static inline void spin_unlock_irqrestore(spinlock_t *l, uint64_t flags) {
+    spin_unlock(l);
+    irq_restore(flags);
+}
@@ -2,6 +2,8 @@
 
 #include <stdint.h>
 
+#include "sched/bandwidth.h"
+
 // Forward declare cap table.
 typedef struct cap_table cap_table_t;
 // cap_handle_t is the opaque handle type that will eventually cross the Core ABI.
@@ -19,6 +21,9 @@ typedef struct task {
     cap_handle_t self_cap;
     cap_handle_t timer_cap;
     cap_handle_t log_cap;
+
+    // CPU bandwidth reservation shared by the task's threads.
+    task_bw_t bw;
 } task_t;
 
 static inline void task_init(task_t *t, uint64_t id, cap_table_t *caps) {
@@ -27,4 +32,5 @@ static inline void task_init(task_t *t, uint64_t id, cap_table_t *caps) {
     t->self_cap = 0;
     t->timer_cap = 0;
     t->log_cap = 0;
+    task_bw_init(&t->bw);
 }
@@ -0,0 +1,417 @@
+// OS/Kern/Kernel/timer/timer_wheel.c
+//
+// Hierarchical timer wheel (see timer_wheel.h).
+//
+// Each CPU has KTIMER_LEVELS levels of 64 buckets. Level n buckets are 8^n
+// granules wide, so a level covers 64 buckets of its own width and the whole
+// wheel spans ~64 * 8^(KTIMER_LEVELS-1) granules. A timer is hashed once, by
+// its distance from now, into the level whose buckets are no coarser than
+// 1/8 of that distance, and stays there until it fires: there is no
+// cascading. A per-level bitmap of non-empty buckets finds the next due
+// bucket in O(levels) without touching any timer, which is what the one-shot
+// timer is programmed with.
+//
+// wheel->clk is the next granule to process. A level-n bucket is processed
+// when clk is a multiple of its width, so timers are rounded up to bucket
+// boundaries and never fire early.
+
+#include "timer/timer_wheel.h"
+
+#include "config.h"
+#include "irq.h"
+#ifdef DEBUG
+#include "debug/panic.h"
+#endif
+#include "smp/percpu.h"
+#include "sync/spinlock.h"
+#include "timer_generic.h"
+
+#define KTIMER_LVL_MASK    (KTIMER_LVL_SIZE - 1u)
+#define KTIMER_CLK_SHIFT   3u
+#define KTIMER_CLK_MASK    ((1u << KTIMER_CLK_SHIFT) - 1u)
+
+#define LVL_SHIFT(n)       ((n) * KTIMER_CLK_SHIFT)
+#define LVL_GRAN(n)        (1ull << LVL_SHIFT(n))
+// Smallest distance (granules) hashed into level n >= 1.
+#define LVL_START(n)       ((uint64_t)(KTIMER_LVL_SIZE - 1u) << LVL_SHIFT((n) - 1u))
+// Distances beyond the last level are clamped; the timer is re-hashed when
+// it comes round instead of firing early.
+#define WHEEL_MAX_DELTA    (LVL_START(KTIMER_LEVELS) - LVL_GRAN(KTIMER_LEVELS - 1u))
+
+static uint64_t s_granule_ticks;
+
+static inline ktimer_wheel_t *this_wheel(void)
+{
+    return &this_cpu_ptr()->timer_wheel;
+}
+
+static inline uint64_t granule_ticks(void)
+{
+    if (s_granule_ticks == 0) {
+        uint64_t g = (time_freq() * CONFIG_KTIMER_GRANULE_US) / 1000000u;
+        s_granule_ticks = g ? g : 1u;
+    }
+    return s_granule_ticks;
+}
+
+static inline uint64_t now_granule(void)
+{
+    return time_now() / granule_ticks();
+}
+
+// Distance in buckets from `start` to the next set bit of `map`, wrapping;
+// -1 if the map is empty.
+static int next_pending_bucket(uint64_t map, uint32_t start)
+{
+    const uint64_t hi = map & (~0ull << start);
+    if (hi) {
+        return __builtin_ctzll(hi) - (int)start;
+    }
+    const uint64_t lo = map & ((1ull << start) - 1u);
+    if (lo) {
+        return __builtin_ctzll(lo) + (int)(KTIMER_LVL_SIZE - start);
+    }
+    return -1;
+}
+
+// Earliest granule at which a non-empty bucket is processed. Caller holds
+// w->lock.
+static uint64_t wheel_next_expiry(const ktimer_wheel_t *w)
+{
+    uint64_t next = UINT64_MAX;
+    uint64_t clk = w->clk;
+    for (uint32_t lvl = 0; lvl < KTIMER_LEVELS; lvl++) {
+        const int pos = next_pending_bucket(w->pending_map[lvl],
+                                            (uint32_t)(clk & KTIMER_LVL_MASK));
+        if (pos >= 0) {
+            const uint64_t due = (clk + (uint64_t)pos) << LVL_SHIFT(lvl);
+            if (due < next) {
+                next = due;
+            }
+        }
+        // The next level's clock: if this level's low bits are not zero its
+        // current bucket is already behind us, so look one bucket further.
+        const uint64_t adj = (clk & KTIMER_CLK_MASK) ? 1u : 0u;
+        clk = (clk >> KTIMER_CLK_SHIFT) + adj;
+    }
+    return next;
+}
+
+// Hash `t` (t->expires set) into w. Returns the granule its bucket is due.
+// Caller holds w->lock.
+static uint64_t wheel_enqueue(ktimer_wheel_t *w, ktimer_t *t)
+{
+    uint64_t expires = t->expires < w->clk ? w->clk : t->expires;
+    uint64_t delta = expires - w->clk;
+
+    uint32_t lvl = 0;
+    while (lvl < KTIMER_LEVELS - 1u && delta >= LVL_START(lvl + 1u)) {
+        lvl++;
+    }
+    if (delta >= LVL_START(KTIMER_LEVELS)) {
+        expires = w->clk + WHEEL_MAX_DELTA;
+    }
+
+    // Round up to the bucket boundary: never early.
+    const uint64_t bucket = (expires + LVL_GRAN(lvl) - 1u) >> LVL_SHIFT(lvl);
+    const uint32_t idx = lvl * KTIMER_LVL_SIZE + (uint32_t)(bucket & KTIMER_LVL_MASK);
+
+    ktimer_t **head = &w->buckets[idx];
+    t->next = *head;
+    if (t->next) {
+        t->next->pprev = &t->next;
+    }
+    t->pprev = head;
+    *head = t;
+    t->slot = (uint16_t)idx;
+    t->wheel = w;
+    w->pending_map[lvl] |= 1ull << (idx & KTIMER_LVL_MASK);
+    w->nr_pending++;
+
+    const uint64_t due = bucket << LVL_SHIFT(lvl);
+    if (due < w->next_expiry) {
+        w->next_expiry = due;
+    }
+    return due;
+}
+
+// Unlink a pending timer. Caller holds w->lock.
+static void wheel_detach(ktimer_wheel_t *w, ktimer_t *t)
+{
+    *t->pprev = t->next;
+    if (t->next) {
+        t->next->pprev = t->pprev;
+    }
+    t->next = NULL;
+    t->pprev = NULL;
+    // The bucket may already have been collected by ktimer_run(); its bit
+    // is then clear or owned by newer timers.
+    if (w->buckets[t->slot] == NULL) {
+        w->pending_map[t->slot / KTIMER_LVL_SIZE] &=
+            ~(1ull << (t->slot & KTIMER_LVL_MASK));
+    }
+    w->nr_pending--;
+}
+
+// Catch the wheel's clock up to granule `now` (an idle wheel's clock lags)
+// without skipping a due bucket, then hash `t` in. Returns the granule its
+// bucket is due. Caller holds w->lock.
+static uint64_t wheel_arm_locked(ktimer_wheel_t *w, ktimer_t *t, uint64_t now)
+{
+    if (w->nr_pending == 0) {
+        w->next_expiry = UINT64_MAX;
+        if (w->clk < now) {
+            w->clk = now;
+        }
+    } else {
+        const uint64_t to = w->next_expiry < now ? w->next_expiry : now;
+        if (w->clk < to) {
+            w->clk = to;
+        }
+    }
+    return wheel_enqueue(w, t);
+}
+
+// Run every timer of w due by granule `now`. Caller holds w->lock, which is
+// dropped around each callback.
+static void wheel_run_locked(ktimer_wheel_t *w, uint64_t now)
+{
+    // Buckets collected in one step; cancel may unlink from them while the
+    // lock is dropped around callbacks.
+    ktimer_t *heads[KTIMER_LEVELS];
+
+    while (w->nr_pending != 0) {
+        if (w->next_expiry > now) {
+            if (w->clk < now) {
+                w->clk = now;
+            }
+            break;
+        }
+        if (w->clk < w->next_expiry) {
+            w->clk = w->next_expiry;
+        }
+
+        const uint64_t clk = w->clk;
+        uint32_t n = 0;
+        uint64_t c = clk;
+        for (uint32_t lvl = 0; lvl < KTIMER_LEVELS; lvl++) {
+            const uint32_t idx = (uint32_t)(c & KTIMER_LVL_MASK);
+            const uint64_t bit = 1ull << idx;
+            if (w->pending_map[lvl] & bit) {
+                w->pending_map[lvl] &= ~bit;
+                ktimer_t **b = &w->buckets[lvl * KTIMER_LVL_SIZE + idx];
+                heads[n] = *b;
+                heads[n]->pprev = &heads[n];
+                *b = NULL;
+                n++;
+            }
+            if (c & KTIMER_CLK_MASK) {
+                break;
+            }
+            c >>= KTIMER_CLK_SHIFT;
+        }
+        w->clk = clk + 1u;
+        w->next_expiry = UINT64_MAX;
+
+        for (uint32_t i = 0; i < n; i++) {
+            while (heads[i]) {
+                ktimer_t *t = heads[i];
+                wheel_detach(w, t);
+                if (t->expires > clk) {
+                    // Clamped beyond the wheel's span: not due yet.
+                    (void)wheel_enqueue(w, t);
+                    continue;
+                }
+                __atomic_store_n(&w->running, t, __ATOMIC_RELAXED);
+                spin_unlock(&w->lock);
+                t->fn(t->arg);
+                spin_lock(&w->lock);
+                __atomic_store_n(&w->running, NULL, __ATOMIC_RELEASE);
+            }
+        }
+        w->next_expiry = w->nr_pending ? wheel_next_expiry(w) : UINT64_MAX;
+    }
+}
+
+void ktimer_init(ktimer_t *t, ktimer_fn_t fn, void *arg)
+{
+    t->next = NULL;
+    t->pprev = NULL;
+    t->expires = 0;
+    t->wheel = NULL;
+    t->slot = 0;
+    t->fn = fn;
+    t->arg = arg;
+}
+
+bool ktimer_arm(ktimer_t *t, uint64_t deadline)
+{
+    const uint64_t gran = granule_ticks();
+    uint64_t flags = irq_save();
+
+    bool was_pending = false;
+    ktimer_wheel_t *old = t->wheel;
+    if (old) {
+        spin_lock(&old->lock);
+        if (ktimer_pending(t)) {
+            wheel_detach(old, t);
+            was_pending = true;
+        }
+        spin_unlock(&old->lock);
+    }
+
+    ktimer_wheel_t *w = this_wheel();
+    spin_lock(&w->lock);
+    const uint64_t prev_next = w->nr_pending ? w->next_expiry : UINT64_MAX;
+    t->expires = deadline / gran + (deadline % gran ? 1u : 0u);
+    const uint64_t due = wheel_arm_locked(w, t, now_granule());
+    spin_unlock(&w->lock);
+
+    // New earliest timer on this CPU: pull the one-shot event in.
+    if (due < prev_next) {
+        const uint64_t at = due * gran;
+        const uint64_t armed = event_oneshot_deadline();
+        if (armed == 0 || at < armed) {
+            event_arm_oneshot(at);
+        }
+    }
+    irq_restore(flags);
+    return was_pending;
+}
+
+bool ktimer_cancel(ktimer_t *t)
+{
+    ktimer_wheel_t *w = t->wheel;
+    if (!w) {
+        return false;
+    }
+
+    uint64_t flags = spin_lock_irqsave(&w->lock);
+    const bool was_pending = ktimer_pending(t);
+    if (was_pending) {
+        wheel_detach(w, t);
+    }
+    spin_unlock_irqrestore(&w->lock, flags);
+
+    while (__atomic_load_n(&w->running, __ATOMIC_ACQUIRE) == t) {
+        __asm__ volatile("yield" ::: "memory");
+    }
+    return was_pending;
+}
+
+void ktimer_run(void)
+{
+    ktimer_wheel_t *w = this_wheel();
+    if (__atomic_load_n(&w->nr_pending, __ATOMIC_RELAXED) == 0) {
+        return;
+    }
+
+    spin_lock(&w->lock);
+    wheel_run_locked(w, now_granule());
+    spin_unlock(&w->lock);
+}
+
+uint64_t ktimer_next_event(void)
+{
+    ktimer_wheel_t *w = this_wheel();
+    spin_lock(&w->lock);
+    const uint64_t next = w->nr_pending ? w->next_expiry : UINT64_MAX;
+    spin_unlock(&w->lock);
+    if (next == UINT64_MAX) {
+        return UINT64_MAX;
+    }
+    return next * granule_ticks();
+}
+
+#ifdef DEBUG
+typedef struct ktimer_test {
+    ktimer_t t;
+    uint64_t armed;     // wheel granule it was armed at
+    uint64_t fired_at;
+    uint32_t fired;
+    bool     cancelled;
+} ktimer_test_t;
+
+static uint64_t s_test_now;
+
+static void ktimer_test_fn(void *arg)
+{
+    ktimer_test_t *r = arg;
+    r->fired++;
+    r->fired_at = s_test_now;
+}
+
+static void ktimer_expect(int cond, const char *msg)
+{
+    if (!cond) {
+        panic_with_prefix("ktimer_selftest: ", msg);
+    }
+}
+#endif
+
+void ktimer_selftest(void)
+{
+#ifdef DEBUG
+    // Distances in granules: every level, bucket edges, and two beyond the
+    // wheel's span that must be re-hashed rather than fire early.
+    static const uint64_t deltas[] = {
+        0, 1, 2, 7, 8, 63, 64, 65, 100, 500, 511, 512, 1000, 4000, 4096,
+        33000, 70001, 262143, 1ull << 21, 3000001, 1ull << 24,
+        WHEEL_MAX_DELTA + 1000u, 1ull << 33,
+    };
+    enum { N = sizeof(deltas) / sizeof(deltas[0]) };
+    // Private wheel on a synthetic clock: the CPU's own wheel is untouched.
+    static ktimer_wheel_t w;
+    static ktimer_test_t recs[N];
+
+    s_test_now = 12345u;
+    spin_lock(&w.lock);
+    for (uint32_t i = 0; i < N; i++) {
+        ktimer_init(&recs[i].t, ktimer_test_fn, &recs[i]);
+        recs[i].armed = s_test_now;
+        recs[i].t.expires = s_test_now + deltas[i];
+        (void)wheel_arm_locked(&w, &recs[i].t, s_test_now);
+    }
+    spin_unlock(&w.lock);
+    ktimer_expect(w.nr_pending == N, "count after arm");
+
+    // Cancel every fourth timer; re-arm the first of them further out.
+    for (uint32_t i = 0; i < N; i += 4) {
+        ktimer_expect(ktimer_cancel(&recs[i].t), "cancel of pending timer");
+        ktimer_expect(!ktimer_cancel(&recs[i].t), "second cancel");
+        recs[i].cancelled = true;
+    }
+    spin_lock(&w.lock);
+    recs[0].cancelled = false;
+    recs[0].t.expires = s_test_now + 100u;
+    (void)wheel_arm_locked(&w, &recs[0].t, s_test_now);
+    spin_unlock(&w.lock);
+
+    // Jump straight to each due bucket, as the one-shot event would.
+    uint32_t steps = 0;
+    spin_lock(&w.lock);
+    while (w.nr_pending != 0) {
+        ktimer_expect(++steps < 100000u, "wheel does not drain");
+        if (w.next_expiry > s_test_now) {
+            s_test_now = w.next_expiry;
+        }
+        wheel_run_locked(&w, s_test_now);
+    }
+    spin_unlock(&w.lock);
+
+    for (uint32_t i = 0; i < N; i++) {
+        const ktimer_test_t *r = &recs[i];
+        if (r->cancelled) {
+            ktimer_expect(r->fired == 0, "cancelled timer fired");
+            continue;
+        }
+        ktimer_expect(r->fired == 1, "timer did not fire exactly once");
+        ktimer_expect(r->fired_at >= r->t.expires, "timer fired early");
+        // Hashed no coarser than 1/8 of the distance (8/63 at worst).
+        const uint64_t late = r->fired_at - r->t.expires;
+        ktimer_expect(late <= (r->t.expires - r->armed) / 7u, "timer fired too late");
+        ktimer_expect(!ktimer_pending(&r->t), "fired timer still pending");
+    }
+    ktimer_expect(w.next_expiry == UINT64_MAX, "next expiry after drain");
+#endif
+}
@@ -0,0 +1,81 @@
+// OS/Kern/Kernel/timer/timer_wheel.h
+//
+// Kernel timers: a hashed hierarchical timer wheel per CPU.
+//
+// - Intrusive: callers embed a ktimer_t, nothing is allocated.
+// - O(1) arm and cancel regardless of how many timers are pending; expiry
+//   work is proportional to the timers that actually fire.
+// - Resolution is CONFIG_KTIMER_GRANULE_US. A timer never fires early; it may
+//   fire late by up to 1/8 of its remaining time when armed (far timers sit
+//   in coarser buckets and are never re-sorted).
+// - Timers run on the CPU that armed them, from the timer interrupt, with
+//   IRQs masked. Callbacks must be short and must not block (sched_wake() is
+//   the typical body).
+//
+// The wheel is driven by the generic timer's one-shot event (timer_generic.h),
+// not by the periodic tick, so it keeps working while the tick is stopped.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sync/spinlock.h"
+
+typedef void (*ktimer_fn_t)(void *arg);
+
+typedef struct ktimer {
+    struct ktimer  *next;
+    struct ktimer **pprev;          // NULL while not pending
+    uint64_t        expires;        // deadline in wheel granules (rounded up)
+    struct ktimer_wheel *wheel;     // wheel it was last armed on
+    uint16_t        slot;           // bucket index while pending
+    ktimer_fn_t     fn;
+    void           *arg;
+} ktimer_t;
+
+#define KTIMER_LVL_BITS    6u
+#define KTIMER_LVL_SIZE    (1u << KTIMER_LVL_BITS)
+#define KTIMER_LEVELS      8u
+
+// One wheel per CPU, kept in the per-CPU block (smp/percpu.h). Only
+// timer_wheel.c looks inside.
+typedef struct ktimer_wheel {
+    spinlock_t lock;
+    uint64_t   clk;          // next granule to process
+    uint64_t   next_expiry;  // earliest due granule (may be early after a cancel)
+    uint32_t   nr_pending;
+    ktimer_t  *running;      // timer whose callback is executing, if any
+    uint64_t   pending_map[KTIMER_LEVELS];
+    ktimer_t  *buckets[KTIMER_LEVELS * KTIMER_LVL_SIZE];
+} ktimer_wheel_t;
+
+void ktimer_init(ktimer_t *t, ktimer_fn_t fn, void *arg);
+
+// Arm `t` on the calling CPU to fire at `deadline` (time_now() units; a past
+// deadline fires at the next timer interrupt). Re-arming a pending timer
+// moves it. Returns true if it was pending. Any context. Callers serialize
+// arm/cancel of one timer.
+bool ktimer_arm(ktimer_t *t, uint64_t deadline);
+
+// Disarm `t`. Returns true if it was pending (its callback will not run).
+// If the callback is running on another CPU, waits for it to finish, so `t`
+// may be freed afterwards. Must not be called from t's own callback.
+bool ktimer_cancel(ktimer_t *t);
+
+static inline bool ktimer_pending(const ktimer_t *t)
+{
+    return t->pprev != NULL;
+}
+
+// Timer interrupt hook (IRQ context): run this CPU's expired timers.
+void ktimer_run(void);
+
+// Counter value at which this CPU's earliest timer is due, or UINT64_MAX.
+// IRQs masked.
+uint64_t ktimer_next_event(void);
+
+// Debug-only self test (DEBUG builds): arm, cancel and expiry bounds on a
+// private wheel.
+void ktimer_selftest(void);
@@ -4,6 +4,7 @@
 #include "contracts.h"
 #include "irq.h"
 #include "mm/mem.h"
+#include "sched/sched.h"
 
 /*
  * Work item cache (thread-context only).
@@ -52,6 +53,8 @@ void workq_init(workq_t *q)
     if (!q) return;
     q->head = NULL;
     q->tail = NULL;
+    q->waiter = NULL;
+    spin_init(&q->lock);
 }
 
 bool workq_enqueue_from_irq(workq_t *q, work_item_t *item)
@@ -61,7 +64,7 @@ bool workq_enqueue_from_irq(workq_t *q, work_item_t *item)
 
     item->next = NULL;
 
-    uint64_t flags = irq_save();
+    uint64_t flags = spin_lock_irqsave(&q->lock);
     if (q->tail) {
         q->tail->next = item;
         q->tail = item;
@@ -69,7 +72,14 @@ bool workq_enqueue_from_irq(workq_t *q, work_item_t *item)
         q->head = item;
         q->tail = item;
     }
-    irq_restore(flags);
+    thread_t *w = q->waiter;
+    q->waiter = NULL;
+    spin_unlock_irqrestore(&q->lock, flags);
+
+    /* The consumer marked itself blocked before publishing `waiter`. */
+    if (w) {
+        sched_wake(w);
+    }
     return true;
 }
 
@@ -78,13 +88,31 @@ work_item_t *workq_dequeue(workq_t *q)
     ASSERT_THREAD_CONTEXT();
     if (!q) return NULL;
 
-    uint64_t flags = irq_save();
+    uint64_t flags = spin_lock_irqsave(&q->lock);
     work_item_t *it = q->head;
     if (it) {
         q->head = it->next;
         if (q->head == NULL) q->tail = NULL;
         it->next = NULL;
     }
-    irq_restore(flags);
+    spin_unlock_irqrestore(&q->lock, flags);
     return it;
 }
+
+void workq_wait(workq_t *q)
+{
+    ASSERT_THREAD_CONTEXT();
+    if (!q) return;
+
+    uint64_t flags = spin_lock_irqsave(&q->lock);
+    if (q->head) {
+        spin_unlock_irqrestore(&q->lock, flags);
+        return;
+    }
+    /* Mark blocked under the lock so a wake between unlock and block is not lost. */
+    q->waiter = sched_current();
+    sched_prepare_block();
+    spin_unlock(&q->lock);
+    sched_block_current();
+    irq_restore(flags);
+}
@@ -2,10 +2,13 @@
 /*
  * work_queue.h — Deferred work queue.
  *
- * Design (single-core bring-up):
- *  - Simple FIFO queue protected by irq_save()/irq_restore().
+ * Design:
+ *  - Simple FIFO queue protected by a spinlock taken with IRQs masked, so
+ *    any CPU's IRQ handler may post while a thread on another CPU drains.
  *  - IRQ context: enqueue only (must not allocate).
- *  - Thread context: dequeue and execute callbacks.
+ *  - Thread context: dequeue and execute callbacks. One consumer thread may
+ *    sleep in workq_wait() until an item arrives, so an idle consumer costs
+ *    no wakeups.
  *
  * This queue allows deferred processing of work items posted from interrupt
  * context to be executed safely in thread context.
@@ -15,10 +18,15 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "sync/spinlock.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// Forward declaration (defined in sched/thread.h).
+typedef struct thread thread_t;
+
 typedef void (*work_fn_t)(void *arg);
 
 typedef struct work_item {
@@ -30,6 +38,8 @@ typedef struct work_item {
 typedef struct workq {
     work_item_t *head;
     work_item_t *tail;
+    spinlock_t   lock;
+    thread_t    *waiter;   // consumer blocked in workq_wait(), if any
 } workq_t;
 
 // Global deferred work queue.
@@ -50,6 +60,12 @@ bool workq_enqueue_from_irq(workq_t *q, work_item_t *item);
 /* Dequeue from thread context only. Returns NULL if empty. */
 work_item_t *workq_dequeue(workq_t *q);
 
+/*
+ * Thread context only: block until the queue is non-empty (returns at once if
+ * it already is). Single consumer per queue.
+ */
+void workq_wait(workq_t *q);
+
 /*
  * Work item cache (thread-context only): allocate nodes ahead of time.
  * IRQ path must never allocate.
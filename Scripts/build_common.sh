@@ -637,9 +637,17 @@ compile_objects() {
     rel="${rel//\//_}"
     local obj="${obj_dir}/${rel%.*}.o"
 
+    # Kernel C never touches FP/SIMD registers: IRQ handlers and the
+    # scheduler must not clobber a thread's lazily switched FP state (see
+    # Kern/Kernel/sched/fpsimd.h). Core may use FP/SIMD in thread context.
+    local -a fp_flags=()
+    case "${src}" in
+      "${KERN_DIR}"/*) fp_flags=(-mgeneral-regs-only) ;;
+    esac
+
     case "${src}" in
       *.c)
-        "${CC}" "${CFLAGS_COMMON_ARR[@]}" \
+        "${CC}" "${CFLAGS_COMMON_ARR[@]}" ${fp_flags[@]+"${fp_flags[@]}"} \
           -I "${KERN_DIR}" \
           -I "${KERN_DIR}/ABI" \
           -I "${KERN_DIR}/HAL" \